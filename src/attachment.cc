@@ -0,0 +1,600 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "attachment.hh"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <openssl/hmac.h>
+
+#include "bands.hh"
+#include "base64.hh"
+#include "cipher.hh"
+#include "exception.hh"
+#include "json11.hh"
+#include "mapped_file.hh"
+#include "opdata.hh"
+#include "profile.hh"
+
+namespace {
+
+// Header of an attachment file: the magic, a version byte, the size of the
+// metadata, two unused bytes and the size of the icon, in little endian.
+constexpr std::size_t kHeaderSize = 16;
+const std::string kMagic = "OPCLDAT";
+constexpr uint8_t kVersion = 1;
+
+// The contents are stored as opdata01: a header holding the magic, the
+// plain text length and the initialization vector, followed by the cipher
+// text and a HMAC over all of it.
+constexpr std::size_t kOpHeaderSize = 32;
+constexpr std::size_t kOpHmacSize = 32;
+const std::string kOpMagic = "opdata01";
+
+const std::string kSuffix = ".attachment";
+
+/**
+ * Reads the HMAC following the cipher text and compares it with the HMAC
+ * computed over the header and the cipher text.
+ * @throw IntegrityError If the HMACs differ.
+ */
+void CheckHmac(HMAC_CTX* hmac_ctx, std::istream& src) {
+  std::array<uint8_t, kOpHmacSize> hmac_provided;
+  src.read(reinterpret_cast<char*>(hmac_provided.data()),
+           hmac_provided.size());
+  if (!src.good())
+    throw onepass::IoError("Read error.");
+
+  std::array<uint8_t, kOpHmacSize> hmac_computed = { { 0 } };
+  unsigned int len = hmac_computed.size();
+  HMAC_Final(hmac_ctx, hmac_computed.data(), &len);
+  assert(len == hmac_computed.size());
+
+  if (hmac_computed != hmac_provided) {
+    throw onepass::IntegrityError(
+        "HMAC integrity and authenticity check failed.");
+  }
+}
+
+uint64_t ReadLittleEndian(const char* data, std::size_t size) {
+  uint64_t value = 0;
+  for (std::size_t i = size; i > 0; --i)
+    value = (value << 8) | static_cast<uint8_t>(data[i - 1]);
+  return value;
+}
+
+} // namespace
+
+namespace onepass {
+
+constexpr std::size_t Attachment::kDefaultChunkSize;
+constexpr std::size_t Attachment::kParallelChunkSize;
+constexpr std::size_t AttachmentStream::kPageSize;
+constexpr std::size_t AttachmentStream::kDefaultCacheSize;
+
+Attachment::Attachment(const std::string& path, const Entry& entry,
+                       Profile& profile) : path_(path) {
+  assert(!profile.IsLocked());
+  if (entry.locked())
+    throw InternalError("Entry is locked.");
+
+  std::ifstream src(path, std::ios::in | std::ios::binary);
+  if (!src.is_open())
+    throw FileNotFoundError();
+
+  char header[kHeaderSize];
+  src.read(header, sizeof(header));
+  if (src.gcount() != sizeof(header) ||
+      std::memcmp(header, kMagic.data(), kMagic.size()) != 0) {
+    throw FormatError("Expected OPCLDAT.");
+  }
+  if (static_cast<uint8_t>(header[7]) != kVersion)
+    throw FormatError("Unsupported attachment version.");
+
+  std::string metadata(ReadLittleEndian(header + 8, 2), '\0');
+  src.read(&metadata[0], metadata.size());
+  if (static_cast<std::size_t>(src.gcount()) != metadata.size())
+    throw FormatError("Attachment metadata is truncated.");
+
+  std::string err;
+  json11::Json json = json11::Json::parse(metadata, err);
+  if (!err.empty() || !json.is_object())
+    throw FormatError("Unable to parse attachment metadata.");
+
+  uuid_ = ParseUuid(json["uuid"].string_value());
+  entry_uuid_ = ParseUuid(json["itemUUID"].string_value());
+  if (entry_uuid_ != entry.uuid())
+    throw FormatError("Attachment belongs to another entry.");
+  creation_time_ = static_cast<std::time_t>(json["createdAt"].number_value());
+  modification_time_ =
+      static_cast<std::time_t>(json["updatedAt"].number_value());
+  transaction_time_ =
+      static_cast<std::time_t>(json["txTimestamp"].number_value());
+
+  src.seekg(0, std::ios::end);
+  uint64_t file_size = static_cast<uint64_t>(src.tellg());
+
+  icon_offset_ = kHeaderSize + metadata.size();
+  icon_size_ = ReadLittleEndian(header + 12, 4);
+  uint64_t contents_offset = icon_offset_ + icon_size_;
+  if (contents_offset + kOpHeaderSize + kOpHmacSize > file_size)
+    throw FormatError("Attachment is truncated.");
+
+  src.seekg(contents_offset);
+  src.read(reinterpret_cast<char*>(contents_header_.data()),
+           contents_header_.size());
+  if (!src.good())
+    throw IoError("Read error.");
+  if (std::memcmp(contents_header_.data(), kOpMagic.data(),
+                  kOpMagic.size()) != 0) {
+    throw FormatError("Expected opdata01.");
+  }
+
+  // The plain text is prefixed by random padding filling up the first
+  // block, or a whole block if the length is a multiple of the block size.
+  std::memcpy(&size_, contents_header_.data() + 8, sizeof(size_));
+  padding_ = 16 - (size_ % 16);
+  cipher_offset_ = contents_offset + kOpHeaderSize;
+  cipher_size_ = file_size - cipher_offset_ - kOpHmacSize;
+  if (cipher_size_ != size_ + padding_)
+    throw FormatError("Unexpected length of attachment contents.");
+
+  key_ = entry.key_;
+  mac_key_ = entry.mac_key_;
+
+  const std::string& overview = json["overview"].string_value();
+  if (!overview.empty()) {
+    json11::Json obj = json11::Json::parse(
+        ReadOpData(base64_decode(overview), profile.overview_key(),
+                   profile.overview_mac_key()), err);
+    if (!err.empty())
+      throw FormatError("Unable to parse attachment overview.");
+    file_name_ = obj["filename"].string_value();
+  }
+}
+
+Attachment::~Attachment() {
+  key_.fill(0);
+  mac_key_.fill(0);
+}
+
+std::string Attachment::Icon() const {
+  if (icon_size_ == 0)
+    return std::string();
+
+  std::ifstream src(path_, std::ios::in | std::ios::binary);
+  if (!src.is_open())
+    throw FileNotFoundError();
+
+  std::string data(icon_size_, '\0');
+  src.seekg(icon_offset_);
+  src.read(&data[0], data.size());
+  if (!src.good())
+    throw IoError("Read error.");
+
+  return ReadOpData(data, key_, mac_key_);
+}
+
+void Attachment::Read(const Sink& sink, std::size_t chunk_size) const {
+  std::ifstream src(path_, std::ios::in | std::ios::binary);
+  if (!src.is_open())
+    throw FileNotFoundError();
+  src.seekg(cipher_offset_);
+
+  std::array<uint8_t, 16> prv = initialization_vector();
+  AesCipher cipher(key_);
+
+  HMAC_CTX hmac_ctx;
+  HMAC_CTX_init(&hmac_ctx);
+  HMAC_Init(&hmac_ctx, mac_key_.data(), mac_key_.size(), EVP_sha256());
+  HMAC_Update(&hmac_ctx, contents_header_.data(), contents_header_.size());
+
+  chunk_size = std::max<std::size_t>(chunk_size - chunk_size % 16, 16);
+  std::vector<uint8_t> buffer(
+      static_cast<std::size_t>(std::min<uint64_t>(chunk_size, cipher_size_)));
+
+  try {
+    uint64_t remaining = cipher_size_;
+    uint64_t skip = padding_;
+    while (remaining > 0) {
+      std::size_t size = static_cast<std::size_t>(
+          std::min<uint64_t>(buffer.size(), remaining));
+      src.read(reinterpret_cast<char*>(buffer.data()), size);
+      if (!src.good())
+        throw IoError("Read error.");
+      remaining -= size;
+
+      HMAC_Update(&hmac_ctx, buffer.data(), size);
+      cipher.DecryptCbc(buffer.data(), buffer.data(), size, prv);
+
+      std::size_t begin = static_cast<std::size_t>(
+          std::min<uint64_t>(skip, size));
+      skip -= begin;
+      if (begin < size)
+        sink(reinterpret_cast<const char*>(buffer.data()) + begin,
+             size - begin);
+    }
+    std::fill(buffer.begin(), buffer.end(), 0);
+
+    CheckHmac(&hmac_ctx, src);
+  } catch (...) {
+    std::fill(buffer.begin(), buffer.end(), 0);
+    HMAC_CTX_cleanup(&hmac_ctx);
+    throw;
+  }
+  HMAC_CTX_cleanup(&hmac_ctx);
+}
+
+void Attachment::Verify() const {
+  std::ifstream src(path_, std::ios::in | std::ios::binary);
+  if (!src.is_open())
+    throw FileNotFoundError();
+  src.seekg(cipher_offset_);
+
+  HMAC_CTX hmac_ctx;
+  HMAC_CTX_init(&hmac_ctx);
+  HMAC_Init(&hmac_ctx, mac_key_.data(), mac_key_.size(), EVP_sha256());
+  HMAC_Update(&hmac_ctx, contents_header_.data(), contents_header_.size());
+
+  std::vector<uint8_t> buffer(static_cast<std::size_t>(
+      std::min<uint64_t>(kDefaultChunkSize, cipher_size_)));
+  try {
+    for (uint64_t remaining = cipher_size_; remaining > 0;) {
+      std::size_t size = static_cast<std::size_t>(
+          std::min<uint64_t>(buffer.size(), remaining));
+      src.read(reinterpret_cast<char*>(buffer.data()), size);
+      if (!src.good())
+        throw IoError("Read error.");
+      remaining -= size;
+      HMAC_Update(&hmac_ctx, buffer.data(), size);
+    }
+
+    CheckHmac(&hmac_ctx, src);
+  } catch (...) {
+    HMAC_CTX_cleanup(&hmac_ctx);
+    throw;
+  }
+  HMAC_CTX_cleanup(&hmac_ctx);
+}
+
+void Attachment::DecryptParallel(
+    std::size_t threads, std::size_t chunk_size,
+    const std::function<void(uint64_t offset, const char* data,
+                             std::size_t size)>& write) const {
+  MappedFile file(path_);
+  if (file.data() == nullptr ||
+      file.size() < cipher_offset_ + cipher_size_ + kOpHmacSize) {
+    throw IoError("Unable to map attachment.");
+  }
+  const uint8_t* cipher =
+      reinterpret_cast<const uint8_t*>(file.data()) + cipher_offset_;
+
+  chunk_size = std::max<std::size_t>(chunk_size - chunk_size % 16, 16);
+  const uint64_t chunk_count = (cipher_size_ + chunk_size - 1) / chunk_size;
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  threads = static_cast<std::size_t>(
+      std::min<uint64_t>(threads, chunk_count));
+
+  const AesCipher aes(key_);
+  std::atomic<uint64_t> next_chunk(0);
+  std::atomic<bool> failed(false);
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  auto work = [&] {
+    std::vector<uint8_t> buffer(static_cast<std::size_t>(
+        std::min<uint64_t>(chunk_size, cipher_size_)));
+    try {
+      for (uint64_t chunk = next_chunk++; chunk < chunk_count && !failed;
+           chunk = next_chunk++) {
+        uint64_t begin = chunk * chunk_size;
+        std::size_t size = static_cast<std::size_t>(
+            std::min<uint64_t>(chunk_size, cipher_size_ - begin));
+
+        // Each chunk is decrypted from the last cipher text block of the
+        // preceding chunk.
+        std::array<uint8_t, 16> prv = initialization_vector();
+        if (begin > 0)
+          std::copy(cipher + begin - prv.size(), cipher + begin, prv.begin());
+        aes.DecryptCbc(cipher + begin, buffer.data(), size, prv);
+
+        std::size_t skip = static_cast<std::size_t>(
+            begin < padding_ ? std::min<uint64_t>(padding_ - begin, size) : 0);
+        if (skip < size) {
+          write(begin + skip - padding_,
+                reinterpret_cast<const char*>(buffer.data()) + skip,
+                size - skip);
+        }
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error)
+        error = std::current_exception();
+      failed = true;
+    }
+    std::fill(buffer.begin(), buffer.end(), 0);
+  };
+
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < threads; ++i)
+    workers.emplace_back(work);
+
+  // HMAC-SHA256 can not be split up, instead it is computed over the cipher
+  // text while the workers decrypt it.
+  std::array<uint8_t, kOpHmacSize> hmac_computed = { { 0 } };
+  unsigned int len = hmac_computed.size();
+
+  HMAC_CTX hmac_ctx;
+  HMAC_CTX_init(&hmac_ctx);
+  HMAC_Init(&hmac_ctx, mac_key_.data(), mac_key_.size(), EVP_sha256());
+  HMAC_Update(&hmac_ctx, contents_header_.data(), contents_header_.size());
+  HMAC_Update(&hmac_ctx, cipher, cipher_size_);
+  HMAC_Final(&hmac_ctx, hmac_computed.data(), &len);
+  assert(len == hmac_computed.size());
+  HMAC_CTX_cleanup(&hmac_ctx);
+
+  for (auto& worker : workers)
+    worker.join();
+  if (error)
+    std::rethrow_exception(error);
+
+  if (std::memcmp(hmac_computed.data(), cipher + cipher_size_,
+                  hmac_computed.size()) != 0) {
+    throw IntegrityError("HMAC integrity and authenticity check failed.");
+  }
+}
+
+void Attachment::Decrypt(char* dst, std::size_t threads,
+                         std::size_t chunk_size) const {
+  try {
+    DecryptParallel(threads, chunk_size, [dst](uint64_t offset,
+                                               const char* data,
+                                               std::size_t size) {
+      std::memcpy(dst + offset, data, size);
+    });
+  } catch (const IntegrityError&) {
+    std::fill(dst, dst + size_, '\0');
+    throw;
+  }
+}
+
+void Attachment::Save(const std::string& path, std::size_t threads,
+                      std::size_t chunk_size) const {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    throw IoError("Unable to create file.");
+
+  try {
+    if (ftruncate(fd, static_cast<off_t>(size_)) != 0)
+      throw IoError("Write error.");
+
+    // Chunks are written at their offsets as soon as they are decrypted.
+    DecryptParallel(threads, chunk_size, [fd](uint64_t offset,
+                                              const char* data,
+                                              std::size_t size) {
+      while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+          if (errno == EINTR)
+            continue;
+          throw IoError("Write error.");
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        offset += static_cast<uint64_t>(written);
+      }
+    });
+
+    if (close(fd) != 0) {
+      fd = -1;
+      throw IoError("Write error.");
+    }
+  } catch (...) {
+    if (fd >= 0)
+      close(fd);
+    unlink(path.c_str());
+    throw;
+  }
+}
+
+std::vector<std::shared_ptr<Attachment>> Attachment::Load(
+    const std::string& dir_path, const Entry& entry, Profile& profile) {
+  // Attachment files are named after the entry and the attachment UUIDs.
+  const std::string prefix = entry.uuid().ToString() + "_";
+
+  std::vector<std::string> names;
+  if (DIR* dir = opendir(dir_path.c_str())) {
+    while (struct dirent* ent = readdir(dir)) {
+      std::string name = ent->d_name;
+      if (name.size() > prefix.size() + kSuffix.size() &&
+          name.compare(0, prefix.size(), prefix) == 0 &&
+          name.compare(name.size() - kSuffix.size(), kSuffix.size(),
+                       kSuffix) == 0) {
+        names.push_back(name);
+      }
+    }
+    closedir(dir);
+  }
+  std::sort(names.begin(), names.end());
+
+  std::vector<std::shared_ptr<Attachment>> attachments;
+  for (const auto& name : names) {
+    attachments.push_back(
+        std::make_shared<Attachment>(dir_path + "/" + name, entry, profile));
+  }
+  return attachments;
+}
+
+AttachmentStream::AttachmentStream(
+    const std::shared_ptr<const Attachment>& attachment,
+    Verification verification, std::size_t cache_size) :
+    attachment_(attachment), cipher_(attachment->key_),
+    verification_(verification),
+    src_(attachment->path_, std::ios::in | std::ios::binary),
+    cache_size_(cache_size) {
+  if (!src_.is_open())
+    throw FileNotFoundError();
+
+  if (verification_ == Verification::kBackground) {
+    std::shared_ptr<const Attachment> target = attachment_;
+    verifying_ = std::async(std::launch::async, [target] {
+      target->Verify();
+    });
+  }
+}
+
+AttachmentStream::~AttachmentStream() {
+  if (verifying_.valid())
+    verifying_.wait();
+  for (auto& page : pages_)
+    std::fill(page.data.begin(), page.data.end(), '\0');
+}
+
+void AttachmentStream::CheckIntegrity(bool wait) {
+  if (!verified_ && !integrity_error_) {
+    try {
+      if (verifying_.valid()) {
+        // Reads do not wait for a background check still running.
+        if (!wait && verifying_.wait_for(std::chrono::seconds(0)) !=
+                     std::future_status::ready) {
+          return;
+        }
+        verifying_.get();
+      } else {
+        attachment_->Verify();
+      }
+      verified_ = true;
+    } catch (const IntegrityError&) {
+      integrity_error_ = std::current_exception();
+    }
+  }
+
+  if (integrity_error_)
+    std::rethrow_exception(integrity_error_);
+}
+
+const std::string& AttachmentStream::LoadPage(uint64_t index) {
+  auto it = page_index_.find(index);
+  if (it != page_index_.end()) {
+    pages_.splice(pages_.begin(), pages_, it->second);
+    return it->second->data;
+  }
+
+  uint64_t begin = index * kPageSize;
+  assert(begin < attachment_->cipher_size_);
+  std::size_t size = static_cast<std::size_t>(
+      std::min<uint64_t>(kPageSize, attachment_->cipher_size_ - begin));
+
+  // The first page follows the initialization vector, the others the last
+  // cipher text block of the preceding page.
+  std::array<uint8_t, 16> prv = attachment_->initialization_vector();
+  src_.clear();
+  if (index == 0) {
+    src_.seekg(attachment_->cipher_offset_);
+  } else {
+    src_.seekg(attachment_->cipher_offset_ + begin - prv.size());
+    src_.read(reinterpret_cast<char*>(prv.data()), prv.size());
+  }
+
+  Page page;
+  page.index = index;
+  page.data.resize(size);
+  src_.read(&page.data[0], size);
+  if (!src_.good())
+    throw IoError("Read error.");
+  uint8_t* data = reinterpret_cast<uint8_t*>(&page.data[0]);
+  cipher_.DecryptCbc(data, data, size, prv);
+
+  pages_.push_front(std::move(page));
+  page_index_[index] = pages_.begin();
+  Evict();
+  return pages_.front().data;
+}
+
+void AttachmentStream::Evict() {
+  while (pages_.size() > 1 && pages_.size() * kPageSize > cache_size_) {
+    Page& page = pages_.back();
+    std::fill(page.data.begin(), page.data.end(), '\0');
+    page_index_.erase(page.index);
+    pages_.pop_back();
+  }
+}
+
+std::size_t AttachmentStream::cache_size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_size_;
+}
+
+void AttachmentStream::set_cache_size(std::size_t cache_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_size_ = cache_size;
+  Evict();
+}
+
+std::size_t AttachmentStream::Read(uint64_t offset, char* dst,
+                                   std::size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CheckIntegrity(false);
+
+  if (offset >= attachment_->size())
+    return 0;
+  size = static_cast<std::size_t>(
+      std::min<uint64_t>(size, attachment_->size() - offset));
+
+  // Offsets into the decrypted contents are shifted by the padding.
+  uint64_t pos = offset + attachment_->padding_;
+  std::size_t done = 0;
+  while (done < size) {
+    const std::string& page = LoadPage(pos / kPageSize);
+    std::size_t begin = static_cast<std::size_t>(pos % kPageSize);
+    std::size_t count = std::min(size - done, page.size() - begin);
+    std::memcpy(dst + done, page.data() + begin, count);
+    done += count;
+    pos += count;
+  }
+  return done;
+}
+
+std::string AttachmentStream::Read(uint64_t offset, std::size_t size) {
+  if (offset >= attachment_->size())
+    return std::string();
+
+  std::string data(static_cast<std::size_t>(
+      std::min<uint64_t>(size, attachment_->size() - offset)), '\0');
+  data.resize(Read(offset, &data[0], data.size()));
+  return data;
+}
+
+void AttachmentStream::Verify() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CheckIntegrity(true);
+}
+
+}   // namespace onepass
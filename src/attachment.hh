@@ -0,0 +1,284 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cipher.hh"
+#include "uuid.hh"
+
+namespace onepass {
+
+class Entry;
+class Profile;
+
+/**
+ * File attached to an entry, stored in an OPCLDAT file next to the band
+ * files. Opening an attachment reads and decrypts only the header, the
+ * metadata and the overview, the contents are read from the file when
+ * requested and never held in memory as a whole.
+ */
+class Attachment final {
+ public:
+  /**
+   * Receives decrypted contents, in order and in chunks. The chunks are
+   * passed on before the contents have been authenticated, a caller must
+   * discard everything its sink received if Read() throws IntegrityError.
+   */
+  using Sink = std::function<void(const char* data, std::size_t size)>;
+
+  static constexpr std::size_t kDefaultChunkSize = 64 * 1024;
+  static constexpr std::size_t kParallelChunkSize = 1024 * 1024;
+
+ private:
+  friend class AttachmentStream;
+
+  std::string path_;
+  Uuid uuid_;
+  Uuid entry_uuid_;
+  std::time_t creation_time_ = 0;
+  std::time_t modification_time_ = 0;
+  std::time_t transaction_time_ = 0;
+  uint64_t size_ = 0;
+  std::string file_name_;
+
+  // Location of the encrypted icon and contents in the file. The contents
+  // header holds the length and the initialization vector, and is covered
+  // by the HMAC together with the cipher text.
+  uint64_t icon_offset_ = 0;
+  uint64_t icon_size_ = 0;
+  std::array<uint8_t, 32> contents_header_;
+  uint64_t cipher_offset_ = 0;
+  uint64_t cipher_size_ = 0;
+  uint64_t padding_ = 0;
+
+  std::array<uint8_t, 32> key_;
+  std::array<uint8_t, 32> mac_key_;
+
+  void DecryptParallel(
+      std::size_t threads, std::size_t chunk_size,
+      const std::function<void(uint64_t offset, const char* data,
+                               std::size_t size)>& write) const;
+
+  std::array<uint8_t, 16> initialization_vector() const {
+    std::array<uint8_t, 16> iv;
+    std::copy(contents_header_.begin() + 16, contents_header_.end(),
+              iv.begin());
+    return iv;
+  }
+
+ public:
+  /**
+   * Opens an attachment.
+   * @param [in] path Path to the attachment file.
+   * @param [in] entry Unlocked entry the attachment belongs to.
+   * @param [in] profile Unlocked profile.
+   * @throw FileNotFoundError If the file could not be opened.
+   * @throw FormatError If the file is not a valid attachment of @a entry.
+   * @throw IntegrityError If the overview fails authentication.
+   */
+  Attachment(const std::string& path, const Entry& entry, Profile& profile);
+  ~Attachment();
+
+  Attachment(const Attachment&) = delete;
+  Attachment& operator=(const Attachment&) = delete;
+
+  const std::string& path() const { return path_; }
+  const Uuid& uuid() const { return uuid_; }
+  const Uuid& entry_uuid() const { return entry_uuid_; }
+  std::time_t creation_time() const { return creation_time_; }
+  std::time_t modification_time() const { return modification_time_; }
+  std::time_t transaction_time() const { return transaction_time_; }
+  /**
+   * @return Size of the decrypted contents in bytes.
+   */
+  uint64_t size() const { return size_; }
+  const std::string& file_name() const { return file_name_; }
+
+  /**
+   * @return The decrypted icon image, or an empty string if the attachment
+   *         has no icon.
+   * @throw IntegrityError If the icon fails authentication.
+   */
+  std::string Icon() const;
+
+  /**
+   * Decrypts the contents, passing them to a sink one chunk at a time. The
+   * MAC is computed while reading and checked after the last chunk, so the
+   * sink receives unauthenticated data and must discard it if an exception
+   * is thrown, see Sink.
+   * @param [in] sink Function receiving the decrypted contents.
+   * @param [in] chunk_size Number of bytes to read and decrypt at a time,
+   *                        rounded down to whole cipher blocks.
+   * @throw IoError If reading the file fails.
+   * @throw IntegrityError If the contents fail authentication.
+   */
+  void Read(const Sink& sink,
+            std::size_t chunk_size = kDefaultChunkSize) const;
+
+  /**
+   * Checks the MAC of the contents without decrypting them.
+   * @throw IoError If reading the file fails.
+   * @throw IntegrityError If the contents fail authentication.
+   */
+  void Verify() const;
+
+  /**
+   * Decrypts the contents on several threads, each decrypting separate
+   * chunks of the memory mapped cipher text, while the calling thread
+   * computes the MAC. Unlike Read() the MAC is checked once all contents
+   * have been decrypted.
+   * @param [out] dst Buffer of at least size() bytes, cleared if the
+   *                  contents fail authentication.
+   * @param [in] threads Number of decrypting threads, zero for one per core.
+   * @param [in] chunk_size Number of bytes decrypted by a thread at a time,
+   *                        rounded down to whole cipher blocks.
+   * @throw IoError If the file could not be mapped.
+   * @throw IntegrityError If the contents fail authentication.
+   */
+  void Decrypt(char* dst, std::size_t threads = 0,
+               std::size_t chunk_size = kParallelChunkSize) const;
+
+  /**
+   * Decrypts the contents into a file, see Decrypt(). The file is removed
+   * if writing fails or the contents fail authentication.
+   * @param [in] path Path to the file to write.
+   * @param [in] threads Number of decrypting threads, zero for one per core.
+   * @param [in] chunk_size Number of bytes decrypted by a thread at a time.
+   * @throw IoError If the file could not be mapped or written.
+   * @throw IntegrityError If the contents fail authentication.
+   */
+  void Save(const std::string& path, std::size_t threads = 0,
+            std::size_t chunk_size = kParallelChunkSize) const;
+
+  /**
+   * Opens the attachments of an entry.
+   * @param [in] dir_path Path to the directory containing the band files.
+   * @param [in] entry Unlocked entry.
+   * @param [in] profile Unlocked profile.
+   * @return The attachments, ordered by UUID.
+   */
+  static std::vector<std::shared_ptr<Attachment>> Load(
+      const std::string& dir_path, const Entry& entry, Profile& profile);
+};
+
+/**
+ * Random access to the decrypted contents of an attachment. CBC allows
+ * decrypting any block given the preceding cipher text block, so a read
+ * only decrypts the pages it touches. Decrypted pages are kept in a least
+ * recently used cache bounded in bytes.
+ *
+ * The MAC covers the whole contents and is checked either when first
+ * reading, or on a background thread while reads already return data. A
+ * stream which failed the check throws on every following read.
+ */
+class AttachmentStream final {
+ public:
+  enum class Verification {
+    kFirstRead,   ///< The first read checks the MAC before returning data.
+    kBackground   ///< Reads return unauthenticated data until the check
+                  ///< completes. A caller must discard what it read if a
+                  ///< later read or Verify() throws IntegrityError.
+  };
+
+  static constexpr std::size_t kPageSize = 16 * 1024;
+  static constexpr std::size_t kDefaultCacheSize = 1024 * 1024;
+
+ private:
+  class Page final {
+   public:
+    uint64_t index = 0;
+    std::string data;
+  };
+
+  const std::shared_ptr<const Attachment> attachment_;
+  const AesCipher cipher_;
+  const Verification verification_;
+
+  std::mutex mutex_;
+  std::ifstream src_;
+  std::size_t cache_size_;
+  // Most recently used first.
+  std::list<Page> pages_;
+  std::unordered_map<uint64_t, std::list<Page>::iterator> page_index_;
+
+  bool verified_ = false;
+  std::exception_ptr integrity_error_;
+  std::future<void> verifying_;
+
+  void CheckIntegrity(bool wait);
+  const std::string& LoadPage(uint64_t index);
+  void Evict();
+
+ public:
+  /**
+   * @param [in] attachment Attachment to read.
+   * @param [in] verification When to check the MAC of the contents.
+   * @param [in] cache_size Maximum number of bytes of decrypted pages to
+   *                        keep. At least one page is always kept.
+   * @throw FileNotFoundError If the attachment file could not be opened.
+   */
+  explicit AttachmentStream(
+      const std::shared_ptr<const Attachment>& attachment,
+      Verification verification = Verification::kFirstRead,
+      std::size_t cache_size = kDefaultCacheSize);
+  ~AttachmentStream();
+
+  AttachmentStream(const AttachmentStream&) = delete;
+  AttachmentStream& operator=(const AttachmentStream&) = delete;
+
+  uint64_t size() const { return attachment_->size(); }
+
+  std::size_t cache_size();
+  void set_cache_size(std::size_t cache_size);
+
+  /**
+   * Reads decrypted contents.
+   * @param [in] offset Offset into the contents.
+   * @param [out] dst Buffer to read into, at least @a size bytes.
+   * @param [in] size Maximum number of bytes to read.
+   * @return Number of bytes read, less than @a size only at the end of the
+   *         contents.
+   * @throw IoError If reading the file fails.
+   * @throw IntegrityError If the contents failed authentication.
+   */
+  std::size_t Read(uint64_t offset, char* dst, std::size_t size);
+  std::string Read(uint64_t offset, std::size_t size);
+
+  /**
+   * Waits for the MAC of the contents to be checked, checking it now if
+   * that has not been done yet.
+   * @throw IntegrityError If the contents failed authentication.
+   */
+  void Verify();
+};
+
+}   // namespace onepass
@@ -18,16 +18,44 @@
 
 #include "bands.hh"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
 
 #include "base64.hh"
 #include "data.hh"
+#include "details_cache.hh"
 #include "exception.hh"
 #include "json11.hh"
 #include "opdata.hh"
 #include "profile.hh"
 #include "util.hh"
+#include "uuid.hh"
+
+namespace {
+
+const std::string kEmptyString;
+
+// 1Password stores one-time password secrets in section fields named with
+// this prefix.
+const std::string kTotpFieldPrefix = "TOTP_";
+
+// Month year values are integers on the form YYYYMM. Some items, such as
+// licenses and memberships in older vaults, store other numbers with the
+// same kind.
+bool IsMonthYear(double value) {
+  if (value <= 0 || value > std::numeric_limits<int>::max() ||
+      value != static_cast<int>(value))
+    return false;
+  const int month = static_cast<int>(value) % 100;
+  return month >= 1 && month <= 12;
+}
+
+} // namespace
 
 namespace onepass {
 
@@ -70,19 +98,65 @@ Entry::Category CategoryFromString(const std::string& str) {
     return Entry::Category::kEmail;
   }
 
-  assert(false);
-  return Entry::Category::kLogin;
+  return Entry::Category::kUnknown;
+}
+
+Entry::Value::Value(const json11::Json& json, const std::string& kind) :
+    json_(json) {
+  switch (json.type()) {
+    case json11::Json::NUL:
+      type_ = Type::kNone;
+      break;
+    case json11::Json::NUMBER:
+      if (kind == "date") {
+        type_ = Type::kDate;
+      } else if (kind == "monthYear" && IsMonthYear(json.number_value())) {
+        type_ = Type::kMonthYear;
+      } else {
+        type_ = Type::kNumber;
+      }
+      break;
+    case json11::Json::BOOL:
+      type_ = Type::kBoolean;
+      break;
+    case json11::Json::STRING:
+      type_ = Type::kString;
+      break;
+    case json11::Json::ARRAY:
+    case json11::Json::OBJECT:
+      type_ = Type::kObject;
+      break;
+  }
+}
+
+std::string Entry::Value::ToString() const {
+  switch (type_) {
+    case Type::kNone:
+      return std::string();
+    case Type::kString:
+      return json_.string_value();
+    case Type::kBoolean:
+      return json_.bool_value() ? "true" : "false";
+    case Type::kNumber:
+    case Type::kDate:
+    case Type::kMonthYear:
+    case Type::kObject:
+      break;
+  }
+
+  return json_.dump();
 }
 
 Entry::Field::Field(const json11::Json& json) {
   assert(json.is_object());
 
+  json11::Json value;
   for (const auto& obj : json.object_items()) {
     if (obj.first == "k") {
       assert(obj.second.is_string());
       key_ = obj.second.string_value();
     } else if (obj.first == "v" || obj.first == "value") {
-      value_ = obj.second.dump();
+      value = obj.second;
     } else if (obj.first == "n" || obj.first == "name") {
       assert(obj.second.is_string());
       name_ = obj.second.string_value();
@@ -107,6 +181,8 @@ Entry::Field::Field(const json11::Json& json) {
       assert(false);
     }
   }
+
+  value_ = Value(value, key_);
 }
 
 Entry::Section::Section(const json11::Json& json) {
@@ -218,7 +294,7 @@ void Entry::UpdateFromOverview(const std::string& overview) {
   }
 }
 
-void Entry::UpdateFromDetails(const std::string& details) {
+Entry::Details::Details(const std::string& details) {
   std::string err;
   json11::Json json = json11::Json::parse(details, err);
   if (!err.empty())
@@ -257,19 +333,115 @@ void Entry::UpdateFromDetails(const std::string& details) {
       assert(false);
     }
   }
+
+  ResolveDesignatedFields();
 }
 
-Entry::Entry(const std::array<uint8_t, 16>& uuid,
+void Entry::Details::ResolveDesignatedFields() {
+  // Prefer the explicit designations, the field type is only used for finding
+  // the password of entries lacking designations.
+  std::shared_ptr<Field> typed_password;
+  for (const auto& field : fields_) {
+    if (field->designation() == "username") {
+      if (!username_field_)
+        username_field_ = field;
+    } else if (field->designation() == "password") {
+      if (!password_field_)
+        password_field_ = field;
+    } else if (field->type() == "P") {
+      if (!typed_password)
+        typed_password = field;
+    }
+  }
+
+  if (!password_field_)
+    password_field_ = typed_password;
+
+  // Items other than logins, such as databases and servers, keep their
+  // credentials in section fields.
+  for (const auto& section : sections_) {
+    for (const auto& field : section->fields()) {
+      if (!username_field_ && field->name() == "username") {
+        username_field_ = field;
+      } else if (!password_field_ && field->name() == "password") {
+        password_field_ = field;
+      } else if (!totp_field_ &&
+                 field->name().compare(0, kTotpFieldPrefix.size(),
+                                       kTotpFieldPrefix) == 0) {
+        totp_field_ = field;
+      }
+    }
+  }
+}
+
+Entry::Entry(const Uuid& uuid,
              const json11::Json& json,
              Profile& profile) :
     uuid_(uuid) {
-  assert(json.is_object());
+  Parse(json);
+  Decrypt(profile);
+}
+
+Entry::Entry(const Uuid& uuid, const json11::Json& json) :
+    uuid_(uuid) {
+  Parse(json);
+}
+
+Entry::Entry(const Sealed& sealed, Profile* profile) :
+    uuid_(sealed.uuid), folder_uuid_(sealed.folder_uuid),
+    category_(sealed.category), creation_time_(sealed.creation_time),
+    modification_time_(sealed.modification_time),
+    transaction_time_(sealed.transaction_time), trashed_(sealed.trashed),
+    fave_(sealed.fave), key_data_(sealed.key_data),
+    overview_data_(sealed.overview_data), details_data_(sealed.details_data),
+    hmac_(sealed.hmac) {
+  key_.fill(0);
+  mac_key_.fill(0);
+  if (profile != nullptr)
+    Decrypt(*profile);
+}
+
+Entry::Sealed Entry::sealed() const {
+  Sealed sealed;
+  sealed.uuid = uuid_;
+  sealed.folder_uuid = folder_uuid_;
+  sealed.category = category_;
+  sealed.creation_time = creation_time_;
+  sealed.modification_time = modification_time_;
+  sealed.transaction_time = transaction_time_;
+  sealed.trashed = trashed_;
+  sealed.fave = fave_;
+  sealed.hmac = hmac_;
+  sealed.key_data = key_data_;
+  sealed.overview_data = overview_data_;
+  sealed.details_data = details_data_;
+  return sealed;
+}
+
+void Entry::Decrypt(Profile& profile) {
+  assert(!profile.IsLocked());
 
-  std::string details;
+  std::string k = ReadData(key_data_, profile.master_key(),
+                           profile.master_mac_key());
+  if (k.size() != 64)
+    throw FormatError("Entry key data is of incorrect size.");
 
-  std::array<uint8_t, 32> key = { 0 };
-  std::array<uint8_t, 32> mac_key = { 0 };
-  std::array<uint8_t, 32> hmac = { 0 };
+  std::copy(k.c_str(), k.c_str() + 32, key_.begin());
+  std::copy(k.c_str() + 32, k.c_str() + 64, mac_key_.begin());
+
+  if (!overview_data_.empty()) {
+    UpdateFromOverview(ReadOpData(overview_data_, profile.overview_key(),
+                                  profile.overview_mac_key()));
+  }
+  locked_ = false;
+}
+
+void Entry::Parse(const json11::Json& json) {
+  assert(json.is_object());
+
+  key_.fill(0);
+  mac_key_.fill(0);
+  hmac_.fill(0);
 
   for (const auto& obj : json.object_items()) {
     if (obj.first == "category") {
@@ -286,39 +458,27 @@ Entry::Entry(const std::array<uint8_t, 16>& uuid,
       modification_time_ = static_cast<std::time_t>(obj.second.number_value());
     } else if (obj.first == "uuid") {
       assert(obj.second.is_string());
-      std::array<uint8_t, 16> uuid = ParseUuid(
-          obj.second.string_value());
-      if (uuid_ != uuid) {
+      if (uuid_ != ParseUuid(obj.second.string_value())) {
         assert(false);
         throw FormatError(
             "Entry internal and external UUIDs does not match.");
       }
     } else if (obj.first == "d") {
       assert(obj.second.is_string());
-      details = base64_decode(obj.second.string_value());
+      details_data_ = base64_decode(obj.second.string_value());
     } else if (obj.first == "k") {
       assert(obj.second.is_string());
-      std::string k = ReadData(base64_decode(obj.second.string_value()),
-                               profile.master_key(),
-                               profile.master_mac_key());
-      if (k.size() != 64)
-        throw FormatError("Entry key data is of incorrect size.");
-
-      std::copy(k.c_str(), k.c_str() + 32, key.begin());
-      std::copy(k.c_str() + 32, k.c_str() + 64, mac_key.begin());
+      key_data_ = base64_decode(obj.second.string_value());
     } else if (obj.first == "o") {
       assert(obj.second.is_string());
-      UpdateFromOverview(ReadOpData(
-          base64_decode(obj.second.string_value()),
-          profile.overview_key(),
-          profile.overview_mac_key()));
+      overview_data_ = base64_decode(obj.second.string_value());
     } else if (obj.first == "hmac") {
       assert(obj.second.is_string());
       std::string hmac_str = base64_decode(obj.second.string_value());
       if (hmac_str.size() != 32)
         throw FormatError("Entry HMAC is of incorrect size.");
 
-      std::copy(hmac_str.begin(), hmac_str.end(), hmac.begin());
+      std::copy(hmac_str.begin(), hmac_str.end(), hmac_.begin());
     } else if (obj.first == "trashed") {
       if (!obj.second.is_bool())
         throw FormatError("Entry trashed flag is not a boolean.");
@@ -333,52 +493,423 @@ Entry::Entry(const std::array<uint8_t, 16>& uuid,
       assert(false);
     }
   }
+}
+
+Entry::~Entry() {
+  key_.fill(0);
+  mac_key_.fill(0);
+  if (details_cache_)
+    details_cache_->Erase(this);
+}
+
+std::shared_ptr<const Entry::Details> Entry::details() const {
+  if (locked_)
+    throw InternalError("Entry is locked.");
+
+  if (details_cache_) {
+    // Concurrent misses may decrypt the details more than once, the last
+    // one is cached.
+    std::shared_ptr<const Details> details = details_cache_->Find(this);
+    if (!details) {
+      std::string data = ReadOpData(details_data_, key_, mac_key_);
+      details = std::make_shared<const Details>(data);
+      details_cache_->Insert(this, details, data.size());
+    }
+    return details;
+  }
 
-  // Decrypt details.
-  UpdateFromDetails(ReadOpData(details, key, mac_key));
+  std::lock_guard<std::mutex> lock(details_mutex_);
+  if (!details_) {
+    details_ = std::make_shared<const Details>(
+        ReadOpData(details_data_, key_, mac_key_));
+  }
+  return details_;
 }
 
-void Bands::LoadIfExists(const std::string path, Profile& profile) {
-  std::ifstream src(path, std::ios::in | std::ios::binary);
+bool Entry::has_details() const {
+  if (details_cache_)
+    return details_cache_->Contains(this);
+
+  std::lock_guard<std::mutex> lock(details_mutex_);
+  return static_cast<bool>(details_);
+}
+
+const std::string& Entry::Details::username() const {
+  return username_field_ ? username_field_->value().string_value() :
+                           kEmptyString;
+}
+
+const std::string& Entry::Details::password() const {
+  return password_field_ ? password_field_->value().string_value() :
+                           kEmptyString;
+}
+
+const std::string& Entry::Details::totp() const {
+  return totp_field_ ? totp_field_->value().string_value() : kEmptyString;
+}
+
+const std::string& Entry::primary_url() const {
+  if (!url_.empty() || urls_.empty())
+    return url_;
+
+  return urls_.begin()->second;
+}
+
+bool LoadOptions::Accepts(Entry::Category category, bool trashed,
+                          const Uuid& folder, std::time_t updated) const {
+  if (!tombstones_ && category == Entry::Category::kTombstone)
+    return false;
+  if (!categories_.empty() && categories_.count(category) == 0)
+    return false;
+
+  if (!trashed_ && trashed)
+    return false;
+  if (!folders_.empty() && folders_.count(folder) == 0)
+    return false;
+  return updated_since_ == 0 || updated >= updated_since_;
+}
+
+bool LoadOptions::Accepts(const json11::Json& json) const {
+  // Entries without a category are loaded as Category::kUnknown, the same
+  // category a vault image records for them.
+  const std::string& name = json["category"].string_value();
+  Entry::Category category = name.empty() ? Entry::Category::kUnknown :
+                                            CategoryFromString(name);
+
+  const json11::Json& folder = json["folder"];
+  return Accepts(category, json["trashed"].bool_value(),
+                 folder.is_string() ? ParseUuid(folder.string_value()) : Uuid(),
+                 static_cast<std::time_t>(json["updated"].number_value()));
+}
+
+bool LoadOptions::Accepts(const Entry::Sealed& sealed) const {
+  return Accepts(sealed.category, sealed.trashed, sealed.folder_uuid,
+                 sealed.modification_time);
+}
+
+std::string LoadOptions::Describe() const {
+  std::ostringstream out;
+  out << "categories";
+  for (const auto& category : categories_)
+    out << ' ' << static_cast<int>(category);
+  out << ";folders";
+  for (const auto& folder : folders_)
+    out << ' ' << folder.ToString();
+  out << ";trashed " << trashed_ << ";tombstones " << tombstones_
+      << ";updated_since " << updated_since_;
+  return out.str();
+}
+
+constexpr std::size_t Bands::kBandCount;
+
+std::string Bands::BandFileName(std::size_t index) {
+  assert(index < kBandCount);
+
+  std::string name = "band_";
+  name.push_back(static_cast<char>(index < 10 ? '0' + index :
+                                                'A' + index - 10));
+  name.append(".js");
+  return name;
+}
+
+std::shared_ptr<Entry> Bands::LoadEntry(const std::string& dir_path,
+                                        const Uuid& uuid, Profile& profile,
+                                        const LoadOptions& options) {
+  assert(!profile.IsLocked());
+
+  // Entries are sharded into bands by the first hex digit of their UUID.
+  std::string key = uuid.ToString();
+  char digit = key[0];
+  std::size_t index = static_cast<std::size_t>(
+      digit <= '9' ? digit - '0' : digit - 'A' + 10);
+
+  std::ifstream src(dir_path + "/" + BandFileName(index),
+                    std::ios::in | std::ios::binary);
   if (!src.is_open())
-    return;
+    return nullptr;
 
   std::string text;
-  std::copy(std::istreambuf_iterator<char>(src), 
-            std::istreambuf_iterator<char>(), 
+  std::copy(std::istreambuf_iterator<char>(src),
+            std::istreambuf_iterator<char>(),
             std::back_inserter(text));
 
+  // Only the span of the entry is parsed, the other entries in the band are
+  // skipped over as text.
+  std::string member = ExtractJsonMember(ExtractJson(text), key);
+  if (member.empty())
+    return nullptr;
+
   std::string err;
-  json11::Json json = json11::Json::parse(ExtractJson(text), err);
-  if (!err.empty())
-    throw FormatError("Unable to parse JSON data in profile.");
+  json11::Json json = json11::Json::parse(member, err);
+  if (!err.empty() || !json.is_object())
+    throw FormatError("Unable to parse JSON data in band.");
+  if (!options.Accepts(json))
+    return nullptr;
+
+  auto entry = std::make_shared<Entry>(uuid, json, profile);
+  entry->set_details_cache(options.details_cache());
+  return entry;
+}
 
-  for (const auto& obj : json.object_items()) {
-    assert(obj.second.is_object());
-    entries_.push_back(std::make_shared<Entry>(
-        ParseUuid(obj.first), obj.second, profile));
+std::shared_ptr<Entry> Bands::MakeEntry(const Uuid& uuid,
+                                        const json11::Json& json,
+                                        Profile& profile) const {
+  auto entry = std::make_shared<Entry>(uuid, json, profile);
+  entry->set_details_cache(options_.details_cache());
+  return entry;
+}
+
+void Bands::ForEachMember(
+    const std::string& dir_path,
+    const std::function<bool(const std::string& key,
+                             const std::string& value)>& callback) {
+  for (std::size_t i = 0; i < kBandCount; ++i) {
+    std::ifstream src(dir_path + "/" + BandFileName(i),
+                      std::ios::in | std::ios::binary);
+    if (!src.is_open())
+      continue;
+
+    bool running = true;
+    ForEachJsonMember(src, [&](const std::string& key,
+                               const std::string& value) {
+      running = callback(key, value);
+      return running;
+    });
+    if (!running)
+      break;
   }
 }
 
-void Bands::Load(const std::string& dir_path, Profile& profile) {
+void Bands::ForEach(const std::string& dir_path, Profile& profile,
+                    const LoadOptions& options,
+                    const std::function<void(const Entry& entry)>& callback) {
   assert(!profile.IsLocked());
 
-  for (std::size_t i = 0; i < 10; ++i) {
-    std::string path = dir_path;
-    path.append("/band_");
-    path.append(std::to_string(i));
-    path.append(".js");
+  // Each entry is read, parsed and decrypted on its own, the band as a whole
+  // is never held in memory.
+  ForEachMember(dir_path, [&](const std::string& key,
+                              const std::string& value) {
+    std::string err;
+    json11::Json item = json11::Json::parse(value, err);
+    if (!err.empty() || !item.is_object())
+      throw FormatError("Unable to parse JSON data in band.");
+
+    if (options.Accepts(item)) {
+      Entry entry(ParseUuid(key), item, profile);
+      callback(entry);
+    }
+    return true;
+  });
+}
+
+void Bands::RefreshBand(Band& band, const std::string& text,
+                        Profile& profile, Delta& delta) {
+  std::map<Uuid, std::shared_ptr<Entry>> previous;
+  for (const auto& entry : band.entries)
+    previous[entry->uuid()] = entry;
+
+  std::vector<std::shared_ptr<Entry>> entries;
+  if (!text.empty()) {
+    std::string err;
+    json11::Json json = json11::Json::parse(ExtractJson(text), err);
+    if (!err.empty())
+      throw FormatError("Unable to parse JSON data in profile.");
 
-    LoadIfExists(path, profile);
+    for (const auto& obj : json.object_items()) {
+      assert(obj.second.is_object());
+      // Filtered entries are treated as absent, an entry no longer passing
+      // the filters is reported as removed.
+      if (!options_.Accepts(obj.second))
+        continue;
+      Uuid uuid = ParseUuid(obj.first);
+
+      auto it = previous.find(uuid);
+      if (it != previous.end()) {
+        // The HMAC covers the encrypted data of the entry, an unchanged HMAC
+        // and transaction time means the entry is the same.
+        std::shared_ptr<Entry> entry = it->second;
+        previous.erase(it);
+
+        const json11::Json& hmac = obj.second["hmac"];
+        const json11::Json& tx = obj.second["tx"];
+        std::string hmac_str = base64_decode(hmac.string_value());
+        if (hmac_str.size() == entry->hmac().size() &&
+            std::memcmp(hmac_str.data(), entry->hmac().data(),
+                        hmac_str.size()) == 0 &&
+            static_cast<std::time_t>(tx.number_value()) ==
+                entry->transaction_time()) {
+          entries.push_back(entry);
+          continue;
+        }
+
+        entries.push_back(MakeEntry(uuid, obj.second, profile));
+        delta.modified_.push_back(entries.back());
+      } else {
+        entries.push_back(MakeEntry(uuid, obj.second, profile));
+        delta.added_.push_back(entries.back());
+      }
+    }
   }
 
-  for (char c = 'A'; c < 'G'; ++c) {
+  for (const auto& entry : previous)
+    delta.removed_.push_back(entry.second);
+  band.entries.swap(entries);
+}
+
+void Bands::RebuildEntries() {
+  entries_.clear();
+  for (const auto& band : bands_)
+    entries_.insert(entries_.end(), band.entries.begin(), band.entries.end());
+}
+
+void Bands::Lock() {
+  for (auto& band : bands_) {
+    for (auto& entry : band.entries) {
+      if (!entry->locked())
+        entry = std::make_shared<Entry>(entry->sealed());
+    }
+  }
+
+  RebuildEntries();
+}
+
+void Bands::Unlock(Profile& profile) {
+  assert(!profile.IsLocked());
+
+  for (auto& band : bands_) {
+    for (auto& entry : band.entries) {
+      if (entry->locked()) {
+        entry = std::make_shared<Entry>(entry->sealed(), &profile);
+        entry->set_details_cache(options_.details_cache());
+      }
+    }
+  }
+
+  RebuildEntries();
+}
+
+void Bands::Load(const std::string& dir_path, Profile& profile,
+                 const LoadOptions& options) {
+  options_ = options;
+  for (auto& band : bands_)
+    band = Band();
+  entries_.clear();
+
+  Refresh(dir_path, profile);
+}
+
+Bands::Delta Bands::Refresh(const std::string& dir_path, Profile& profile) {
+  assert(!profile.IsLocked());
+
+  Delta delta;
+  bool changed = false;
+
+  for (std::size_t i = 0; i < kBandCount; ++i) {
     std::string path = dir_path;
-    path.append("/band_");
-    path.push_back(c);
-    path.append(".js");
+    path.append("/");
+    path.append(BandFileName(i));
+
+    // Only keep the new fingerprint once the band has been read, a failed
+    // band is retried on the next refresh. Bands refreshed before the
+    // failure stay refreshed.
+    std::string text;
+    FileFingerprint fingerprint = bands_[i].fingerprint;
+    try {
+      if (fingerprint.Refresh(path, text)) {
+        RefreshBand(bands_[i], text, profile, delta);
+        changed = true;
+      }
+    } catch (...) {
+      if (changed)
+        RebuildEntries();
+      throw;
+    }
+    bands_[i].fingerprint = fingerprint;
+  }
+
+  if (changed)
+    RebuildEntries();
+  return delta;
+}
+
+ProgressiveLoader::ProgressiveLoader(const std::string& dir_path,
+                                     Profile& profile, Order order,
+                                     const LoadOptions& options) :
+    profile_(profile) {
+  assert(!profile.IsLocked());
+  bands_.options_ = options;
+
+  for (std::size_t i = 0; i < Bands::kBandCount; ++i) {
+    std::string text;
+    bands_.bands_[i].fingerprint.Refresh(
+        dir_path + "/" + Bands::BandFileName(i), text);
+    if (text.empty())
+      continue;
+
+    std::string err;
+    json11::Json json = json11::Json::parse(ExtractJson(text), err);
+    if (!err.empty())
+      throw FormatError("Unable to parse JSON data in band.");
+
+    for (const auto& obj : json.object_items()) {
+      assert(obj.second.is_object());
+      if (!options.Accepts(obj.second))
+        continue;
+
+      Pending pending = { i, slots_[i].size(), ParseUuid(obj.first),
+                          obj.second };
+      pending_.push_back(pending);
+      slots_[i].push_back(nullptr);
+    }
+  }
+
+  auto updated = [](const Pending& pending) {
+    return pending.json["updated"].number_value();
+  };
+  auto fave = [](const Pending& pending) {
+    // Entries which are not favorites have no or a zero favorite index.
+    double fave = pending.json["fave"].number_value();
+    return fave > 0 ? fave : std::numeric_limits<double>::infinity();
+  };
+  switch (order) {
+    case Order::kFavoritesFirst:
+      std::stable_sort(pending_.begin(), pending_.end(),
+          [&](const Pending& lhs, const Pending& rhs) {
+            double lhs_fave = fave(lhs);
+            double rhs_fave = fave(rhs);
+            return lhs_fave < rhs_fave ||
+                (lhs_fave == rhs_fave && updated(lhs) > updated(rhs));
+          });
+      break;
+    case Order::kRecentFirst:
+      std::stable_sort(pending_.begin(), pending_.end(),
+          [&](const Pending& lhs, const Pending& rhs) {
+            return updated(lhs) > updated(rhs);
+          });
+      break;
+    case Order::kFile:
+      break;
+  }
+}
+
+void ProgressiveLoader::Step(std::size_t count) {
+  if (done())
+    return;
+
+  std::size_t end = std::min(pending_.size(), loaded_ + count);
+  for (; loaded_ < end; ++loaded_) {
+    Pending& pending = pending_[loaded_];
+    auto entry = bands_.MakeEntry(pending.uuid, pending.json, profile_);
+    slots_[pending.band][pending.slot] = entry;
+    bands_.entries_.push_back(entry);
+    pending.json = json11::Json();
+  }
+
+  if (done()) {
+    for (std::size_t i = 0; i < Bands::kBandCount; ++i)
+      bands_.bands_[i].entries.swap(slots_[i]);
 
-    LoadIfExists(path, profile);
+    bands_.RebuildEntries();
   }
 }
 
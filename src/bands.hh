@@ -19,22 +19,27 @@
 #pragma once
 #include <array>
 #include <ctime>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 
-namespace json11 {
-  class Json;
-} // namespace json11
+#include "fingerprint.hh"
+#include "json11.hh"
+#include "uuid.hh"
 
 namespace onepass {
 
+class DetailsCache;
 class Profile;
 
 class Entry final {
  public:
   enum class Category {
+    kUnknown = 0,  ///< Missing or not recognized in the band file.
     kLogin = 1,
     kCreditCard = 2,
     kSecureNote = 3,
@@ -55,10 +60,75 @@ class Entry final {
     kEmail = 111
   };
 
+  /**
+   * Field value. The value references the JSON node parsed from the decrypted
+   * entry details, conversion into a specific representation is done first
+   * when the value is accessed.
+   */
+  class Value final {
+   public:
+    enum class Type {
+      kNone,
+      kString,
+      kNumber,
+      kBoolean,
+      kDate,
+      kMonthYear,
+      kObject
+    };
+
+   private:
+    json11::Json json_;
+    Type type_ = Type::kNone;
+
+   public:
+    Value() = default;
+    Value(const json11::Json& json, const std::string& kind);
+
+    Type type() const { return type_; }
+    bool empty() const { return type_ == Type::kNone; }
+
+    /**
+     * @return The string value, or an empty string if the value is not a
+     *         string.
+     */
+    const std::string& string_value() const { return json_.string_value(); }
+    double number_value() const { return json_.number_value(); }
+    bool bool_value() const { return json_.bool_value(); }
+    /**
+     * @return The date as seconds since the epoch.
+     */
+    std::time_t date_value() const {
+      return static_cast<std::time_t>(json_.number_value());
+    }
+    /**
+     * Month year values are stored as a single integer on the form YYYYMM.
+     * Values of the month year kind that do not hold a month in 1..12 are
+     * typed as plain numbers instead, see Type::kNumber.
+     */
+    int year() const { return json_.int_value() / 100; }
+    int month() const { return json_.int_value() % 100; }
+    /**
+     * @return The string value of a member of an object value, such as the
+     *         street of an address, or an empty string if there is no such
+     *         member.
+     */
+    const std::string& member(const std::string& key) const {
+      return json_[key].string_value();
+    }
+
+    /**
+     * Converts the value into a textual representation. Strings are returned
+     * as is, other types are serialized.
+     * @return Textual representation of the value.
+     */
+    std::string ToString() const;
+  };
+
   class Field final {
    private:
     std::string key_;
-    std::string value_; ///< Raw JSON value, including quotes for strings.
+    Value value_;
     std::string name_;
     std::string title_;
     std::string designation_;
@@ -69,7 +139,7 @@ class Entry final {
     Field(const json11::Json& json);
 
     const std::string& key() const { return key_; }
-    const std::string& value() const { return value_; }
+    const Value& value() const { return value_; }
     const std::string& name() const { return name_; }
     const std::string& title() const { return title_; }
     const std::string& designation() const { return designation_; }
@@ -129,10 +199,87 @@ class Entry final {
     std::time_t time() const { return time_; }
   };
 
+  /**
+   * Decrypted entry details. Holding on to the object keeps the details and
+   * all references into them valid.
+   */
+  class Details final {
+   private:
+    std::string notes_;
+    std::shared_ptr<Form> form_;
+    std::vector<std::shared_ptr<Section>> sections_;
+    std::vector<std::shared_ptr<Field>> fields_;
+    std::vector<std::shared_ptr<PasswordHistory>> password_history_;
+
+    // Well-known fields, resolved once when parsing the details.
+    std::shared_ptr<Field> username_field_;
+    std::shared_ptr<Field> password_field_;
+    std::shared_ptr<Field> totp_field_;
+
+    void ResolveDesignatedFields();
+
+   public:
+    explicit Details(const std::string& details);
+
+    const std::string& notes() const { return notes_; }
+    std::shared_ptr<Form> form() const { return form_; }
+    const std::vector<std::shared_ptr<Section>>& sections() const {
+      return sections_;
+    }
+    const std::vector<std::shared_ptr<Field>>& fields() const {
+      return fields_;
+    }
+    const std::vector<std::shared_ptr<PasswordHistory>>&
+        password_history() const { return password_history_; }
+
+    std::shared_ptr<Field> username_field() const { return username_field_; }
+    std::shared_ptr<Field> password_field() const { return password_field_; }
+    std::shared_ptr<Field> totp_field() const { return totp_field_; }
+
+    /**
+     * @return The value of the designated username field, or an empty
+     *         string if the entry has no such field.
+     */
+    const std::string& username() const;
+    /**
+     * @return The value of the designated password field, or an empty
+     *         string if the entry has no such field.
+     */
+    const std::string& password() const;
+    /**
+     * @return The value of the one-time password field, or an empty string
+     *         if the entry has no such field.
+     */
+    const std::string& totp() const;
+  };
+
+  /**
+   * The attributes of an entry stored in plain text, together with its
+   * encrypted data. Enough to recreate the entry without the band file.
+   */
+  class Sealed final {
+   public:
+    Uuid uuid;
+    Uuid folder_uuid;
+    Category category = Category::kUnknown;
+    std::time_t creation_time = 0;
+    std::time_t modification_time = 0;
+    std::time_t transaction_time = 0;
+    bool trashed = false;
+    uint32_t fave = 0;
+    std::array<uint8_t, 32> hmac = { { 0 } };
+    std::string key_data;
+    std::string overview_data;
+    std::string details_data;
+  };
+
  private:
-  std::array<uint8_t, 16> uuid_ = { { 0 } };
-  std::array<uint8_t, 16> folder_uuid_ = { { 0 } };
-  Category category_ = Category::kLogin;
+  // Attachments are encrypted with the item keys.
+  friend class Attachment;
+
+  Uuid uuid_;
+  Uuid folder_uuid_;
+  Category category_ = Category::kUnknown;
   std::time_t creation_time_ = 0;
   std::time_t modification_time_ = 0;
   std::time_t transaction_time_ = 0;
@@ -141,57 +288,415 @@ class Entry final {
   std::string title_;
   std::string info_;
   std::string url_;
-  std::string notes_;
-  std::shared_ptr<Form> form_;
   std::map<std::string, std::string> urls_;
   std::vector<std::string> tags_;
-  std::vector<std::shared_ptr<Section>> sections_;
-  std::vector<std::shared_ptr<Field>> fields_;
-  std::vector<std::shared_ptr<PasswordHistory>> password_history_;
+
+  // The encrypted item keys and overview, kept for unlocking.
+  std::string key_data_;
+  std::string overview_data_;
+  bool locked_ = true;
+
+  // The details are kept encrypted together with the item keys until they
+  // are needed.
+  std::string details_data_;
+  std::array<uint8_t, 32> key_;
+  std::array<uint8_t, 32> mac_key_;
+  std::array<uint8_t, 32> hmac_;
+
+  mutable std::mutex details_mutex_;
+  mutable std::shared_ptr<const Details> details_;
+  // When set, the details are kept in the cache rather than in details_.
+  std::shared_ptr<DetailsCache> details_cache_;
 
   void UpdateFromOverview(const std::string& overview);
-  void UpdateFromDetails(const std::string& details);
+  void Parse(const json11::Json& json);
+  void Decrypt(Profile& profile);
 
  public:
-  Entry(const std::array<uint8_t, 16>& uuid,
+  Entry(const Uuid& uuid,
         const json11::Json& json,
         Profile& profile);
+  /**
+   * Creates a locked entry, holding only the attributes stored in plain text
+   * in the band file. Nothing is decrypted.
+   */
+  Entry(const Uuid& uuid, const json11::Json& json);
+  /**
+   * Recreates an entry, locked unless a profile is given.
+   */
+  explicit Entry(const Sealed& sealed, Profile* profile = nullptr);
+  ~Entry();
 
-  const std::array<uint8_t, 16>& uuid() const { return uuid_; }
-  const std::array<uint8_t, 16>& folder_uuid() const { return folder_uuid_; }
+  const Uuid& uuid() const { return uuid_; }
+  const Uuid& folder_uuid() const { return folder_uuid_; }
   Category category() const { return category_; }
   std::time_t creation_time() const { return creation_time_; }
   std::time_t modification_time() const { return modification_time_; }
   std::time_t transaction_time() const { return transaction_time_; }
   bool trashed() const { return trashed_; }
   uint32_t fave() const { return fave_; }
+  /**
+   * @return The HMAC of the entry as stored in the band file, which changes
+   *         whenever the entry is modified.
+   */
+  const std::array<uint8_t, 32>& hmac() const { return hmac_; }
+  /**
+   * @return The plain text attributes and encrypted data of the entry.
+   */
+  Sealed sealed() const;
+  /**
+   * @return true if the entry was created locked, in which case the
+   *         overview is empty and the details can not be decrypted.
+   */
+  bool locked() const { return locked_; }
   const std::string& title() const { return title_; }
   const std::string& info() const { return info_; }
   const std::string& url() const { return url_; }
-  const std::string& notes() const { return notes_; }
-  std::shared_ptr<Form> form() const { return form_; }
   const std::map<std::string, std::string>& urls() const { return urls_; }
   const std::vector<std::string>& tags() const { return tags_; }
-  const std::vector<std::shared_ptr<Section>>& sections() const {
-    return sections_;
+
+  /**
+   * Makes the entry keep its decrypted details in a cache with a limited
+   * budget. Needs to be set before the details are first accessed.
+   */
+  void set_details_cache(const std::shared_ptr<DetailsCache>& cache) {
+    details_cache_ = cache;
+  }
+
+  /**
+   * Decrypts the details unless already done. Safe to call from multiple
+   * threads, the details are decrypted once, or once each time they were
+   * evicted from the details cache.
+   * @return The entry details.
+   * @throw InternalError If the entry is locked.
+   * @throw IntegrityError If the details fail authentication.
+   * @throw FormatError If the details can not be parsed.
+   */
+  std::shared_ptr<const Details> details() const;
+  /**
+   * @return true if the decrypted details are held by the entry or the
+   *         details cache.
+   */
+  bool has_details() const;
+
+  // Shorthands decrypting the details if needed. The details may be evicted
+  // from the details cache as soon as the call returns, so values are
+  // returned by copy rather than by reference. Every call copies the value,
+  // and with a details cache it decrypts and parses the details again if
+  // they were evicted since the last call. Hold on to details() to read
+  // several values with one decryption and without copying.
+  std::string notes() const { return details()->notes(); }
+  std::shared_ptr<Form> form() const { return details()->form(); }
+  std::vector<std::shared_ptr<Section>> sections() const {
+    return details()->sections();
+  }
+  std::vector<std::shared_ptr<Field>> fields() const {
+    return details()->fields();
+  }
+  std::vector<std::shared_ptr<PasswordHistory>> password_history() const {
+    return details()->password_history();
   }
-  const std::vector<std::shared_ptr<Field>>& fields() const { return fields_; }
-  const std::vector<std::shared_ptr<PasswordHistory>>&
-      password_history() const { return password_history_; }
+  std::shared_ptr<Field> username_field() const {
+    return details()->username_field();
+  }
+  std::shared_ptr<Field> password_field() const {
+    return details()->password_field();
+  }
+  std::shared_ptr<Field> totp_field() const {
+    return details()->totp_field();
+  }
+  std::string username() const { return details()->username(); }
+  std::string password() const { return details()->password(); }
+  std::string totp() const { return details()->totp(); }
+
+  /**
+   * @return The main URL of the entry, falling back on the first of the
+   *         additional URLs if no main URL is set.
+   */
+  const std::string& primary_url() const;
 };
 
+/**
+ * Filters deciding which entries to load. The filters only look at the
+ * attributes stored in plain text in the band files and are applied before
+ * anything is decrypted, entries not passing them are skipped entirely.
+ */
+class LoadOptions final {
+ private:
+  std::set<Entry::Category> categories_;
+  std::set<Uuid> folders_;
+  bool trashed_ = true;
+  bool tombstones_ = true;
+  std::time_t updated_since_ = 0;
+  std::shared_ptr<DetailsCache> details_cache_;
+  bool index_notes_ = true;
+
+  bool Accepts(Entry::Category category, bool trashed, const Uuid& folder,
+               std::time_t updated) const;
+
+ public:
+  /**
+   * Only loads entries of these categories, all categories when empty.
+   */
+  void set_categories(const std::set<Entry::Category>& categories) {
+    categories_ = categories;
+  }
+  /**
+   * Only loads entries in these folders, all entries when empty. Entries
+   * outside any folder are included by adding the nil UUID.
+   */
+  void set_folders(const std::set<Uuid>& folders) { folders_ = folders; }
+  /**
+   * Whether to load entries in the trash. Enabled by default.
+   */
+  void set_trashed(bool trashed) { trashed_ = trashed; }
+  /**
+   * Whether to load tombstones of deleted entries. Enabled by default.
+   */
+  void set_tombstones(bool tombstones) { tombstones_ = tombstones; }
+  /**
+   * Only loads entries modified at or after a time, zero for all entries.
+   */
+  void set_updated_since(std::time_t time) { updated_since_ = time; }
+  /**
+   * Cache keeping the decrypted details of the loaded entries, by default
+   * entries keep their details once decrypted.
+   */
+  void set_details_cache(const std::shared_ptr<DetailsCache>& cache) {
+    details_cache_ = cache;
+  }
+  const std::shared_ptr<DetailsCache>& details_cache() const {
+    return details_cache_;
+  }
+  /**
+   * Whether the full-text index covers the notes of the entries. Enabled by
+   * default. Indexing the notes decrypts the details of every entry each time
+   * the index is built and keeps the folded notes in the index, outside the
+   * budget of the details cache, so users of a details cache will usually
+   * want to disable it.
+   */
+  void set_index_notes(bool index_notes) { index_notes_ = index_notes; }
+  bool index_notes() const { return index_notes_; }
+
+  /**
+   * @param [in] json Encrypted entry as stored in a band file.
+   * @return true if the entry passes the filters.
+   */
+  bool Accepts(const json11::Json& json) const;
+  bool Accepts(const Entry::Sealed& sealed) const;
+
+  /**
+   * @return A canonical description of the filters, equal for options with
+   *         equal filters. The details cache and notes indexing are not
+   *         included.
+   */
+  std::string Describe() const;
+};
+
+class ProgressiveLoader;
+
 class Bands final {
+ public:
+  /**
+   * Entries added, modified or removed by a refresh.
+   */
+  class Delta final {
+   private:
+    friend class Bands;
+
+    std::vector<std::shared_ptr<Entry>> added_;
+    std::vector<std::shared_ptr<Entry>> modified_;
+    std::vector<std::shared_ptr<Entry>> removed_;
+
+   public:
+    const std::vector<std::shared_ptr<Entry>>& added() const {
+      return added_;
+    }
+    /**
+     * @return The new versions of the modified entries.
+     */
+    const std::vector<std::shared_ptr<Entry>>& modified() const {
+      return modified_;
+    }
+    const std::vector<std::shared_ptr<Entry>>& removed() const {
+      return removed_;
+    }
+    bool empty() const {
+      return added_.empty() && modified_.empty() && removed_.empty();
+    }
+  };
+
+  static constexpr std::size_t kBandCount = 16;
+
  private:
+  friend class ProgressiveLoader;
+  friend class VaultImage;
+
+  class Band final {
+   public:
+    FileFingerprint fingerprint;
+    std::vector<std::shared_ptr<Entry>> entries;
+  };
+
+  LoadOptions options_;
+  std::array<Band, kBandCount> bands_;
   std::vector<std::shared_ptr<Entry>> entries_;
 
-  void LoadIfExists(const std::string path, Profile& profile);
+  void RefreshBand(Band& band, const std::string& text, Profile& profile,
+                   Delta& delta);
+  std::shared_ptr<Entry> MakeEntry(const Uuid& uuid, const json11::Json& json,
+                                   Profile& profile) const;
+  void RebuildEntries();
 
  public:
-  void Load(const std::string& dir_path, Profile& profile);
+  /**
+   * Loads the band files.
+   * @param [in] dir_path Path to the directory containing the band files.
+   * @param [in] profile Unlocked profile.
+   * @param [in] options Filters for the entries to load, also applied when
+   *                     refreshing.
+   */
+  void Load(const std::string& dir_path, Profile& profile,
+            const LoadOptions& options = LoadOptions());
+
+  /**
+   * Decrypts the entries of the band files one at a time, without keeping
+   * them. The band files are read incrementally, only one encrypted and one
+   * decrypted entry are held in memory at any time.
+   * @param [in] dir_path Path to the directory containing the band files.
+   * @param [in] profile Unlocked profile.
+   * @param [in] options Filters for the entries to decrypt.
+   * @param [in] callback Called with each entry, which is destroyed when the
+   *                      callback returns.
+   */
+  static void ForEach(const std::string& dir_path, Profile& profile,
+                      const LoadOptions& options,
+                      const std::function<void(const Entry& entry)>& callback);
+  /**
+   * Reads the encrypted entries of the band files one at a time, without
+   * parsing or decrypting them.
+   * @param [in] dir_path Path to the directory containing the band files.
+   * @param [in] callback Called with the UUID, as it appears in the band
+   *                      file, and the JSON text of each entry. Returns false
+   *                      to stop.
+   * @throw FormatError If a band file is malformed.
+   */
+  static void ForEachMember(
+      const std::string& dir_path,
+      const std::function<bool(const std::string& key,
+                               const std::string& value)>& callback);
+
+  /**
+   * Replaces the entries with locked entries holding only the plain text
+   * attributes and the encrypted data. Nothing is read from disk.
+   */
+  void Lock();
+  /**
+   * Replaces locked entries with decrypted ones, without reading or parsing
+   * the band files again.
+   * @param [in] profile Unlocked profile.
+   */
+  void Unlock(Profile& profile);
+
+  /**
+   * Reloads the band files changed since the last load or refresh. Entries
+   * with the same HMAC and transaction time as before are kept as is, only
+   * new and modified entries are decrypted.
+   * @param [in] dir_path Path to the directory containing the band files.
+   * @param [in] profile Unlocked profile.
+   * @return The changes.
+   */
+  Delta Refresh(const std::string& dir_path, Profile& profile);
 
+  /**
+   * Loads a single entry, reading only the band file the entry belongs to
+   * and decrypting only the entry itself.
+   * @param [in] dir_path Path to the directory containing the band files.
+   * @param [in] uuid UUID of the entry.
+   * @param [in] profile Unlocked profile.
+   * @param [in] options Filters for the entry and the details cache to keep
+   *                     its details in, see LoadOptions.
+   * @return The entry, or nullptr if there is no such entry or it does not
+   *         pass the filters.
+   */
+  static std::shared_ptr<Entry> LoadEntry(
+      const std::string& dir_path, const Uuid& uuid, Profile& profile,
+      const LoadOptions& options = LoadOptions());
+
+  /**
+   * @param [in] index Band number, from 0 to 15.
+   * @return The file name of a band, such as "band_A.js".
+   */
+  static std::string BandFileName(std::size_t index);
+
+  /**
+   * @return The options the entries were loaded with.
+   */
+  const LoadOptions& options() const { return options_; }
   const std::vector<std::shared_ptr<Entry>>& entries() const {
     return entries_;
   }
 };
 
+/**
+ * Loads the band files in steps, decrypting the entries in priority order.
+ * All band files are read and their plain text attributes parsed up front,
+ * which is cheap compared to decrypting the entries.
+ */
+class ProgressiveLoader final {
+ public:
+  enum class Order {
+    // Favorites in their favorite order, then the rest by modification time,
+    // most recent first.
+    kFavoritesFirst,
+    // By modification time, most recent first.
+    kRecentFirst,
+    // In the order of the band files, like Bands::Load.
+    kFile
+  };
+
+ private:
+  class Pending final {
+   public:
+    std::size_t band;
+    std::size_t slot;
+    Uuid uuid;
+    json11::Json json;
+  };
+
+  Profile& profile_;
+  Bands bands_;
+  std::vector<Pending> pending_;
+  std::size_t loaded_ = 0;
+  // Decrypted entries of each band, in file order.
+  std::array<std::vector<std::shared_ptr<Entry>>, Bands::kBandCount> slots_;
+
+ public:
+  /**
+   * Reads the band files and orders their entries.
+   * @param [in] dir_path Path to the directory containing the band files.
+   * @param [in] profile Unlocked profile, must outlive the loader.
+   * @param [in] order Order to decrypt the entries in.
+   * @param [in] options Filters for the entries to load.
+   */
+  ProgressiveLoader(const std::string& dir_path, Profile& profile,
+                    Order order, const LoadOptions& options = LoadOptions());
+
+  /**
+   * Decrypts the next entries.
+   * @param [in] count Maximum number of entries to decrypt.
+   */
+  void Step(std::size_t count);
+
+  bool done() const { return loaded_ == pending_.size(); }
+  std::size_t loaded() const { return loaded_; }
+  std::size_t total() const { return pending_.size(); }
+
+  /**
+   * @return The entries decrypted so far, in priority order. Once done, the
+   *         bands equal those loaded by Bands::Load and may be refreshed.
+   */
+  const Bands& bands() const { return bands_; }
+};
+
 }   // namespace onepass
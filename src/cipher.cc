@@ -71,7 +71,8 @@ void encrypt_ecb(std::istream& src, std::ostream& dst, const Cipher<16>& cipher)
                                     std::size_t src_len) -> std::size_t {
     if (src_len != 16) {
       assert(false);
-      throw InternalError("ECB can only encrypt an even number of blocks.");
+      throw InternalError(
+          "ECB can only encrypt a whole number of 16-byte blocks.");
     }
 
     cipher.Encrypt(src, dst);
@@ -85,7 +86,8 @@ void decrypt_ecb(std::istream& src, std::ostream& dst, const Cipher<16>& cipher)
                                     std::size_t src_len) -> std::size_t {
     if (src_len != 16) {
       assert(false);
-      throw InternalError("ECB can only decrypt an even number of blocks.");
+      throw InternalError(
+          "ECB can only decrypt a whole number of 16-byte blocks.");
     }
 
     cipher.Decrypt(src, dst);
@@ -138,7 +140,8 @@ void encrypt_cbc(std::istream& src, std::ostream& dst,
 
     if (src_len != 16) {
       assert(false);
-      throw InternalError("CBC can only encrypt an even number of blocks.");
+      throw InternalError(
+          "CBC can only encrypt a whole number of 16-byte blocks.");
     }
 
     cipher.Encrypt(src_xor_iv, dst);
@@ -204,4 +207,13 @@ void AesCipher::Encrypt(const std::array<uint8_t, 16>& src,
   AES_encrypt(src.data(), dst.data(), &key_enc_);
 }
 
+void AesCipher::DecryptCbc(const uint8_t* src, uint8_t* dst, std::size_t size,
+                           std::array<uint8_t, 16>& prv) const {
+  if (size % 16 != 0)
+    throw InternalError(
+        "CBC can only decrypt a whole number of 16-byte blocks.");
+
+  AES_cbc_encrypt(src, dst, size, &key_dec_, prv.data(), AES_DECRYPT);
+}
+
 }   // namespace onepass
@@ -72,6 +72,20 @@ class AesCipher final : public Cipher<16> {
                        std::array<uint8_t, 16>& dst) const override;
   virtual void Encrypt(const std::array<uint8_t, 16>& src,
                        std::array<uint8_t, 16>& dst) const override;
+
+  /**
+   * Decrypts a run of whole blocks in CBC mode, without going through
+   * streams. Suitable for decrypting large data in chunks.
+   * @param [in] src Cipher text.
+   * @param [out] dst Plain text, may be the same as @a src.
+   * @param [in] size Number of bytes to decrypt, a multiple of 16.
+   * @param [in,out] prv Cipher text block preceding @a src, or the
+   *                     initialization vector for the first block. Updated
+   *                     to the last block of @a src.
+   * @throw InternalError If @a size is not a multiple of 16.
+   */
+  void DecryptCbc(const uint8_t* src, uint8_t* dst, std::size_t size,
+                  std::array<uint8_t, 16>& prv) const;
 };
 
 }
@@ -19,34 +19,286 @@
 #include "database.hh"
 
 #include <cassert>
+#include <ctime>
 
+#include "exception.hh"
 #include "profile.hh"
+#include "util.hh"
+#include "vault_image.hh"
+
+namespace {
+
+// Number of entries published by the first step of a progressive load.
+constexpr std::size_t kFirstProgressiveStep = 16;
+
+/**
+ * Parses the folders file from the contents read when fingerprinting it,
+ * the folders then match the fingerprint even if the file changes again.
+ */
+void ParseFolders(const onepass::FileFingerprint& fingerprint,
+                  const std::string& text, onepass::Profile& profile,
+                  onepass::Folders& folders) {
+  if (!fingerprint.exists())
+    throw onepass::FileNotFoundError();
+  folders.Parse(onepass::ExtractJson(text), profile);
+}
+
+} // namespace
 
 namespace onepass {
 
-void Database::Load(const std::string& path, Profile& profile) {
-  assert(!profile.IsLocked());
-  folders_.Load(path + "/default/folders.js", profile);
-  bands_.Load(path + "/default/", profile);
+void Database::Snapshot::BuildIndexes() {
+  // Locked entries only have the plain text attributes, which is all the
+  // structural and time indexes need.
+  index_.Build(folders_, bands_);
+  time_index_.Build(folders_, bands_);
+  if (locked_)
+    return;
+
+  url_index_.Build(bands_);
+  text_index_.set_index_notes(bands_.options().index_notes());
+  text_index_.Build(bands_);
+  sorted_index_.Build(bands_);
+  fuzzy_index_.Build(bands_);
+
+  login_items_.clear();
+  for (const auto& entry : index_.EntriesInCategory(Entry::Category::kLogin))
+    login_items_.push_back(LoginItem(entry));
 }
 
-std::vector<Database::LoginItem> Database::GetLoginItems() const {
-  std::vector<LoginItem> logins;
+void Database::Snapshot::UpdateIndexes(bool folders_changed) {
+  // The structural indexes hold no decrypted data beyond the overview and
+  // are rebuilt, the others only process the entries that changed.
+  index_.Build(folders_, bands_);
+  url_index_.Build(bands_);
+  text_index_.Update(bands_);
+  sorted_index_.Update(bands_);
+  if (folders_changed)
+    time_index_.Build(folders_, bands_);
+  else
+    time_index_.Update(folders_, bands_);
+  fuzzy_index_.Build(bands_);
+
+  login_items_.clear();
+  for (const auto& entry : index_.EntriesInCategory(Entry::Category::kLogin))
+    login_items_.push_back(LoginItem(entry));
+}
 
-  for (const auto& entry : bands_.entries()) {
-    if (entry->category() != Entry::Category::kLogin)
-      continue;
+Database::Database() :
+    snapshot_(std::make_shared<const Snapshot>()) {
+}
+
+void Database::Publish(const std::shared_ptr<Snapshot>& next) {
+  next->version_ = snapshot()->version_ + 1;
+  std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(next));
+}
 
-    std::string password;
-    for (const auto& field : entry->fields()) {
-      if (field->type() == "P")
-        password = field->value().substr(1, field->value().size() -2 );
+void Database::Load(const std::string& path, Profile& profile,
+                    const LoadOptions& options) {
+  assert(!profile.IsLocked());
+  std::lock_guard<std::mutex> lock(write_mutex_);
+
+  auto next = std::make_shared<Snapshot>();
+  next->read_time_ = std::time(nullptr);
+  std::string text;
+  next->folders_fingerprint_.Refresh(path + "/default/folders.js", text);
+  ParseFolders(next->folders_fingerprint_, text, profile, next->folders_);
+  next->bands_.Load(path + "/default/", profile, options);
+  next->url_index_ = url_rules_;
+  next->BuildIndexes();
+
+  path_ = path;
+  profile_ = &profile;
+  Publish(next);
+}
+
+bool Database::LoadImage(const std::string& path, Profile& profile,
+                         const std::string& image_path,
+                         const LoadOptions& options) {
+  assert(!profile.IsLocked());
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto next = std::make_shared<Snapshot>();
+    next->read_time_ = std::time(nullptr);
+    if (VaultImage::Read(image_path, path + "/default", profile, options,
+                         next->folders_fingerprint_, next->folders_,
+                         next->bands_)) {
+      next->url_index_ = url_rules_;
+      next->BuildIndexes();
+
+      path_ = path;
+      profile_ = &profile;
+      Publish(next);
+      return true;
     }
+  }
+
+  Load(path, profile, options);
+  try {
+    SaveImage(image_path);
+  } catch (const IoError&) {
+    // The image only speeds up the next load, the vault is loaded anyway.
+  }
+  return false;
+}
+
+void Database::SaveImage(const std::string& image_path) {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  if (profile_ == nullptr)
+    throw InternalError("Database has not been loaded.");
+  std::shared_ptr<const Snapshot> current = snapshot();
+  if (current->locked_)
+    throw InternalError("Database is locked.");
+
+  VaultImage::Write(image_path, current->folders_fingerprint_,
+                    current->folders_, current->bands_, *profile_);
+}
+
+void Database::LoadProgressively(const std::string& path, Profile& profile,
+                                 ProgressiveLoader::Order order,
+                                 const ProgressCallback& progress,
+                                 const LoadOptions& options) {
+  assert(!profile.IsLocked());
+  std::lock_guard<std::mutex> lock(write_mutex_);
+
+  std::time_t read_time = std::time(nullptr);
+  std::string text;
+  FileFingerprint folders_fingerprint;
+  folders_fingerprint.Refresh(path + "/default/folders.js", text);
+  Folders folders;
+  ParseFolders(folders_fingerprint, text, profile, folders);
+  ProgressiveLoader loader(path + "/default/", profile, order, options);
+
+  path_ = path;
+  profile_ = &profile;
+
+  std::size_t step = kFirstProgressiveStep;
+  do {
+    loader.Step(step);
+    step *= 2;
+
+    auto next = std::make_shared<Snapshot>();
+    next->read_time_ = read_time;
+    next->folders_fingerprint_ = folders_fingerprint;
+    next->folders_ = folders;
+    next->bands_ = loader.bands();
+    next->url_index_ = url_rules_;
+    next->BuildIndexes();
+    Publish(next);
+
+    if (progress)
+      progress(loader.loaded(), loader.total());
+  } while (!loader.done());
+}
+
+void Database::LoadPublicSuffixList(const std::string& path) {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  url_rules_.LoadPublicSuffixList(path);
+}
+
+Database::Delta Database::Refresh() {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  if (profile_ == nullptr)
+    throw InternalError("Database has not been loaded.");
+  std::shared_ptr<const Snapshot> current = snapshot();
+  if (current->locked_)
+    throw InternalError("Database is locked.");
+  assert(!profile_->IsLocked());
+
+  // Entries are immutable and shared between snapshots, only the containers
+  // and indexes are copied. Writers are serialized, so the current snapshot
+  // cannot be replaced while the next one is built.
+  auto next = std::make_shared<Snapshot>();
+  next->read_time_ = std::time(nullptr);
+  next->folders_fingerprint_ = current->folders_fingerprint_;
+  next->bands_ = current->bands_;
+
+  std::string text;
+  bool folders_changed = next->folders_fingerprint_.Refresh(
+      path_ + "/default/folders.js", text);
+  if (folders_changed)
+    ParseFolders(next->folders_fingerprint_, text, *profile_, next->folders_);
+  else
+    next->folders_ = current->folders_;
 
-    logins.push_back(LoginItem(entry->url(), password));
+  // When nothing changed the next snapshot is dropped. Fingerprints of files
+  // only touched are then refreshed again next time, which costs a read.
+  Delta delta(next->bands_.Refresh(path_ + "/default/", *profile_),
+              folders_changed);
+  if (delta.empty())
+    return delta;
+
+  next->url_index_ = url_rules_;
+  next->text_index_ = current->text_index_;
+  next->sorted_index_ = current->sorted_index_;
+  next->time_index_ = current->time_index_;
+  next->UpdateIndexes(folders_changed);
+  Publish(next);
+
+  std::map<int, Subscriber> subscribers;
+  {
+    std::lock_guard<std::mutex> subscribers_lock(subscribers_mutex_);
+    subscribers = subscribers_;
   }
+  for (const auto& subscriber : subscribers)
+    subscriber.second(delta);
+  return delta;
+}
+
+void Database::Lock() {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  if (profile_ == nullptr)
+    throw InternalError("Database has not been loaded.");
+
+  // Readers still holding the previous snapshot keep its entries alive, the
+  // plain text goes away with the last of them.
+  std::shared_ptr<const Snapshot> current = snapshot();
+  auto next = std::make_shared<Snapshot>();
+  next->locked_ = true;
+  next->read_time_ = current->read_time_;
+  next->folders_fingerprint_ = current->folders_fingerprint_;
+  next->folders_ = current->folders_;
+  next->folders_.Lock();
+  next->bands_ = current->bands_;
+  next->bands_.Lock();
+  next->BuildIndexes();
+  Publish(next);
+
+  profile_->Lock();
+}
+
+void Database::Unlock(const std::string& password) {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  if (profile_ == nullptr)
+    throw InternalError("Database has not been loaded.");
+
+  profile_->Unlock(password);
+  std::shared_ptr<const Snapshot> current = snapshot();
+  if (!current->locked_)
+    return;
+
+  auto next = std::make_shared<Snapshot>();
+  next->read_time_ = current->read_time_;
+  next->folders_fingerprint_ = current->folders_fingerprint_;
+  next->folders_ = current->folders_;
+  next->folders_.Unlock(*profile_);
+  next->bands_ = current->bands_;
+  next->bands_.Unlock(*profile_);
+  next->url_index_ = url_rules_;
+  next->BuildIndexes();
+  Publish(next);
+}
+
+int Database::Subscribe(const Subscriber& subscriber) {
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  int id = next_subscriber_id_++;
+  subscribers_[id] = subscriber;
+  return id;
+}
 
-  return logins;
+void Database::Unsubscribe(int id) {
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  subscribers_.erase(id);
 }
 
 }   // namespace onepass
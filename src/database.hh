@@ -17,8 +17,26 @@
  */
 
 #pragma once
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "fingerprint.hh"
 #include "folders.hh"
+#include "attachment.hh"
 #include "bands.hh"
+#include "fuzzy.hh"
+#include "index.hh"
+#include "query.hh"
+#include "scan.hh"
+#include "sorted_index.hh"
+#include "text_index.hh"
+#include "time_index.hh"
+#include "url_index.hh"
+#include "view.hh"
 
 namespace onepass {
 
@@ -26,27 +44,514 @@ class Profile;
 
 class Database final {
  public:
+  /**
+   * Login item referencing the underlying entry. The URL references the
+   * entry, the credentials are copied from the details when accessed. Each
+   * accessor goes through the entry shorthands, so with a details cache an
+   * accessor decrypts the details again if they were evicted since the last
+   * one, for example by other readers sharing the cache. Read both from
+   * entry()->details() to decrypt at most once.
+   */
   class LoginItem final {
    private:
-    std::string url_;
-    std::string password_;
+    std::shared_ptr<Entry> entry_;
+
+   public:
+    explicit LoginItem(const std::shared_ptr<Entry>& entry) :
+        entry_(entry) {}
+
+    const std::string& url() const { return entry_->primary_url(); }
+    std::string username() const { return entry_->username(); }
+    std::string password() const { return entry_->password(); }
+    std::shared_ptr<Entry> entry() const { return entry_; }
+  };
+
+  /**
+   * Changes applied by a refresh.
+   */
+  class Delta final {
+   private:
+    Bands::Delta entries_;
+    bool folders_changed_;
 
    public:
-    LoginItem(const std::string& url, const std::string& password) :
-        url_(url), password_(password) {}
+    Delta(const Bands::Delta& entries, bool folders_changed) :
+        entries_(entries), folders_changed_(folders_changed) {}
+
+    const std::vector<std::shared_ptr<Entry>>& added() const {
+      return entries_.added();
+    }
+    const std::vector<std::shared_ptr<Entry>>& modified() const {
+      return entries_.modified();
+    }
+    const std::vector<std::shared_ptr<Entry>>& removed() const {
+      return entries_.removed();
+    }
+    bool folders_changed() const { return folders_changed_; }
+    bool empty() const { return entries_.empty() && !folders_changed_; }
+  };
+
+  typedef std::function<void(const Delta& delta)> Subscriber;
+
+  /**
+   * Called each time a progressive load published more entries.
+   * @param [in] loaded Number of entries loaded so far.
+   * @param [in] total Number of entries to load, the load is complete when
+   *                   @a loaded equals @a total.
+   */
+  typedef std::function<void(std::size_t loaded, std::size_t total)>
+      ProgressCallback;
+
+  /**
+   * Immutable state of the database at one point in time. Loading or
+   * refreshing the database builds a new snapshot and publishes it, so a
+   * reader holding on to a snapshot keeps seeing a consistent state for as
+   * long as it wants, without blocking or being blocked by writers.
+   */
+  class Snapshot final : public std::enable_shared_from_this<Snapshot> {
+   private:
+    friend class Database;
+
+    uint64_t version_ = 0;
+    bool locked_ = false;
+    // When the vault files were read, before reading started.
+    std::time_t read_time_ = 0;
+    FileFingerprint folders_fingerprint_;
+    Folders folders_;
+    Bands bands_;
+    Index index_;
+    UrlIndex url_index_;
+    TextIndex text_index_;
+    SortedIndex sorted_index_;
+    TimeIndex time_index_;
+    FuzzyIndex fuzzy_index_;
+    std::vector<LoginItem> login_items_;
+
+    void BuildIndexes();
+    void UpdateIndexes(bool folders_changed);
+
+   public:
+    /**
+     * @return Number of the snapshot, increasing by one for each snapshot
+     *         published by the database.
+     */
+    uint64_t version() const { return version_; }
+
+    /**
+     * @return true if the snapshot was taken while the database was locked.
+     *         Locked snapshots hold locked entries and only index them by
+     *         the attributes stored in plain text, that is by category,
+     *         folder and time.
+     */
+    bool locked() const { return locked_; }
+
+    const std::vector<LoginItem>& GetLoginItems() const {
+      return login_items_;
+    }
+
+    const std::vector<std::shared_ptr<Folder>>& folders() const {
+      return folders_.folders();
+    }
+    const std::vector<std::shared_ptr<Entry>>& entries() const {
+      return bands_.entries();
+    }
+
+    /**
+     * @return A lazy view of all entries, narrowed down using
+     *         EntryView::Where. The view keeps the snapshot alive.
+     */
+    EntryView View() const { return EntryView(bands_.entries(),
+                                              shared_from_this()); }
+
+    std::shared_ptr<Entry> Find(const Uuid& uuid) const {
+      return index_.FindEntry(uuid);
+    }
+    std::shared_ptr<Folder> FindFolder(const Uuid& uuid) const {
+      return index_.FindFolder(uuid);
+    }
+    const Index::EntryList& EntriesInFolder(const Uuid& folder_uuid) const {
+      return index_.EntriesInFolder(folder_uuid);
+    }
+    const Index::EntryList& EntriesInCategory(
+        Entry::Category category) const {
+      return index_.EntriesInCategory(category);
+    }
+    const Index::EntryList& EntriesWithTag(const std::string& tag) const {
+      return index_.EntriesWithTag(tag);
+    }
+
+    /**
+     * Finds the entries applying to a web page.
+     * @param [in] url Page URL.
+     * @return Matching entries, best matches first.
+     */
+    std::vector<UrlIndex::Match> FindByUrl(const std::string& url) const {
+      return url_index_.Find(url);
+    }
+    std::vector<std::vector<UrlIndex::Match>> FindByUrls(
+        const std::vector<std::string>& urls) const {
+      return url_index_.Find(urls);
+    }
+
+    /**
+     * Searches the titles, tags, additional information, URLs and notes of
+     * the entries, the notes unless disabled by LoadOptions::set_index_notes.
+     * See TextIndex::Search.
+     */
+    std::vector<TextIndex::Hit> Search(
+        const std::string& query, std::size_t limit = 0,
+        TextIndex::Mode mode = TextIndex::Mode::kSubstring) const {
+      return text_index_.Search(query, limit, mode);
+    }
+
+    /**
+     * Fuzzy matches the entry titles. See FuzzyIndex::Search.
+     */
+    std::vector<FuzzyIndex::Match> FuzzySearch(const std::string& query,
+                                               std::size_t limit) const {
+      return fuzzy_index_.Search(query, limit);
+    }
+
+    /**
+     * Lists the entries in sorted order, a page at a time. See
+     * SortedIndex::List.
+     */
+    SortedIndex::Page List(
+        SortedIndex::Order order, std::size_t limit,
+        const SortedIndex::Cursor& after = SortedIndex::Cursor()) const {
+      return sorted_index_.List(order, limit, after);
+    }
+
+    /**
+     * Finds entries by title prefix. See SortedIndex::Complete.
+     */
+    std::vector<std::shared_ptr<Entry>> Complete(const std::string& prefix,
+                                                 std::size_t limit) const {
+      return sorted_index_.Complete(prefix, limit);
+    }
+
+    /**
+     * @return Entries with a modification or transaction time within
+     *         [first, last), in time order.
+     */
+    std::vector<std::shared_ptr<Entry>> EntriesBetween(
+        TimeIndex::Field field, std::time_t first, std::time_t last) const {
+      return time_index_.Between(field, first, last);
+    }
+
+    /**
+     * Finds the entries and folders changed since a previous sync. Items
+     * changed in the second the vault was read are reported again by the
+     * next call, see TimeIndex::ChangedSince.
+     * @param [in] watermark Watermark returned by the previous call, or zero
+     *                       for everything.
+     * @return Changed items together with the next watermark.
+     */
+    TimeIndex::Changes ChangedSince(std::time_t watermark) const {
+      return time_index_.ChangedSince(watermark, read_time_);
+    }
+
+    /**
+     * Compiles a query against the indexes of the snapshot. See Query for
+     * the syntax.
+     * @throw FormatError If the query is malformed.
+     */
+    QueryPlan Plan(const std::string& query) const {
+      return QueryPlan(Query(query), bands_, folders_, index_, url_index_,
+                       text_index_);
+    }
+
+    /**
+     * @return The entries matching a query. See Query for the syntax.
+     * @throw FormatError If the query is malformed.
+     */
+    Index::EntryList Select(const std::string& query) const {
+      return Plan(query).Execute();
+    }
 
-    const std::string& url() const { return url_; }
-    const std::string& password() const { return password_; }
+    /**
+     * Scans every decrypted value of all entries for a pattern, without
+     * using the indexes. See Scanner.
+     * @param [in] pattern Substring or regular expression to look for.
+     * @param [in] syntax How to interpret @a pattern.
+     * @param [in] ignore_case Whether ASCII letters match regardless of case.
+     * @param [in] callback Receiver of the matches.
+     */
+    void Scan(const std::string& pattern, Scanner::Syntax syntax,
+              bool ignore_case, const Scanner::Callback& callback) const {
+      Scanner(pattern, syntax, ignore_case).Scan(bands_.entries(), callback);
+    }
   };
 
  private:
-  Folders folders_;
-  Bands bands_;
+  // Only accessed using std::atomic_load and std::atomic_store.
+  std::shared_ptr<const Snapshot> snapshot_;
+
+  // Serializes all writers: loading, refreshing, locking, unlocking, image
+  // handling and LoadPublicSuffixList. Readers only pin snapshots.
+  std::mutex write_mutex_;
+  std::string path_;
+  Profile* profile_ = nullptr;
+  // Public suffix rules copied into the URL index of each snapshot.
+  UrlIndex url_rules_;
+
+  std::mutex subscribers_mutex_;
+  std::map<int, Subscriber> subscribers_;
+  int next_subscriber_id_ = 0;
+
+  void Publish(const std::shared_ptr<Snapshot>& next);
 
  public:
-  void Load(const std::string& path, Profile& profile);
+  Database();
+
+  /**
+   * Loads a vault. The profile is kept for refreshing the database later and
+   * must outlive it.
+   * @param [in] path Path to the vault.
+   * @param [in] profile Unlocked profile of the vault.
+   * @param [in] options Filters for the entries to load, see LoadOptions.
+   */
+  void Load(const std::string& path, Profile& profile,
+            const LoadOptions& options = LoadOptions());
+
+  /**
+   * Loads a vault from a binary image saved by SaveImage when the image is
+   * intact, up to date with the vault files and holds the entries @a
+   * options selects, that is it was saved without filters or with the same
+   * filters. Otherwise the vault is loaded as by Load and a new image is
+   * saved. Failing to save the image does not fail the load, the next load
+   * then falls back to Load again. Using the image skips reading and
+   * parsing the band files, the item keys and overviews are still decrypted
+   * and the indexes rebuilt, see VaultImage.
+   * @param [in] path Path to the vault.
+   * @param [in] profile Unlocked profile of the vault.
+   * @param [in] image_path Path of the image file.
+   * @param [in] options Filters for the entries to load, see LoadOptions.
+   * @return true if the image was used.
+   */
+  bool LoadImage(const std::string& path, Profile& profile,
+                 const std::string& image_path,
+                 const LoadOptions& options = LoadOptions());
+
+  /**
+   * Saves a binary image of the loaded vault for LoadImage. The image holds
+   * the entries of the current snapshot, save it from a database loaded
+   * without filters for the image to be usable with any filters.
+   * @param [in] image_path Path of the image file.
+   * @throw InternalError If the database has not been loaded or is locked.
+   * @throw IoError If the image can not be written.
+   */
+  void SaveImage(const std::string& image_path);
+
+  /**
+   * Loads a vault in steps, decrypting the entries in priority order and
+   * publishing a snapshot after each step, so that the first entries can be
+   * queried from other threads long before the whole vault is loaded. The
+   * steps double in size, the indexes are rebuilt for each snapshot. Returns
+   * once everything is loaded.
+   * @param [in] path Path to the vault.
+   * @param [in] profile Unlocked profile of the vault.
+   * @param [in] order Order to load the entries in.
+   * @param [in] progress Called after each published snapshot.
+   * @param [in] options Filters for the entries to load, see LoadOptions.
+   */
+  void LoadProgressively(const std::string& path, Profile& profile,
+                         ProgressiveLoader::Order order,
+                         const ProgressCallback& progress,
+                         const LoadOptions& options = LoadOptions());
+
+  /**
+   * Loads a single entry from a vault without loading the database. Only the
+   * band file holding the entry is read, and only the entry is decrypted,
+   * which suits short-lived processes fetching one secret.
+   * @param [in] path Path to the vault.
+   * @param [in] uuid UUID of the entry.
+   * @param [in] profile Unlocked profile of the vault.
+   * @param [in] options Filters for the entry and the details cache to keep
+   *                     its details in, see LoadOptions.
+   * @return The entry, or nullptr if there is no such entry or it does not
+   *         pass the filters.
+   */
+  static std::shared_ptr<Entry> LoadEntry(
+      const std::string& path, const Uuid& uuid, Profile& profile,
+      const LoadOptions& options = LoadOptions()) {
+    return Bands::LoadEntry(path + "/default/", uuid, profile, options);
+  }
+
+  /**
+   * Streams the entries of a vault without loading the database, band by
+   * band and entry by entry. Memory use is bounded by the largest entry
+   * rather than by the vault size, which suits converting vaults.
+   * @param [in] path Path to the vault.
+   * @param [in] profile Unlocked profile of the vault.
+   * @param [in] options Filters for the entries, see LoadOptions.
+   * @param [in] callback Called with each entry, which is released when the
+   *                      callback returns.
+   */
+  static void ForEachEntry(
+      const std::string& path, Profile& profile, const LoadOptions& options,
+      const std::function<void(const Entry& entry)>& callback) {
+    Bands::ForEach(path + "/default/", profile, options, callback);
+  }
+
+  /**
+   * Opens the attachments of an entry. Only the attachment metadata is read,
+   * the contents are streamed from disk when read.
+   * @param [in] path Path to the vault.
+   * @param [in] entry Unlocked entry.
+   * @param [in] profile Unlocked profile of the vault.
+   * @return The attachments of the entry.
+   */
+  static std::vector<std::shared_ptr<Attachment>> LoadAttachments(
+      const std::string& path, const Entry& entry, Profile& profile) {
+    return Attachment::Load(path + "/default/", entry, profile);
+  }
+
+  /**
+   * Reloads what changed on disk since the vault was loaded or last
+   * refreshed. Only band files which changed are parsed, and only new or
+   * modified entries in them are decrypted. The next snapshot is built next
+   * to the current one, which readers keep using until the new one is
+   * published. Subscribers are notified when anything changed.
+   * @return The changes.
+   * @throw InternalError If the database has not been loaded or is locked.
+   */
+  Delta Refresh();
+
+  /**
+   * Locks the database and its profile. The decrypted entries, folders and
+   * the indexes built from them are dropped from the published snapshot,
+   * while the parsed encrypted data and the indexes by category, folder and
+   * time are kept.
+   * @throw InternalError If the database has not been loaded.
+   */
+  void Lock();
+
+  /**
+   * Unlocks the profile and decrypts the overviews of the entries kept when
+   * locking, without reading or parsing the vault files again. The details
+   * are decrypted right away when the notes are indexed, otherwise on first
+   * access, see LoadOptions::set_index_notes.
+   * @param [in] password Master password.
+   * @throw PasswordError If the password is wrong.
+   * @throw InternalError If the database has not been loaded.
+   */
+  void Unlock(const std::string& password);
+
+  bool IsLocked() const { return snapshot()->locked(); }
+
+  /**
+   * Refreshes the database on a background thread. See Refresh.
+   */
+  std::future<Delta> RefreshAsync() {
+    return std::async(std::launch::async, &Database::Refresh, this);
+  }
+
+  /**
+   * Registers a function called with the changes of each refresh changing
+   * anything. Subscribers are called on the thread calling Refresh, after
+   * the new snapshot has been published.
+   * @return Identifier for unsubscribing.
+   */
+  int Subscribe(const Subscriber& subscriber);
+  void Unsubscribe(int id);
+
+  /**
+   * Pins the current snapshot. Readers needing several consistent lookups,
+   * or references into the indexes, should use a pinned snapshot rather
+   * than the methods of the database, which each read the latest snapshot.
+   * @return The current snapshot, empty before loading.
+   */
+  std::shared_ptr<const Snapshot> snapshot() const {
+    return std::atomic_load(&snapshot_);
+  }
+
+  std::vector<LoginItem> GetLoginItems() const {
+    return snapshot()->GetLoginItems();
+  }
+
+  std::vector<std::shared_ptr<Folder>> folders() const {
+    return snapshot()->folders();
+  }
+  std::vector<std::shared_ptr<Entry>> entries() const {
+    return snapshot()->entries();
+  }
+
+  EntryView View() const { return snapshot()->View(); }
+
+  std::shared_ptr<Entry> Find(const Uuid& uuid) const {
+    return snapshot()->Find(uuid);
+  }
+  std::shared_ptr<Folder> FindFolder(const Uuid& uuid) const {
+    return snapshot()->FindFolder(uuid);
+  }
+  Index::EntryList EntriesInFolder(const Uuid& folder_uuid) const {
+    return snapshot()->EntriesInFolder(folder_uuid);
+  }
+  Index::EntryList EntriesInCategory(Entry::Category category) const {
+    return snapshot()->EntriesInCategory(category);
+  }
+  Index::EntryList EntriesWithTag(const std::string& tag) const {
+    return snapshot()->EntriesWithTag(tag);
+  }
+
+  /**
+   * Replaces the built-in public suffix rules used for matching URLs with a
+   * list loaded from disk. Needs to be called before loading the database.
+   */
+  void LoadPublicSuffixList(const std::string& path);
+
+  std::vector<UrlIndex::Match> FindByUrl(const std::string& url) const {
+    return snapshot()->FindByUrl(url);
+  }
+  std::vector<std::vector<UrlIndex::Match>> FindByUrls(
+      const std::vector<std::string>& urls) const {
+    return snapshot()->FindByUrls(urls);
+  }
+
+  std::vector<TextIndex::Hit> Search(
+      const std::string& query, std::size_t limit = 0,
+      TextIndex::Mode mode = TextIndex::Mode::kSubstring) const {
+    return snapshot()->Search(query, limit, mode);
+  }
+
+  std::vector<FuzzyIndex::Match> FuzzySearch(const std::string& query,
+                                             std::size_t limit) const {
+    return snapshot()->FuzzySearch(query, limit);
+  }
+
+  SortedIndex::Page List(
+      SortedIndex::Order order, std::size_t limit,
+      const SortedIndex::Cursor& after = SortedIndex::Cursor()) const {
+    return snapshot()->List(order, limit, after);
+  }
+
+  std::vector<std::shared_ptr<Entry>> Complete(const std::string& prefix,
+                                               std::size_t limit) const {
+    return snapshot()->Complete(prefix, limit);
+  }
+
+  std::vector<std::shared_ptr<Entry>> EntriesBetween(
+      TimeIndex::Field field, std::time_t first, std::time_t last) const {
+    return snapshot()->EntriesBetween(field, first, last);
+  }
+
+  TimeIndex::Changes ChangedSince(std::time_t watermark) const {
+    return snapshot()->ChangedSince(watermark);
+  }
+
+  QueryPlan Plan(const std::string& query) const {
+    return snapshot()->Plan(query);
+  }
+
+  Index::EntryList Select(const std::string& query) const {
+    return snapshot()->Select(query);
+  }
 
-  std::vector<LoginItem> GetLoginItems() const;
+  void Scan(const std::string& pattern, Scanner::Syntax syntax,
+            bool ignore_case, const Scanner::Callback& callback) const {
+    snapshot()->Scan(pattern, syntax, ignore_case, callback);
+  }
 };
 
 }   // namespace onepass
@@ -0,0 +1,97 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "details_cache.hh"
+
+namespace onepass {
+
+void DetailsCache::Evict() {
+  while (statistics_.size > budget_ && items_.size() > 1) {
+    const Item& item = items_.back();
+    statistics_.size -= item.size;
+    ++statistics_.evictions;
+    lookup_.erase(item.entry);
+    items_.pop_back();
+  }
+  statistics_.entries = items_.size();
+}
+
+std::shared_ptr<const Entry::Details> DetailsCache::Find(const Entry* entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = lookup_.find(entry);
+  if (it == lookup_.end()) {
+    ++statistics_.misses;
+    return nullptr;
+  }
+
+  ++statistics_.hits;
+  items_.splice(items_.begin(), items_, it->second);
+  return it->second->details;
+}
+
+void DetailsCache::Insert(const Entry* entry,
+                          const std::shared_ptr<const Entry::Details>& details,
+                          std::size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = lookup_.find(entry);
+  if (it != lookup_.end()) {
+    statistics_.size -= it->second->size;
+    items_.erase(it->second);
+  }
+
+  Item item = { entry, details, size };
+  items_.push_front(item);
+  lookup_[entry] = items_.begin();
+  statistics_.size += size;
+  Evict();
+}
+
+void DetailsCache::Erase(const Entry* entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = lookup_.find(entry);
+  if (it == lookup_.end())
+    return;
+
+  statistics_.size -= it->second->size;
+  items_.erase(it->second);
+  lookup_.erase(it);
+  statistics_.entries = items_.size();
+}
+
+bool DetailsCache::Contains(const Entry* entry) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lookup_.count(entry) != 0;
+}
+
+std::size_t DetailsCache::budget() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return budget_;
+}
+
+void DetailsCache::set_budget(std::size_t budget) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  budget_ = budget;
+  Evict();
+}
+
+DetailsCache::Statistics DetailsCache::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+}   // namespace onepass
@@ -0,0 +1,99 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "bands.hh"
+
+namespace onepass {
+
+/**
+ * Keeps the decrypted details of the most recently used entries within a
+ * byte budget. Entries using the cache do not hold on to their details,
+ * details evicted from the cache are decrypted again when next needed.
+ * Safe to use from multiple threads.
+ */
+class DetailsCache final {
+ public:
+  class Statistics final {
+   public:
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    // Size of the decrypted details in the cache, in bytes.
+    std::size_t size = 0;
+    std::size_t entries = 0;
+  };
+
+ private:
+  class Item final {
+   public:
+    const Entry* entry;
+    std::shared_ptr<const Entry::Details> details;
+    std::size_t size;
+  };
+
+  mutable std::mutex mutex_;
+  std::size_t budget_;
+  // Most recently used first.
+  std::list<Item> items_;
+  std::unordered_map<const Entry*, std::list<Item>::iterator> lookup_;
+  Statistics statistics_;
+
+  void Evict();
+
+ public:
+  /**
+   * @param [in] budget Maximum size of the decrypted details to keep, in
+   *                    bytes. The most recently used details are kept even
+   *                    if larger.
+   */
+  explicit DetailsCache(std::size_t budget) : budget_(budget) {}
+
+  /**
+   * Looks up the details of an entry, marking them as recently used.
+   * @return The details, or nullptr if not cached.
+   */
+  std::shared_ptr<const Entry::Details> Find(const Entry* entry);
+
+  /**
+   * Adds or replaces the details of an entry, evicting the least recently
+   * used details if needed.
+   * @param [in] entry Entry the details belong to.
+   * @param [in] details Decrypted details.
+   * @param [in] size Size of the decrypted details, in bytes.
+   */
+  void Insert(const Entry* entry,
+              const std::shared_ptr<const Entry::Details>& details,
+              std::size_t size);
+
+  void Erase(const Entry* entry);
+  bool Contains(const Entry* entry) const;
+
+  std::size_t budget() const;
+  void set_budget(std::size_t budget);
+
+  Statistics statistics() const;
+};
+
+}   // namespace onepass
@@ -0,0 +1,553 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+#include "base64.hh"
+#include "exception.hh"
+#include "exporter.hh"
+#include "json11.hh"
+
+namespace {
+
+// Formatted entries are collected and written in chunks of about this size.
+constexpr std::size_t kWriteBufferSize = 1 << 20;
+
+std::string CategoryCode(onepass::Entry::Category category) {
+  char code[8];
+  std::snprintf(code, sizeof(code), "%03d", static_cast<int>(category));
+  return code;
+}
+
+/**
+ * @return The time as an ISO 8601 UTC string.
+ */
+std::string FormatTime(std::time_t time) {
+  struct tm tm;
+  gmtime_r(&time, &tm);
+  char text[32];
+  std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &tm);
+  return text;
+}
+
+std::string Join(const std::vector<std::string>& values, char separator) {
+  std::string text;
+  for (const auto& value : values) {
+    if (!text.empty())
+      text.push_back(separator);
+    text.append(value);
+  }
+  return text;
+}
+
+/**
+ * Appends a CSV field, quoting it if it contains a separator, a quote or a
+ * line break.
+ */
+void AppendCsv(std::string& out, const std::string& value) {
+  if (value.find_first_of(",\"\r\n") == std::string::npos) {
+    out.append(value);
+    return;
+  }
+
+  out.push_back('"');
+  for (char c : value) {
+    if (c == '"')
+      out.push_back('"');
+    out.push_back(c);
+  }
+  out.push_back('"');
+}
+
+void AppendXml(std::string& out, const std::string& value) {
+  for (char c : value) {
+    switch (c) {
+      case '<': out.append("&lt;"); break;
+      case '>': out.append("&gt;"); break;
+      case '&': out.append("&amp;"); break;
+      case '"': out.append("&quot;"); break;
+      case '\'': out.append("&apos;"); break;
+      default:
+        // Control characters other than white space are not allowed in XML
+        // 1.0 documents.
+        if (static_cast<unsigned char>(c) >= 0x20 ||
+            c == '\t' || c == '\n' || c == '\r') {
+          out.push_back(c);
+        }
+        break;
+    }
+  }
+}
+
+void AppendXmlString(std::string& out, const std::string& key,
+                     const std::string& value, bool protect = false) {
+  out.append("<String><Key>");
+  AppendXml(out, key);
+  out.append(protect ? "</Key><Value ProtectInMemory=\"True\">" :
+                       "</Key><Value>");
+  AppendXml(out, value);
+  out.append("</Value></String>");
+}
+
+json11::Json FieldsJson(
+    const std::vector<std::shared_ptr<onepass::Entry::Field>>& fields) {
+  json11::Json::array array;
+  for (const auto& field : fields) {
+    array.push_back(json11::Json::object {
+      { "name", field->name() },
+      { "designation", field->designation() },
+      { "type", field->type() },
+      { "value", field->value().ToString() }
+    });
+  }
+  return array;
+}
+
+/**
+ * Entry to export. Entries read from a vault are parsed and decrypted by the
+ * worker formatting them, loaded entries are only formatted.
+ */
+class Item final {
+ public:
+  std::string key;
+  std::string json;
+  std::shared_ptr<onepass::Entry> entry;
+};
+
+/**
+ * State shared by the stages of an export. Items are numbered in input
+ * order, workers take items from the input queue and put the formatted
+ * entries into a reorder buffer, from which the writer takes them in order.
+ * A worker holding an entry too far ahead of the writer waits, which bounds
+ * the reorder buffer.
+ */
+class Pipeline final {
+ private:
+  const onepass::ExportFormat& format_;
+  const onepass::LoadOptions* options_;
+  onepass::Profile* profile_;
+  const std::size_t queue_size_;
+  std::ostream& out_;
+
+  std::mutex mutex_;
+  std::condition_variable input_not_full_;
+  std::condition_variable input_not_empty_;
+  std::condition_variable output_changed_;
+  std::condition_variable window_moved_;
+
+  std::deque<std::pair<std::size_t, Item>> input_;
+  std::size_t produced_ = 0;
+  bool closed_ = false;
+  // Formatted entries by input number, filtered entries have no text.
+  std::map<std::size_t, std::pair<bool, std::string>> output_;
+  std::size_t written_ = 0;
+  std::size_t exported_ = 0;
+  std::exception_ptr error_;
+
+  void Fail(std::exception_ptr error) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = error;
+    }
+    NotifyAll();
+  }
+
+  void NotifyAll() {
+    input_not_full_.notify_all();
+    input_not_empty_.notify_all();
+    output_changed_.notify_all();
+    window_moved_.notify_all();
+  }
+
+  /**
+   * @return true if the item passed the filters and was formatted, false if
+   *         it was filtered out.
+   */
+  bool FormatItem(const Item& item, std::string& text) const {
+    if (item.entry) {
+      format_.Format(*item.entry, text);
+      return true;
+    }
+
+    std::string err;
+    json11::Json json = json11::Json::parse(item.json, err);
+    if (!err.empty() || !json.is_object())
+      throw onepass::FormatError("Unable to parse JSON data in band.");
+    if (!options_->Accepts(json))
+      return false;
+
+    onepass::Entry entry(onepass::ParseUuid(item.key), json, *profile_);
+    format_.Format(entry, text);
+    return true;
+  }
+
+  void Work() {
+    for (;;) {
+      std::pair<std::size_t, Item> work;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        input_not_empty_.wait(lock, [this] {
+          return !input_.empty() || closed_ || error_;
+        });
+        if (error_ || input_.empty())
+          return;
+        work = std::move(input_.front());
+        input_.pop_front();
+      }
+      input_not_full_.notify_one();
+
+      std::pair<bool, std::string> result;
+      try {
+        result.first = FormatItem(work.second, result.second);
+      } catch (...) {
+        Fail(std::current_exception());
+        return;
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        window_moved_.wait(lock, [&] {
+          return work.first < written_ + queue_size_ || error_;
+        });
+        if (error_)
+          return;
+        output_[work.first] = std::move(result);
+      }
+      output_changed_.notify_one();
+    }
+  }
+
+  void Flush(std::string& buffer) {
+    out_.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    if (!out_)
+      throw onepass::IoError("Unable to write export.");
+    buffer.clear();
+  }
+
+  void Write() {
+    std::string buffer;
+    try {
+      for (;;) {
+        std::pair<bool, std::string> result;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          output_changed_.wait(lock, [this] {
+            return output_.count(written_) != 0 ||
+                   (closed_ && written_ == produced_) || error_;
+          });
+          if (error_)
+            return;
+
+          auto it = output_.find(written_);
+          if (it == output_.end())
+            break;
+          result = std::move(it->second);
+          output_.erase(it);
+          ++written_;
+          if (result.first)
+            ++exported_;
+        }
+        window_moved_.notify_all();
+
+        buffer.append(result.second);
+        if (buffer.size() >= kWriteBufferSize)
+          Flush(buffer);
+      }
+      Flush(buffer);
+    } catch (...) {
+      Fail(std::current_exception());
+    }
+  }
+
+ public:
+  Pipeline(const onepass::ExportFormat& format,
+           const onepass::LoadOptions* options, onepass::Profile* profile,
+           std::size_t queue_size, std::ostream& out) :
+      format_(format), options_(options), profile_(profile),
+      queue_size_(std::max<std::size_t>(queue_size, 1)), out_(out) {}
+
+  /**
+   * Queues an item, waiting while the input queue is full.
+   * @return false if the export has failed and no more items should be
+   *         queued.
+   */
+  bool Push(Item&& item) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      input_not_full_.wait(lock, [this] {
+        return input_.size() < queue_size_ || error_;
+      });
+      if (error_)
+        return false;
+      input_.emplace_back(produced_++, std::move(item));
+    }
+    input_not_empty_.notify_one();
+    return true;
+  }
+
+  /**
+   * Runs the pipeline, reading the input on the calling thread.
+   * @param [in] threads Number of worker threads.
+   * @param [in] produce Function pushing the items to export.
+   * @return Number of exported entries.
+   */
+  std::size_t Run(std::size_t threads, const std::function<void()>& produce) {
+    out_ << format_.Header();
+    if (!out_)
+      throw onepass::IoError("Unable to write export.");
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < threads; ++i)
+      workers.emplace_back(&Pipeline::Work, this);
+    std::thread writer(&Pipeline::Write, this);
+
+    try {
+      produce();
+    } catch (...) {
+      Fail(std::current_exception());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    NotifyAll();
+
+    for (auto& worker : workers)
+      worker.join();
+    writer.join();
+    if (error_)
+      std::rethrow_exception(error_);
+
+    out_ << format_.Footer();
+    out_.flush();
+    if (!out_)
+      throw onepass::IoError("Unable to write export.");
+    return exported_;
+  }
+};
+
+} // namespace
+
+namespace onepass {
+
+void JsonLinesFormat::Format(const Entry& entry, std::string& out) const {
+  std::shared_ptr<const Entry::Details> details = entry.details();
+
+  json11::Json::array urls;
+  for (const auto& url : entry.urls()) {
+    urls.push_back(json11::Json::object {
+      { "label", url.first },
+      { "url", url.second }
+    });
+  }
+
+  json11::Json::array sections;
+  for (const auto& section : details->sections()) {
+    json11::Json::array fields;
+    for (const auto& field : section->fields()) {
+      fields.push_back(json11::Json::object {
+        { "name", field->name() },
+        { "title", field->title() },
+        { "kind", field->type() },
+        { "value", field->value().ToString() }
+      });
+    }
+    sections.push_back(json11::Json::object {
+      { "name", section->name() },
+      { "title", section->title() },
+      { "fields", fields }
+    });
+  }
+
+  json11::Json::array history;
+  for (const auto& password : details->password_history()) {
+    history.push_back(json11::Json::object {
+      { "value", password->value() },
+      { "time", static_cast<double>(password->time()) }
+    });
+  }
+
+  json11::Json json = json11::Json::object {
+    { "uuid", entry.uuid().ToString() },
+    { "category", CategoryCode(entry.category()) },
+    { "title", entry.title() },
+    { "info", entry.info() },
+    { "url", entry.url() },
+    { "urls", urls },
+    { "tags", entry.tags() },
+    { "folder", entry.folder_uuid().IsNil() ?
+          json11::Json() : json11::Json(entry.folder_uuid().ToString()) },
+    { "created", static_cast<double>(entry.creation_time()) },
+    { "updated", static_cast<double>(entry.modification_time()) },
+    { "trashed", entry.trashed() },
+    { "fave", static_cast<double>(entry.fave()) },
+    { "notes", details->notes() },
+    { "username", details->username() },
+    { "password", details->password() },
+    { "totp", details->totp() },
+    { "fields", FieldsJson(details->fields()) },
+    { "sections", sections },
+    { "password_history", history }
+  };
+
+  out.append(json.dump());
+  out.push_back('\n');
+}
+
+std::string CsvFormat::Header() const {
+  return "uuid,category,title,url,username,password,totp,notes,tags,folder,"
+         "created,updated\r\n";
+}
+
+void CsvFormat::Format(const Entry& entry, std::string& out) const {
+  std::shared_ptr<const Entry::Details> details = entry.details();
+
+  const std::string values[] = {
+    entry.uuid().ToString(),
+    CategoryCode(entry.category()),
+    entry.title(),
+    entry.primary_url(),
+    details->username(),
+    details->password(),
+    details->totp(),
+    details->notes(),
+    Join(entry.tags(), ','),
+    entry.folder_uuid().IsNil() ? std::string() :
+                                  entry.folder_uuid().ToString(),
+    FormatTime(entry.creation_time()),
+    FormatTime(entry.modification_time())
+  };
+
+  bool first = true;
+  for (const auto& value : values) {
+    if (!first)
+      out.push_back(',');
+    AppendCsv(out, value);
+    first = false;
+  }
+  out.append("\r\n");
+}
+
+std::string KeePassXmlFormat::Header() const {
+  return "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+         "<KeePassFile><Meta><Generator>libonepass</Generator></Meta>"
+         "<Root><Group><Name>1Password</Name>\n";
+}
+
+void KeePassXmlFormat::Format(const Entry& entry, std::string& out) const {
+  std::shared_ptr<const Entry::Details> details = entry.details();
+  const auto& uuid = entry.uuid().bytes();
+
+  out.append("<Entry><UUID>");
+  out.append(base64_encode(uuid.begin(), uuid.end()));
+  out.append("</UUID>");
+
+  // KeePass requires the keys of an entry to be unique.
+  std::set<std::string> keys = {
+    "Title", "UserName", "Password", "URL", "Notes", "otp"
+  };
+  AppendXmlString(out, "Title", entry.title());
+  AppendXmlString(out, "UserName", details->username());
+  AppendXmlString(out, "Password", details->password(), true);
+  AppendXmlString(out, "URL", entry.primary_url());
+  AppendXmlString(out, "Notes", details->notes());
+  if (!details->totp().empty())
+    AppendXmlString(out, "otp", details->totp(), true);
+
+  for (const auto& section : details->sections()) {
+    for (const auto& field : section->fields()) {
+      std::string value = field->value().ToString();
+      if (value.empty())
+        continue;
+
+      std::string key = field->title().empty() ? field->name() :
+                                                 field->title();
+      std::string unique = key;
+      for (int i = 2; !keys.insert(unique).second; ++i)
+        unique = key + " (" + std::to_string(i) + ")";
+      AppendXmlString(out, unique, value, field->type() == "concealed");
+    }
+  }
+
+  if (!entry.tags().empty()) {
+    out.append("<Tags>");
+    AppendXml(out, Join(entry.tags(), ';'));
+    out.append("</Tags>");
+  }
+
+  out.append("<Times><CreationTime>");
+  out.append(FormatTime(entry.creation_time()));
+  out.append("</CreationTime><LastModificationTime>");
+  out.append(FormatTime(entry.modification_time()));
+  out.append("</LastModificationTime></Times></Entry>\n");
+}
+
+std::string KeePassXmlFormat::Footer() const {
+  return "</Group></Root></KeePassFile>\n";
+}
+
+Exporter::Exporter(const std::shared_ptr<const ExportFormat>& format,
+                   std::size_t threads, std::size_t queue_size) :
+    format_(format), threads_(threads), queue_size_(queue_size) {
+  if (threads_ == 0)
+    threads_ = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+std::size_t Exporter::Export(const std::string& path, Profile& profile,
+                             const LoadOptions& options,
+                             std::ostream& out) const {
+  Pipeline pipeline(*format_, &options, &profile, queue_size_, out);
+  return pipeline.Run(threads_, [&] {
+    Bands::ForEachMember(path + "/default/", [&](const std::string& key,
+                                                 const std::string& value) {
+      Item item;
+      item.key = key;
+      item.json = value;
+      return pipeline.Push(std::move(item));
+    });
+  });
+}
+
+std::size_t Exporter::Export(
+    const std::vector<std::shared_ptr<Entry>>& entries,
+    std::ostream& out) const {
+  Pipeline pipeline(*format_, nullptr, nullptr, queue_size_, out);
+  return pipeline.Run(threads_, [&] {
+    for (const auto& entry : entries) {
+      Item item;
+      item.entry = entry;
+      if (!pipeline.Push(std::move(item)))
+        break;
+    }
+  });
+}
+
+}   // namespace onepass
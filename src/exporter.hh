@@ -0,0 +1,131 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bands.hh"
+
+namespace onepass {
+
+class Profile;
+
+/**
+ * Output format of an export. Entries are formatted concurrently from
+ * several threads, formats must not modify any state while formatting.
+ */
+class ExportFormat {
+ public:
+  virtual ~ExportFormat() = default;
+
+  /**
+   * @return Text written before the first entry.
+   */
+  virtual std::string Header() const { return std::string(); }
+  /**
+   * Formats an entry, decrypting its details as needed.
+   * @param [in] entry Entry to format.
+   * @param [out] out String to append the formatted entry to.
+   */
+  virtual void Format(const Entry& entry, std::string& out) const = 0;
+  /**
+   * @return Text written after the last entry.
+   */
+  virtual std::string Footer() const { return std::string(); }
+};
+
+/**
+ * One JSON object per line with all attributes, fields and sections.
+ */
+class JsonLinesFormat final : public ExportFormat {
+ public:
+  void Format(const Entry& entry, std::string& out) const override;
+};
+
+/**
+ * Comma separated values as described in RFC 4180, one row per entry with
+ * the common attributes and the designated fields.
+ */
+class CsvFormat final : public ExportFormat {
+ public:
+  std::string Header() const override;
+  void Format(const Entry& entry, std::string& out) const override;
+};
+
+/**
+ * KeePass 2 XML, with all entries in a single group. Section fields are
+ * exported as additional strings.
+ */
+class KeePassXmlFormat final : public ExportFormat {
+ public:
+  std::string Header() const override;
+  void Format(const Entry& entry, std::string& out) const override;
+  std::string Footer() const override;
+};
+
+/**
+ * Exports entries using a pipeline. The calling thread reads the input,
+ * worker threads decrypt and format entries and a writer thread writes the
+ * formatted entries in input order. The queues between the stages are
+ * bounded, so memory use does not grow with the number of entries.
+ */
+class Exporter final {
+ private:
+  std::shared_ptr<const ExportFormat> format_;
+  std::size_t threads_;
+  std::size_t queue_size_;
+
+ public:
+  /**
+   * @param [in] format Output format.
+   * @param [in] threads Number of worker threads, zero for one per core.
+   * @param [in] queue_size Maximum number of entries waiting to be
+   *                        formatted, and formatted entries waiting to be
+   *                        written.
+   */
+  explicit Exporter(const std::shared_ptr<const ExportFormat>& format,
+                    std::size_t threads = 0, std::size_t queue_size = 256);
+
+  /**
+   * Exports the entries of a vault without loading it, parsing and
+   * decrypting each entry on a worker thread.
+   * @param [in] path Path to the vault.
+   * @param [in] profile Unlocked profile of the vault.
+   * @param [in] options Filters for the entries to export.
+   * @param [in] out Stream to write to.
+   * @return Number of exported entries.
+   * @throw IoError If writing fails.
+   */
+  std::size_t Export(const std::string& path, Profile& profile,
+                     const LoadOptions& options, std::ostream& out) const;
+
+  /**
+   * Exports loaded entries, decrypting the details on worker threads.
+   * @param [in] entries Entries to export.
+   * @param [in] out Stream to write to.
+   * @return Number of exported entries.
+   * @throw IoError If writing fails.
+   */
+  std::size_t Export(const std::vector<std::shared_ptr<Entry>>& entries,
+                     std::ostream& out) const;
+};
+
+}   // namespace onepass
@@ -0,0 +1,92 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fingerprint.hh"
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <iterator>
+
+#include "exception.hh"
+
+namespace {
+
+/**
+ * 64-bit FNV-1a hash.
+ */
+uint64_t Hash(const std::string& data) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+namespace onepass {
+
+bool FileFingerprint::Refresh(const std::string& path,
+                              std::string& contents) {
+  std::time_t now = std::time(nullptr);
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    bool changed = exists_;
+    *this = FileFingerprint();
+    checked_time_ = now;
+    return changed;
+  }
+
+  uint64_t size = static_cast<uint64_t>(st.st_size);
+  std::time_t modification_time = st.st_mtime;
+
+  // A file modified in the same second as the last check may have changed
+  // again without affecting its size or timestamp.
+  if (exists_ && size == size_ && modification_time == modification_time_ &&
+      modification_time < checked_time_) {
+    checked_time_ = now;
+    return false;
+  }
+
+  std::ifstream src(path, std::ios::in | std::ios::binary);
+  if (!src.is_open())
+    throw IoError("Unable to open " + path + ".");
+
+  std::string text;
+  std::copy(std::istreambuf_iterator<char>(src),
+            std::istreambuf_iterator<char>(),
+            std::back_inserter(text));
+
+  uint64_t hash = Hash(text);
+  bool changed = !exists_ || hash != hash_ || text.size() != size_;
+
+  exists_ = true;
+  size_ = text.size();
+  modification_time_ = modification_time;
+  hash_ = hash;
+  checked_time_ = now;
+
+  if (changed)
+    contents.swap(text);
+  return changed;
+}
+
+}   // namespace onepass
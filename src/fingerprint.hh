@@ -0,0 +1,78 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace onepass {
+
+/**
+ * Identifies the version of a file on disk by its size, modification time
+ * and a hash of its contents. The contents are only read and hashed when
+ * the size or modification time changed, or when the file was modified so
+ * recently that a second change within the same timestamp granularity can
+ * not be ruled out.
+ */
+class FileFingerprint final {
+ private:
+  bool exists_ = false;
+  uint64_t size_ = 0;
+  std::time_t modification_time_ = 0;
+  uint64_t hash_ = 0;
+  std::time_t checked_time_ = 0;
+
+ public:
+  FileFingerprint() = default;
+  /**
+   * Recreates a fingerprint from its parts, as saved by a previous process.
+   */
+  FileFingerprint(bool exists, uint64_t size, std::time_t modification_time,
+                  uint64_t hash, std::time_t checked_time) :
+      exists_(exists), size_(size), modification_time_(modification_time),
+      hash_(hash), checked_time_(checked_time) {}
+
+  /**
+   * Checks a file against the fingerprint and updates the fingerprint.
+   * @param [in] path Path to the file.
+   * @param [out] contents The file contents if the file changed, the
+   *                       contents are not read otherwise.
+   * @return true if the file changed, was created or was removed since the
+   *         last check.
+   * @throw IoError If the file exists but can not be read.
+   */
+  bool Refresh(const std::string& path, std::string& contents);
+
+  bool exists() const { return exists_; }
+  uint64_t size() const { return size_; }
+  std::time_t modification_time() const { return modification_time_; }
+  uint64_t hash() const { return hash_; }
+  std::time_t checked_time() const { return checked_time_; }
+
+  bool operator==(const FileFingerprint& other) const {
+    return exists_ == other.exists_ && size_ == other.size_ &&
+        modification_time_ == other.modification_time_ &&
+        hash_ == other.hash_;
+  }
+  bool operator!=(const FileFingerprint& other) const {
+    return !(*this == other);
+  }
+};
+
+}   // namespace onepass
@@ -27,10 +27,11 @@
 #include "opdata.hh"
 #include "profile.hh"
 #include "util.hh"
+#include "uuid.hh"
 
 namespace onepass {
 
-Folder::Folder(const std::array<uint8_t, 16>& uuid,
+Folder::Folder(const Uuid& uuid,
                const json11::Json& json,
                Profile& profile) :
     uuid_(uuid) {
@@ -52,8 +53,7 @@ Folder::Folder(const std::array<uint8_t, 16>& uuid,
       modification_time_ = static_cast<std::time_t>(obj.second.number_value());
     } else if (obj.first == "uuid") {
       assert(obj.second.is_string());
-      std::array<uint8_t, 16> uuid = ParseUuid(obj.second.string_value());
-      if (uuid_ != uuid) {
+      if (uuid_ != ParseUuid(obj.second.string_value())) {
         assert(false);
         throw FormatError(
             "Folder internal and external UUIDs does not match.");
@@ -114,12 +114,27 @@ void Folders::Load(const std::string& path, Profile& profile) {
             std::istreambuf_iterator<char>(), 
             std::back_inserter(text));
 
+  Parse(ExtractJson(text), profile);
+}
+
+void Folders::Parse(const std::string& json, Profile& profile) {
   std::string err;
-  json11::Json json = json11::Json::parse(ExtractJson(text), err);
+  json_ = json11::Json::parse(json, err);
   if (!err.empty())
     throw FormatError("Unable to parse JSON data in profile.");
 
-  for (const auto& obj : json.object_items()) {
+  Unlock(profile);
+}
+
+void Folders::Lock() {
+  folders_.clear();
+}
+
+void Folders::Unlock(Profile& profile) {
+  assert(!profile.IsLocked());
+
+  folders_.clear();
+  for (const auto& obj : json_.object_items()) {
     assert(obj.second.is_object());
     folders_.push_back(
         std::make_shared<Folder>(ParseUuid(obj.first),
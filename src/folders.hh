@@ -23,9 +23,8 @@
 #include <string>
 #include <vector>
 
-namespace json11 {
-  class Json;
-} // namespace json11
+#include "json11.hh"
+#include "uuid.hh"
 
 namespace onepass {
 
@@ -33,7 +32,7 @@ class Profile;
 
 class Folder final {
  private:
-  std::array<uint8_t, 16> uuid_ = { { 0 } };
+  Uuid uuid_;
   std::time_t creation_time_ = 0;
   std::time_t modification_time_ = 0;
   std::time_t transaction_time_ = 0;
@@ -43,27 +42,49 @@ class Folder final {
   void UpdateFromOverview(const std::string& overview);
 
  public:
-  Folder(const std::array<uint8_t, 16>& uuid,
+  Folder(const Uuid& uuid,
          const json11::Json& json,
          Profile& profile);
 
-  const std::array<uint8_t, 16>& uuid() const { return uuid_; }
+  const Uuid& uuid() const { return uuid_; }
   std::time_t creation_time() const { return creation_time_; }
   void set_creation_time(std::time_t time) { creation_time_ = time; }
   std::time_t modification_time() const { return modification_time_; }
   void set_modification_time(std::time_t time) { modification_time_ = time; }
   std::time_t transaction_time() const { return transaction_time_; }
   void set_transaction_time(std::time_t time) { transaction_time_ = time; }
+  const std::string& title() const { return title_; }
   bool smart() const { return smart_; }
   void set_smart(bool smart) { smart_ = smart; }
 };
 
 class Folders final {
  private:
+  // The encrypted folders as parsed from disk, kept for unlocking.
+  json11::Json json_;
   std::vector<std::shared_ptr<Folder>> folders_;
 
  public:
   void Load(const std::string& path, Profile& profile);
+  /**
+   * Loads the folders from the JSON content of a folders file.
+   * @throw FormatError If @a json can not be parsed.
+   */
+  void Parse(const std::string& json, Profile& profile);
+  /**
+   * @return The encrypted folders as JSON, as accepted by Parse.
+   */
+  std::string ToJson() const { return json_.dump(); }
+
+  /**
+   * Drops the decrypted folders, keeping the parsed encrypted folders.
+   */
+  void Lock();
+  /**
+   * Decrypts the folders kept when locking, without reading the file again.
+   * @param [in] profile Unlocked profile.
+   */
+  void Unlock(Profile& profile);
 
   const std::vector<std::shared_ptr<Folder>>& folders() const {
     return folders_;
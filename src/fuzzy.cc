@@ -0,0 +1,301 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fuzzy.hh"
+
+#include <algorithm>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "util.hh"
+
+namespace {
+
+const int kScoreMatch = 16;
+const int kScoreGapStart = -3;
+const int kScoreGapExtension = -1;
+const int kBonusBoundary = 8;
+const int kBonusConsecutive = 4;
+const int kBonusFirstCharMultiplier = 2;
+
+// Number of titles per thread when searching in parallel.
+const std::size_t kParallelThreshold = 1 << 15;
+
+/**
+ * Maps a case folded character to its bit in the character mask of a title.
+ * Letters have one bit each, digits share five bits and all non-ASCII bytes
+ * share one bit. Other characters are not represented.
+ */
+inline uint32_t CharMask(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return 1u << (c - 'a');
+  if (c >= '0' && c <= '9')
+    return 1u << (26 + (c - '0') % 5);
+  if (c & 0x80)
+    return 1u << 31;
+  return 0;
+}
+
+inline bool IsWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+      (static_cast<unsigned char>(c) & 0x80);
+}
+
+inline const char* FindChar(const char* first, const char* last, char c) {
+#if defined(__SSE2__)
+  const __m128i needle = _mm_set1_epi8(c);
+  for (; last - first >= 16; first += 16) {
+    int found = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(first)), needle));
+    if (found != 0)
+      return first + __builtin_ctz(found);
+  }
+#endif
+  for (; first != last; ++first) {
+    if (*first == c)
+      return first;
+  }
+  return last;
+}
+
+/**
+ * Finds the shortest window of a title containing the query as a
+ * subsequence, ending at the leftmost possible position.
+ * @return true if the title contains the query, false otherwise.
+ */
+bool MatchWindow(const char* title, std::size_t size,
+                 const std::string& query,
+                 std::size_t& start, std::size_t& end) {
+  const char* pos = title;
+  const char* last = title + size;
+  for (char c : query) {
+    pos = FindChar(pos, last, c);
+    if (pos == last)
+      return false;
+    ++pos;
+  }
+  end = pos - title;
+
+  std::size_t i = end;
+  for (std::size_t remaining = query.size(); remaining > 0;) {
+    --i;
+    if (title[i] == query[remaining - 1])
+      --remaining;
+  }
+  start = i;
+  return true;
+}
+
+int ScoreWindow(const char* title, std::size_t start, std::size_t end,
+                const std::string& query, std::vector<uint32_t>* positions) {
+  int score = 0;
+  bool in_gap = false;
+  bool consecutive = false;
+
+  std::size_t q = 0;
+  for (std::size_t i = start; i < end && q < query.size(); ++i) {
+    if (title[i] != query[q]) {
+      score += in_gap ? kScoreGapExtension : kScoreGapStart;
+      in_gap = true;
+      consecutive = false;
+      continue;
+    }
+
+    int bonus = 0;
+    if (i == 0 || !IsWordChar(title[i - 1]))
+      bonus = kBonusBoundary;
+    if (q == 0)
+      bonus *= kBonusFirstCharMultiplier;
+    if (consecutive)
+      bonus = std::max(bonus, kBonusConsecutive);
+
+    score += kScoreMatch + bonus;
+    if (positions)
+      positions->push_back(static_cast<uint32_t>(i));
+
+    ++q;
+    in_gap = false;
+    consecutive = true;
+  }
+
+  return score;
+}
+
+} // namespace
+
+namespace onepass {
+
+void FuzzyIndex::Build(const Bands& bands) {
+  Clear();
+
+  entries_.reserve(bands.entries().size());
+  masks_.reserve(bands.entries().size());
+  offsets_.reserve(bands.entries().size() + 1);
+
+  for (const auto& entry : bands.entries()) {
+    std::string title = FoldCase(entry->title());
+
+    uint32_t mask = 0;
+    for (char c : title)
+      mask |= CharMask(static_cast<unsigned char>(c));
+
+    titles_.append(title);
+    offsets_.push_back(static_cast<uint32_t>(titles_.size()));
+    masks_.push_back(mask);
+    entries_.push_back(entry);
+  }
+}
+
+void FuzzyIndex::Clear() {
+  entries_.clear();
+  titles_.clear();
+  offsets_.assign(1, 0);
+  masks_.clear();
+}
+
+void FuzzyIndex::SearchRange(
+    const std::string& query, uint32_t query_mask,
+    std::size_t first, std::size_t last, std::size_t limit,
+    std::vector<std::pair<int, std::size_t>>& results) const {
+  auto match = [&](std::size_t i) {
+    const char* title = titles_.data() + offsets_[i];
+    std::size_t start = 0, end = 0;
+    if (MatchWindow(title, offsets_[i + 1] - offsets_[i], query, start, end))
+      results.push_back(std::make_pair(
+          ScoreWindow(title, start, end, query, nullptr), i));
+  };
+
+  std::size_t i = first;
+#if defined(__SSE2__)
+  const __m128i needed = _mm_set1_epi32(static_cast<int>(query_mask));
+  for (; i + 4 <= last; i += 4) {
+    __m128i masks = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(masks_.data() + i));
+    int candidates = _mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpeq_epi32(_mm_and_si128(masks, needed), needed)));
+    while (candidates != 0) {
+      match(i + __builtin_ctz(candidates));
+      candidates &= candidates - 1;
+    }
+  }
+#endif
+  for (; i < last; ++i) {
+    if ((masks_[i] & query_mask) == query_mask)
+      match(i);
+  }
+
+  // Keep the best matches only.
+  auto better = [&](const std::pair<int, std::size_t>& a,
+                    const std::pair<int, std::size_t>& b) {
+    if (a.first != b.first)
+      return a.first > b.first;
+    uint32_t a_len = offsets_[a.second + 1] - offsets_[a.second];
+    uint32_t b_len = offsets_[b.second + 1] - offsets_[b.second];
+    if (a_len != b_len)
+      return a_len < b_len;
+    return a.second < b.second;
+  };
+
+  if (results.size() > limit) {
+    std::partial_sort(results.begin(), results.begin() + limit,
+                      results.end(), better);
+    results.resize(limit);
+  } else {
+    std::sort(results.begin(), results.end(), better);
+  }
+}
+
+std::vector<FuzzyIndex::Match> FuzzyIndex::Search(const std::string& query,
+                                                  std::size_t limit) const {
+  std::vector<Match> matches;
+
+  std::string folded;
+  for (char c : FoldCase(query)) {
+    if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+      folded.push_back(c);
+  }
+
+  if (folded.empty() || limit == 0 || entries_.empty())
+    return matches;
+
+  uint32_t query_mask = 0;
+  for (char c : folded)
+    query_mask |= CharMask(static_cast<unsigned char>(c));
+
+  std::size_t threads = std::min<std::size_t>(
+      std::max(1u, std::thread::hardware_concurrency()),
+      (entries_.size() + kParallelThreshold - 1) / kParallelThreshold);
+
+  std::vector<std::pair<int, std::size_t>> results;
+  if (threads <= 1) {
+    SearchRange(folded, query_mask, 0, entries_.size(), limit, results);
+  } else {
+    std::vector<std::vector<std::pair<int, std::size_t>>> partial(threads);
+    std::vector<std::thread> workers;
+
+    std::size_t chunk = (entries_.size() + threads - 1) / threads;
+    for (std::size_t t = 0; t < threads; ++t) {
+      std::size_t first = std::min(entries_.size(), t * chunk);
+      std::size_t last = std::min(entries_.size(), first + chunk);
+      workers.push_back(std::thread([&, t, first, last]() {
+        SearchRange(folded, query_mask, first, last, limit, partial[t]);
+      }));
+    }
+
+    for (auto& worker : workers)
+      worker.join();
+
+    // The partial results are sorted, merging them keeps the order of the
+    // best matches.
+    for (const auto& part : partial) {
+      std::vector<std::pair<int, std::size_t>> merged;
+      merged.reserve(std::min(limit, results.size() + part.size()));
+      std::size_t i = 0, j = 0;
+      while (merged.size() < limit && (i < results.size() ||
+                                       j < part.size())) {
+        bool take_part = i == results.size() ||
+            (j < part.size() && (part[j].first > results[i].first ||
+             (part[j].first == results[i].first &&
+              offsets_[part[j].second + 1] - offsets_[part[j].second] <
+              offsets_[results[i].second + 1] - offsets_[results[i].second])));
+        merged.push_back(take_part ? part[j++] : results[i++]);
+      }
+      results.swap(merged);
+    }
+  }
+
+  matches.reserve(results.size());
+  for (const auto& result : results) {
+    const char* title = titles_.data() + offsets_[result.second];
+    std::size_t start = 0, end = 0;
+    MatchWindow(title, offsets_[result.second + 1] - offsets_[result.second],
+                folded, start, end);
+
+    std::vector<uint32_t> positions;
+    ScoreWindow(title, start, end, folded, &positions);
+    matches.push_back(Match(entries_[result.second], result.first,
+                            positions));
+  }
+
+  return matches;
+}
+
+}   // namespace onepass
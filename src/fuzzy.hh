@@ -0,0 +1,87 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bands.hh"
+
+namespace onepass {
+
+/**
+ * Fuzzy matcher over entry titles, in the style of fzf. A query matches a
+ * title if its characters occur in the title in order. Matches are scored
+ * with bonuses for characters at word boundaries and consecutive characters
+ * and penalties for gaps.
+ *
+ * The case folded titles are packed into a single buffer, together with a
+ * mask per title of the characters it contains. Titles lacking any of the
+ * query characters are rejected four at a time using SSE2 before the
+ * subsequence matching.
+ */
+class FuzzyIndex final {
+ public:
+  class Match final {
+   private:
+    std::shared_ptr<Entry> entry_;
+    int score_;
+    std::vector<uint32_t> positions_;
+
+   public:
+    Match(const std::shared_ptr<Entry>& entry, int score,
+          const std::vector<uint32_t>& positions) :
+        entry_(entry), score_(score), positions_(positions) {}
+
+    std::shared_ptr<Entry> entry() const { return entry_; }
+    int score() const { return score_; }
+    /**
+     * @return Byte offsets of the matched characters in the title.
+     */
+    const std::vector<uint32_t>& positions() const { return positions_; }
+  };
+
+ private:
+  std::vector<std::shared_ptr<Entry>> entries_;
+  std::string titles_;
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> masks_;
+
+  void SearchRange(const std::string& query, uint32_t query_mask,
+                   std::size_t first, std::size_t last, std::size_t limit,
+                   std::vector<std::pair<int, std::size_t>>& results) const;
+
+ public:
+  void Build(const Bands& bands);
+  void Clear();
+
+  /**
+   * Finds the titles best matching a query. Large indexes are searched
+   * using multiple threads.
+   * @param [in] query Query, whitespace is ignored.
+   * @param [in] limit Maximum number of matches to return.
+   * @return The best matches, best first.
+   */
+  std::vector<Match> Search(const std::string& query,
+                            std::size_t limit) const;
+
+  std::size_t size() const { return entries_.size(); }
+};
+
+}   // namespace onepass
@@ -0,0 +1,117 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "index.hh"
+
+#include <algorithm>
+
+namespace {
+
+const onepass::Index::EntryList kEmptyEntryList;
+
+} // namespace
+
+namespace onepass {
+
+void Index::Build(const Folders& folders, const Bands& bands) {
+  Clear();
+
+  entries_.reserve(bands.entries().size());
+  folders_.reserve(folders.folders().size());
+  positions_.reserve(bands.entries().size());
+
+  for (const auto& folder : folders.folders())
+    folders_.insert(std::make_pair(folder->uuid(), folder));
+
+  for (const auto& entry : bands.entries()) {
+    entries_.insert(std::make_pair(entry->uuid(), entry));
+    positions_.insert(std::make_pair(entry.get(), positions_.size()));
+    folder_entries_[entry->folder_uuid()].push_back(entry);
+    category_entries_[entry->category()].push_back(entry);
+
+    for (const auto& tag : entry->tags())
+      tag_entries_[tag].push_back(entry);
+  }
+}
+
+void Index::Clear() {
+  entries_.clear();
+  folders_.clear();
+  folder_entries_.clear();
+  category_entries_.clear();
+  tag_entries_.clear();
+  positions_.clear();
+}
+
+std::shared_ptr<Entry> Index::FindEntry(const Uuid& uuid) const {
+  auto it = entries_.find(uuid);
+  return it != entries_.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<Folder> Index::FindFolder(const Uuid& uuid) const {
+  auto it = folders_.find(uuid);
+  return it != folders_.end() ? it->second : nullptr;
+}
+
+const Index::EntryList& Index::EntriesInFolder(const Uuid& folder_uuid) const {
+  auto it = folder_entries_.find(folder_uuid);
+  return it != folder_entries_.end() ? it->second : kEmptyEntryList;
+}
+
+Index::EntryList Index::EntriesInFolders(
+    const std::vector<Uuid>& folder_uuids) const {
+  EntryList entries;
+  for (const auto& uuid : folder_uuids) {
+    const EntryList& list = EntriesInFolder(uuid);
+    entries.insert(entries.end(), list.begin(), list.end());
+  }
+
+  // Each list is in load order already, restore the order across them.
+  if (folder_uuids.size() > 1)
+    SortInLoadOrder(entries);
+  return entries;
+}
+
+const Index::EntryList& Index::EntriesInCategory(
+    Entry::Category category) const {
+  auto it = category_entries_.find(category);
+  return it != category_entries_.end() ? it->second : kEmptyEntryList;
+}
+
+const Index::EntryList& Index::EntriesWithTag(const std::string& tag) const {
+  auto it = tag_entries_.find(tag);
+  return it != tag_entries_.end() ? it->second : kEmptyEntryList;
+}
+
+void Index::SortInLoadOrder(EntryList& entries) const {
+  std::sort(entries.begin(), entries.end(),
+            [this](const std::shared_ptr<Entry>& lhs,
+                   const std::shared_ptr<Entry>& rhs) {
+    return positions_.at(lhs.get()) < positions_.at(rhs.get());
+  });
+}
+
+std::map<std::string, std::size_t> Index::Tags() const {
+  std::map<std::string, std::size_t> tags;
+  for (const auto& tag : tag_entries_)
+    tags.insert(std::make_pair(tag.first, tag.second.size()));
+
+  return tags;
+}
+
+}   // namespace onepass
@@ -0,0 +1,92 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bands.hh"
+#include "folders.hh"
+#include "uuid.hh"
+
+namespace onepass {
+
+/**
+ * Lookup structures over the entries and folders of a database. The primary
+ * index maps UUIDs to entries and folders, the secondary indexes map folders,
+ * categories and tags to the entries carrying them, in load order.
+ */
+class Index final {
+ public:
+  typedef std::vector<std::shared_ptr<Entry>> EntryList;
+
+ private:
+  std::unordered_map<Uuid, std::shared_ptr<Entry>> entries_;
+  std::unordered_map<Uuid, std::shared_ptr<Folder>> folders_;
+  std::unordered_map<Uuid, EntryList> folder_entries_;
+  std::map<Entry::Category, EntryList> category_entries_;
+  std::unordered_map<std::string, EntryList> tag_entries_;
+  // Position of each entry in load order.
+  std::unordered_map<const Entry*, std::size_t> positions_;
+
+ public:
+  void Build(const Folders& folders, const Bands& bands);
+  void Clear();
+
+  /**
+   * @return The entry with the UUID @a uuid or nullptr if there is no such
+   *         entry.
+   */
+  std::shared_ptr<Entry> FindEntry(const Uuid& uuid) const;
+  /**
+   * @return The folder with the UUID @a uuid or nullptr if there is no such
+   *         folder.
+   */
+  std::shared_ptr<Folder> FindFolder(const Uuid& uuid) const;
+
+  /**
+   * @param [in] folder_uuid Folder UUID, the nil UUID selects the entries not
+   *                         belonging to any folder.
+   * @return The entries in the folder.
+   */
+  const EntryList& EntriesInFolder(const Uuid& folder_uuid) const;
+  /**
+   * @param [in] folder_uuids Folder UUIDs, see EntriesInFolder.
+   * @return The entries in any of the folders, in load order.
+   */
+  EntryList EntriesInFolders(const std::vector<Uuid>& folder_uuids) const;
+  const EntryList& EntriesInCategory(Entry::Category category) const;
+  const EntryList& EntriesWithTag(const std::string& tag) const;
+
+  /**
+   * Sorts entries from other sources, such as ranked search results, into
+   * load order.
+   * @param [in,out] entries Entries of the indexed bands.
+   */
+  void SortInLoadOrder(EntryList& entries) const;
+
+  /**
+   * @return All tags in use along with the number of entries carrying them.
+   */
+  std::map<std::string, std::size_t> Tags() const;
+};
+
+}   // namespace onepass
@@ -30,6 +30,7 @@
 #include "key.hh"
 #include "opdata.hh"
 #include "util.hh"
+#include "uuid.hh"
 
 namespace {
 
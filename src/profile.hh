@@ -22,11 +22,13 @@
 #include <string>
 #include <vector>
 
+#include "uuid.hh"
+
 namespace onepass {
 
 class Profile final {
  private:
-  std::array<uint8_t, 16> uuid_ = { { 0 } };
+  Uuid uuid_;
   std::time_t creation_time_ = 0;
   std::time_t modification_time_ = 0;
   std::string name_;
@@ -48,6 +50,8 @@ class Profile final {
   void Unlock(const std::string& password);
   void Lock();
 
+  const Uuid& uuid() const { return uuid_; }
+
   const std::array<uint8_t, 32> &master_key() const { return master_key_; }
   const std::array<uint8_t, 32> &master_mac_key() const {
     return master_mac_key_;
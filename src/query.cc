@@ -0,0 +1,713 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "query.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <unordered_set>
+
+#include "exception.hh"
+#include "url.hh"
+#include "util.hh"
+
+namespace onepass {
+
+class Query::Node final {
+ public:
+  enum class Type {
+    kAnd,
+    kOr,
+    kNot,
+    kTerm
+  };
+
+  Type type = Type::kTerm;
+  std::vector<std::shared_ptr<const Node>> children;
+  std::string key;  ///< Empty for text terms.
+  std::string op;
+  std::string value;
+};
+
+namespace {
+
+typedef std::shared_ptr<const Query::Node> NodePtr;
+
+const std::time_t kSecondsPerDay = 24 * 60 * 60;
+
+const std::map<std::string, Entry::Category> kCategoryNames = {
+  { "unknown", Entry::Category::kUnknown },
+  { "login", Entry::Category::kLogin },
+  { "creditcard", Entry::Category::kCreditCard },
+  { "note", Entry::Category::kSecureNote },
+  { "identity", Entry::Category::kIdentity },
+  { "password", Entry::Category::kPassword },
+  { "tombstone", Entry::Category::kTombstone },
+  { "software", Entry::Category::kSoftwareLicense },
+  { "bankaccount", Entry::Category::kBankAccount },
+  { "database", Entry::Category::kDatabase },
+  { "driverlicense", Entry::Category::kDriverLicense },
+  { "outdoorlicense", Entry::Category::kOutdoorLicense },
+  { "membership", Entry::Category::kMembership },
+  { "passport", Entry::Category::kPassport },
+  { "rewards", Entry::Category::kRewards },
+  { "ssn", Entry::Category::kSocialSecurityNumber },
+  { "router", Entry::Category::kRouter },
+  { "server", Entry::Category::kServer },
+  { "email", Entry::Category::kEmail }
+};
+
+class Token final {
+ public:
+  enum class Type {
+    kWord,
+    kOpen,
+    kClose,
+    kNot
+  };
+
+  Type type = Type::kWord;
+  std::string key;
+  std::string op;
+  std::string value;
+  bool quoted = false;
+
+  bool IsKeyword(const char* keyword) const {
+    return type == Type::kWord && !quoted && key.empty() && value == keyword;
+  }
+};
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline bool IsKeyChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+      (c >= '0' && c <= '9') || c == '_';
+}
+
+std::vector<Token> Tokenize(const std::string& text) {
+  std::vector<Token> tokens;
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    char c = text[pos];
+    if (IsSpace(c)) {
+      ++pos;
+      continue;
+    }
+
+    Token token;
+    if (c == '(' || c == ')') {
+      token.type = c == '(' ? Token::Type::kOpen : Token::Type::kClose;
+      tokens.push_back(token);
+      ++pos;
+      continue;
+    }
+    if (c == '-' && pos + 1 < text.size() && !IsSpace(text[pos + 1])) {
+      token.type = Token::Type::kNot;
+      tokens.push_back(token);
+      ++pos;
+      continue;
+    }
+
+    // A word, split into key, operator and value at the first operator
+    // following a key.
+    bool in_quotes = false;
+    while (pos < text.size()) {
+      c = text[pos];
+      if (c == '"') {
+        in_quotes = !in_quotes;
+        token.quoted = true;
+        ++pos;
+        continue;
+      }
+      if (!in_quotes && (IsSpace(c) || c == '(' || c == ')'))
+        break;
+
+      if (!in_quotes && !token.quoted && token.key.empty() &&
+          !token.value.empty() && (c == ':' || c == '<' || c == '>') &&
+          std::all_of(token.value.begin(), token.value.end(), IsKeyChar)) {
+        token.key = FoldCase(token.value);
+        token.value.clear();
+        token.op.push_back(c);
+        if (c != ':' && pos + 1 < text.size() && text[pos + 1] == '=')
+          token.op.push_back(text[++pos]);
+        ++pos;
+        continue;
+      }
+
+      token.value.push_back(c);
+      ++pos;
+    }
+
+    if (in_quotes)
+      throw FormatError("Unterminated quote in query.");
+    tokens.push_back(token);
+  }
+  return tokens;
+}
+
+class Parser final {
+ private:
+  std::vector<Token> tokens_;
+  std::size_t pos_ = 0;
+
+  bool AtEnd() const {
+    return pos_ >= tokens_.size();
+  }
+
+  static NodePtr Combine(Query::Node::Type type,
+                         std::vector<NodePtr> children) {
+    if (children.size() == 1)
+      return children.front();
+    auto node = std::make_shared<Query::Node>();
+    node->type = type;
+    node->children = std::move(children);
+    return node;
+  }
+
+  NodePtr ParseUnary() {
+    if (AtEnd())
+      throw FormatError("Unexpected end of query.");
+
+    const Token& token = tokens_[pos_++];
+    if (token.type == Token::Type::kNot || token.IsKeyword("not")) {
+      auto node = std::make_shared<Query::Node>();
+      node->type = Query::Node::Type::kNot;
+      node->children.push_back(ParseUnary());
+      return node;
+    }
+    if (token.type == Token::Type::kOpen) {
+      NodePtr node = ParseOr();
+      if (AtEnd() || tokens_[pos_].type != Token::Type::kClose)
+        throw FormatError("Missing closing parenthesis in query.");
+      ++pos_;
+      return node;
+    }
+    if (token.type == Token::Type::kClose)
+      throw FormatError("Unexpected closing parenthesis in query.");
+
+    if (!token.key.empty() && token.value.empty())
+      throw FormatError("Missing value for \"" + token.key + "\" in query.");
+
+    auto node = std::make_shared<Query::Node>();
+    node->key = token.key;
+    node->op = token.op;
+    node->value = token.value;
+    return node;
+  }
+
+  NodePtr ParseAnd() {
+    std::vector<NodePtr> children;
+    while (!AtEnd() && tokens_[pos_].type != Token::Type::kClose &&
+           !tokens_[pos_].IsKeyword("or")) {
+      if (tokens_[pos_].IsKeyword("and")) {
+        ++pos_;
+        continue;
+      }
+      children.push_back(ParseUnary());
+    }
+    if (children.empty())
+      throw FormatError("Expected a term in query.");
+    return Combine(Query::Node::Type::kAnd, std::move(children));
+  }
+
+ public:
+  explicit Parser(const std::string& text) : tokens_(Tokenize(text)) {}
+
+  NodePtr ParseOr() {
+    std::vector<NodePtr> children;
+    children.push_back(ParseAnd());
+    while (!AtEnd() && tokens_[pos_].IsKeyword("or")) {
+      ++pos_;
+      children.push_back(ParseAnd());
+    }
+    return Combine(Query::Node::Type::kOr, std::move(children));
+  }
+
+  NodePtr Parse() {
+    if (tokens_.empty())
+      throw FormatError("Empty query.");
+    NodePtr root = ParseOr();
+    if (!AtEnd())
+      throw FormatError("Unexpected closing parenthesis in query.");
+    return root;
+  }
+};
+
+std::string NodeToString(const Query::Node& node) {
+  switch (node.type) {
+    case Query::Node::Type::kAnd:
+    case Query::Node::Type::kOr: {
+      std::string str = "(";
+      for (std::size_t i = 0; i < node.children.size(); ++i) {
+        if (i > 0)
+          str += node.type == Query::Node::Type::kAnd ? " and " : " or ";
+        str += NodeToString(*node.children[i]);
+      }
+      return str + ")";
+    }
+    case Query::Node::Type::kNot:
+      return "not " + NodeToString(*node.children.front());
+    case Query::Node::Type::kTerm:
+      break;
+  }
+
+  std::string value = node.value;
+  if (value.find_first_of(" \t()") != std::string::npos)
+    value = "\"" + value + "\"";
+  return node.key + node.op + value;
+}
+
+/**
+ * Days since 1970-01-01 of a date in the proleptic Gregorian calendar.
+ */
+std::time_t DaysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const int year_of_era = year - era * 400;
+  const int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 +
+      day - 1;
+  const int day_of_era = year_of_era * 365 + year_of_era / 4 -
+      year_of_era / 100 + day_of_year;
+  return static_cast<std::time_t>(era) * 146097 + day_of_era - 719468;
+}
+
+/**
+ * Parses a non-negative decimal number.
+ * @param [in] max Largest accepted number.
+ * @param [out] number The parsed number.
+ * @return true if @a value is a number no larger than @a max, false
+ *         otherwise.
+ */
+bool ParseNumber(const std::string& value, long long max, long long& number) {
+  if (value.empty() || value.find_first_not_of("0123456789") !=
+                       std::string::npos) {
+    return false;
+  }
+
+  errno = 0;
+  number = std::strtoll(value.c_str(), nullptr, 10);
+  return errno != ERANGE && number <= max;
+}
+
+/**
+ * Parses a time given as seconds since the epoch or as a YYYY-MM-DD date.
+ * @param [out] length Length of the time span denoted, one day for dates.
+ */
+std::time_t ParseTime(const std::string& value, std::time_t& length) {
+  if (!value.empty() &&
+      value.find_first_not_of("0123456789") == std::string::npos) {
+    // Leave room for the end of the time span.
+    long long seconds = 0;
+    if (!ParseNumber(value, std::numeric_limits<std::time_t>::max() -
+                            kSecondsPerDay, seconds)) {
+      throw FormatError("Invalid time \"" + value + "\" in query.");
+    }
+    length = 1;
+    return static_cast<std::time_t>(seconds);
+  }
+
+  int year = 0, month = 0, day = 0;
+  char dash1 = 0, dash2 = 0;
+  std::istringstream stream(value);
+  stream >> year >> dash1 >> month >> dash2 >> day;
+  if (stream.fail() || !stream.eof() || dash1 != '-' || dash2 != '-' ||
+      month < 1 || month > 12 || day < 1 || day > 31) {
+    throw FormatError("Invalid time \"" + value + "\" in query.");
+  }
+
+  length = kSecondsPerDay;
+  return DaysFromCivil(year, month, day) * kSecondsPerDay;
+}
+
+bool ParseBool(const Query::Node& term) {
+  std::string value = FoldCase(term.value);
+  if (value == "yes" || value == "true")
+    return true;
+  if (value == "no" || value == "false")
+    return false;
+  throw FormatError("Invalid value \"" + term.value + "\" for \"" +
+                    term.key + "\" in query.");
+}
+
+class Compiler final {
+ private:
+  const Bands& bands_;
+  const Folders& folders_;
+  const Index& index_;
+  const UrlIndex& url_index_;
+  const TextIndex& text_index_;
+
+  // Results of text searches, shared between the lookup and the predicate.
+  std::map<const Query::Node*,
+           std::shared_ptr<const Index::EntryList>> text_results_;
+
+  std::shared_ptr<const Index::EntryList> TextResult(
+      const Query::Node& term) {
+    auto it = text_results_.find(&term);
+    if (it != text_results_.end())
+      return it->second;
+
+    auto entries = std::make_shared<Index::EntryList>();
+    for (const auto& hit : text_index_.Search(term.value))
+      entries->push_back(hit.entry());
+    text_results_[&term] = entries;
+    return entries;
+  }
+
+  Entry::Category ParseCategory(const Query::Node& term) const {
+    auto it = kCategoryNames.find(FoldCase(term.value));
+    if (it != kCategoryNames.end())
+      return it->second;
+
+    long long number = 0;
+    if (ParseNumber(term.value, std::numeric_limits<int>::max(), number)) {
+      for (const auto& name : kCategoryNames) {
+        if (static_cast<int>(name.second) == number)
+          return name.second;
+      }
+    }
+    throw FormatError("Unknown category \"" + term.value + "\" in query.");
+  }
+
+  /**
+   * Resolves a folder given either by UUID or by title.
+   */
+  std::vector<Uuid> ParseFolder(const Query::Node& term) const {
+    std::vector<Uuid> uuids;
+    if (term.value.size() == 32 &&
+        term.value.find_first_not_of("0123456789abcdefABCDEF") ==
+            std::string::npos) {
+      uuids.push_back(ParseUuid(term.value));
+      return uuids;
+    }
+
+    std::string title = FoldCase(term.value);
+    for (const auto& folder : folders_.folders()) {
+      if (FoldCase(folder->title()) == title)
+        uuids.push_back(folder->uuid());
+    }
+    return uuids;
+  }
+
+  Predicate CompileTime(const Query::Node& term,
+                        std::time_t (Entry::*getter)() const) const {
+    std::time_t length = 0;
+    std::time_t time = ParseTime(term.value, length);
+    std::time_t first = std::numeric_limits<std::time_t>::min();
+    std::time_t last = std::numeric_limits<std::time_t>::max();
+    if (term.op == ":") {
+      first = time;
+      last = time + length;
+    } else if (term.op == "<") {
+      last = time;
+    } else if (term.op == "<=") {
+      last = time + length;
+    } else if (term.op == ">") {
+      first = time + length;
+    } else if (term.op == ">=") {
+      first = time;
+    } else {
+      assert(false);
+    }
+
+    return Predicate(Predicate::Cost::kMetadata,
+                     [getter, first, last](const Entry& entry) {
+      std::time_t value = (entry.*getter)();
+      return value >= first && value < last;
+    });
+  }
+
+  Predicate CompileTerm(const Query::Node& term) {
+    if (term.key.empty()) {
+      std::shared_ptr<const Index::EntryList> list = TextResult(term);
+      auto entries = std::make_shared<std::unordered_set<const Entry*>>();
+      for (const auto& entry : *list)
+        entries->insert(entry.get());
+      return Predicate(Predicate::Cost::kMetadata,
+                       [entries](const Entry& entry) {
+        return entries->count(&entry) > 0;
+      });
+    }
+
+    if (term.key != "created" && term.key != "updated" && term.key != "tx" &&
+        term.op != ":") {
+      throw FormatError("Invalid operator \"" + term.op + "\" for \"" +
+                        term.key + "\" in query.");
+    }
+
+    if (term.key == "category") {
+      return Predicate::InCategory(ParseCategory(term));
+    } else if (term.key == "folder") {
+      std::vector<Uuid> uuids = ParseFolder(term);
+      return Predicate(Predicate::Cost::kMetadata,
+                       [uuids](const Entry& entry) {
+        return std::find(uuids.begin(), uuids.end(), entry.folder_uuid()) !=
+            uuids.end();
+      });
+    } else if (term.key == "tag") {
+      return Predicate::HasTag(term.value);
+    } else if (term.key == "uuid") {
+      Uuid uuid = ParseUuid(term.value);
+      return Predicate(Predicate::Cost::kMetadata,
+                       [uuid](const Entry& entry) {
+        return entry.uuid() == uuid;
+      });
+    } else if (term.key == "trashed") {
+      return Predicate::Trashed(ParseBool(term));
+    } else if (term.key == "fave") {
+      bool fave = ParseBool(term);
+      return Predicate(Predicate::Cost::kMetadata,
+                       [fave](const Entry& entry) {
+        return (entry.fave() != 0) == fave;
+      });
+    } else if (term.key == "created") {
+      return CompileTime(term, &Entry::creation_time);
+    } else if (term.key == "updated") {
+      return CompileTime(term, &Entry::modification_time);
+    } else if (term.key == "tx") {
+      return CompileTime(term, &Entry::transaction_time);
+    } else if (term.key == "url") {
+      // Patterns with a path are matched against the whole URL, otherwise
+      // against the host.
+      std::string pattern = FoldCase(term.value);
+      bool whole = pattern.find('/') != std::string::npos;
+      return Predicate(Predicate::Cost::kOverview,
+                       [pattern, whole](const Entry& entry) {
+        // URLs without a host are not in the URL index, nor matched here.
+        auto matches = [&](const std::string& url) {
+          if (url.empty())
+            return false;
+          if (whole)
+            return GlobMatch(pattern, FoldCase(url));
+          Url parsed(url);
+          return !parsed.empty() && GlobMatch(pattern, parsed.host());
+        };
+        if (matches(entry.url()))
+          return true;
+        for (const auto& url : entry.urls()) {
+          if (matches(url.second))
+            return true;
+        }
+        return false;
+      });
+    } else if (term.key == "title") {
+      std::string text = FoldCase(term.value);
+      return Predicate(Predicate::Cost::kOverview,
+                       [text](const Entry& entry) {
+        return FoldCase(entry.title()).find(text) != std::string::npos;
+      });
+    } else if (term.key == "has") {
+      std::string field = FoldCase(term.value);
+      if (field == "password") {
+        return Predicate(Predicate::Cost::kDetails, [](const Entry& entry) {
+          return !entry.details()->password().empty();
+        });
+      } else if (field == "username") {
+        return Predicate(Predicate::Cost::kDetails, [](const Entry& entry) {
+          return !entry.details()->username().empty();
+        });
+      } else if (field == "totp") {
+        return Predicate(Predicate::Cost::kDetails, [](const Entry& entry) {
+          return !entry.details()->totp().empty();
+        });
+      } else if (field == "notes") {
+        return Predicate(Predicate::Cost::kDetails, [](const Entry& entry) {
+          return !entry.details()->notes().empty();
+        });
+      }
+      throw FormatError("Unknown field \"" + term.value + "\" in query.");
+    }
+
+    throw FormatError("Unknown term \"" + term.key + "\" in query.");
+  }
+
+ public:
+  Compiler(const Bands& bands,
+           const Folders& folders,
+           const Index& index,
+           const UrlIndex& url_index,
+           const TextIndex& text_index) :
+      bands_(bands), folders_(folders), index_(index), url_index_(url_index),
+      text_index_(text_index) {}
+
+  Predicate Compile(const Query::Node& node) {
+    switch (node.type) {
+      case Query::Node::Type::kAnd:
+      case Query::Node::Type::kOr: {
+        Predicate predicate = Compile(*node.children.front());
+        for (std::size_t i = 1; i < node.children.size(); ++i) {
+          Predicate child = Compile(*node.children[i]);
+          predicate = node.type == Query::Node::Type::kAnd ?
+              predicate && child : predicate || child;
+        }
+        return predicate;
+      }
+      case Query::Node::Type::kNot:
+        return !Compile(*node.children.front());
+      case Query::Node::Type::kTerm:
+        break;
+    }
+    return CompileTerm(node);
+  }
+
+  /**
+   * Looks up the entries matching a term in an index.
+   * @param [out] entries Matching entries.
+   * @param [out] description Description of the lookup.
+   * @return true if the term can be answered by an index.
+   */
+  bool Lookup(const Query::Node& term, Index::EntryList& entries,
+              std::string& description) {
+    if (term.type != Query::Node::Type::kTerm)
+      return false;
+
+    if (term.key.empty()) {
+      // The text index ranks its hits, restore the load order.
+      entries = *TextResult(term);
+      index_.SortInLoadOrder(entries);
+      description = "text index \"" + term.value + "\"";
+    } else if (term.key == "category" && term.op == ":") {
+      entries = index_.EntriesInCategory(ParseCategory(term));
+      description = "category index " + term.value;
+    } else if (term.key == "folder" && term.op == ":") {
+      entries = index_.EntriesInFolders(ParseFolder(term));
+      description = "folder index " + term.value;
+    } else if (term.key == "tag" && term.op == ":") {
+      entries = index_.EntriesWithTag(term.value);
+      description = "tag index " + term.value;
+    } else if (term.key == "url" && term.op == ":" &&
+               term.value.find('/') == std::string::npos) {
+      entries = url_index_.FindHosts(FoldCase(term.value));
+      description = "url index " + term.value;
+    } else if (term.key == "uuid" && term.op == ":") {
+      entries.clear();
+      std::shared_ptr<Entry> entry = index_.FindEntry(ParseUuid(term.value));
+      if (entry)
+        entries.push_back(entry);
+      description = "uuid index " + term.value;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  const Index::EntryList& AllEntries() const {
+    return bands_.entries();
+  }
+};
+
+const char* CostName(Predicate::Cost cost) {
+  switch (cost) {
+    case Predicate::Cost::kMetadata:
+      return "metadata";
+    case Predicate::Cost::kOverview:
+      return "overview";
+    case Predicate::Cost::kDetails:
+      return "details";
+  }
+  assert(false);
+  return "";
+}
+
+} // namespace
+
+Query::Query(const std::string& text) : root_(Parser(text).Parse()) {}
+
+std::string Query::ToString() const {
+  return NodeToString(*root_);
+}
+
+QueryPlan::QueryPlan(const Query& query,
+                     const Bands& bands,
+                     const Folders& folders,
+                     const Index& index,
+                     const UrlIndex& url_index,
+                     const TextIndex& text_index) {
+  Compiler compiler(bands, folders, index, url_index, text_index);
+
+  std::vector<NodePtr> terms;
+  if (query.root()->type == Query::Node::Type::kAnd)
+    terms = query.root()->children;
+  else
+    terms.push_back(query.root());
+
+  // Read the candidates from the index giving the fewest entries.
+  std::size_t source = terms.size();
+  for (std::size_t i = 0; i < terms.size(); ++i) {
+    Index::EntryList entries;
+    std::string description;
+    if (compiler.Lookup(*terms[i], entries, description) &&
+        (source == terms.size() || entries.size() < candidates_.size())) {
+      source = i;
+      source_ = description;
+      candidates_.swap(entries);
+    }
+  }
+
+  if (source == terms.size()) {
+    source_ = "all entries";
+    candidates_ = compiler.AllEntries();
+  }
+
+  for (std::size_t i = 0; i < terms.size(); ++i) {
+    if (i != source) {
+      filters_.push_back(Filter(NodeToString(*terms[i]),
+                                compiler.Compile(*terms[i])));
+    }
+  }
+
+  std::stable_sort(filters_.begin(), filters_.end(),
+                   [](const Filter& lhs, const Filter& rhs) {
+    return lhs.predicate.cost() < rhs.predicate.cost();
+  });
+}
+
+Index::EntryList QueryPlan::Execute() const {
+  Index::EntryList entries;
+  for (const auto& entry : candidates_) {
+    bool match = true;
+    for (const auto& filter : filters_) {
+      if (!filter.predicate(*entry)) {
+        match = false;
+        break;
+      }
+    }
+    if (match)
+      entries.push_back(entry);
+  }
+  return entries;
+}
+
+std::string QueryPlan::Explain() const {
+  std::string str = "scan " + source_ + " (" +
+      std::to_string(candidates_.size()) + " entries)\n";
+  for (const auto& filter : filters_) {
+    str += "filter " + filter.description + " [" +
+        CostName(filter.predicate.cost()) + "]\n";
+  }
+  return str;
+}
+
+}   // namespace onepass
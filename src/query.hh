@@ -0,0 +1,124 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bands.hh"
+#include "folders.hh"
+#include "index.hh"
+#include "text_index.hh"
+#include "url_index.hh"
+#include "view.hh"
+
+namespace onepass {
+
+/**
+ * Parsed query expression. A query is a sequence of terms which all need to
+ * match, terms can be combined using "or", negated using "not" or "-" and
+ * grouped using parentheses. The terms are:
+ *
+ *   category:login       Entry category, by name or number.
+ *   folder:<name|uuid>   Entries in a folder.
+ *   tag:prod             Entries with a tag.
+ *   uuid:<uuid>          A single entry.
+ *   trashed:yes|no       Trashed entries.
+ *   fave:yes|no          Favorite entries.
+ *   created<op><time>    Creation time, with op one of ":", "<", "<=", ">"
+ *   updated<op><time>    and ">=". Times are given as seconds since the
+ *   tx<op><time>         epoch or as YYYY-MM-DD in UTC.
+ *   url:<glob>           Entries with a URL host matching a glob, such as
+ *                        "*.corp".
+ *   title:<text>         Titles containing the text, ignoring case.
+ *   has:<field>          Entries with a non-empty password, username, totp
+ *                        or notes.
+ *   <text>               Text search as done by TextIndex.
+ *
+ * Values containing spaces can be quoted using double quotes.
+ */
+class Query final {
+ public:
+  class Node;
+
+ private:
+  std::shared_ptr<const Node> root_;
+
+ public:
+  /**
+   * @param [in] text Query expression.
+   * @throw FormatError If the expression is malformed.
+   */
+  explicit Query(const std::string& text);
+
+  std::shared_ptr<const Node> root() const { return root_; }
+
+  /**
+   * @return The query in normalized form, with explicit "and" and fully
+   *         parenthesized.
+   */
+  std::string ToString() const;
+};
+
+/**
+ * Query compiled against the indexes of a database. The plan reads its
+ * candidates from the most selective index usable for one of the top-level
+ * terms, or all entries if there is no such term, and filters them through
+ * the remaining terms ordered by cost. Terms on plaintext metadata come
+ * first, terms requiring the details, and thus decryption, last.
+ */
+class QueryPlan final {
+ private:
+  class Filter final {
+   public:
+    std::string description;
+    Predicate predicate;
+
+    Filter(const std::string& description, const Predicate& predicate) :
+        description(description), predicate(predicate) {}
+  };
+
+  std::string source_;
+  Index::EntryList candidates_;
+  std::vector<Filter> filters_;
+
+ public:
+  /**
+   * @throw FormatError If a term of @a query has an invalid value.
+   */
+  QueryPlan(const Query& query,
+            const Bands& bands,
+            const Folders& folders,
+            const Index& index,
+            const UrlIndex& url_index,
+            const TextIndex& text_index);
+
+  /**
+   * Runs the plan.
+   * @return Matching entries, in load order.
+   */
+  Index::EntryList Execute() const;
+
+  /**
+   * @return Human readable description of the plan, one step per line.
+   */
+  std::string Explain() const;
+};
+
+}   // namespace onepass
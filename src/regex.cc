@@ -0,0 +1,550 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "regex.hh"
+
+#include <algorithm>
+#include <cassert>
+
+#include "exception.hh"
+
+namespace {
+
+// Upper bound on the number of NFA states, guards against patterns like
+// "(a{1000}){1000}".
+const std::size_t kMaxNfaStates = 1 << 16;
+
+// Number of DFA states kept by a matcher before its cache is flushed.
+const std::size_t kMaxDfaStates = 4096;
+
+}   // namespace
+
+namespace onepass {
+
+/**
+ * Node in the syntax tree of a regular expression.
+ */
+class Regex::Node final {
+ public:
+  enum class Type {
+    kEmpty,
+    kSet,
+    kConcat,
+    kAlternate,
+    kRepeat,
+  };
+
+  Type type = Type::kEmpty;
+  SymbolSet set;
+  std::vector<Node> children;
+  int min = 0;
+  int max = 0;  ///< -1 for unbounded.
+};
+
+constexpr int Regex::kSymbolCount;
+constexpr int Regex::kBeginSymbol;
+constexpr int Regex::kEndSymbol;
+
+/**
+ * Recursive descent parser producing the syntax tree of a pattern.
+ */
+class Regex::Parser final {
+ private:
+  const std::string& pattern_;
+  std::size_t pos_ = 0;
+  bool ignore_case_;
+
+  [[noreturn]] void Fail(const std::string& msg) const {
+    throw FormatError("invalid regular expression at offset " +
+                      std::to_string(pos_) + ": " + msg + ".");
+  }
+
+  bool AtEnd() const {
+    return pos_ >= pattern_.size();
+  }
+
+  char Peek() const {
+    return pattern_[pos_];
+  }
+
+  void AddByte(SymbolSet& set, unsigned char c) const {
+    set.set(c);
+    if (ignore_case_) {
+      if (c >= 'a' && c <= 'z')
+        set.set(c - 'a' + 'A');
+      else if (c >= 'A' && c <= 'Z')
+        set.set(c - 'A' + 'a');
+    }
+  }
+
+  void AddRange(SymbolSet& set, unsigned char first,
+                unsigned char last) const {
+    for (int c = first; c <= last; ++c)
+      AddByte(set, static_cast<unsigned char>(c));
+  }
+
+  static SymbolSet AllBytes() {
+    SymbolSet set;
+    for (int c = 0; c < 256; ++c)
+      set.set(c);
+    return set;
+  }
+
+  int ParseHexDigit() {
+    if (AtEnd())
+      Fail("incomplete hex escape");
+    char c = pattern_[pos_++];
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    Fail("invalid hex escape");
+  }
+
+  /**
+   * Parses the escape following a backslash.
+   * @param [out] set Symbols matched by the escape.
+   * @return true if the escape denotes a class, false if it is a single
+   *         byte which is also returned in @a byte.
+   */
+  bool ParseEscape(SymbolSet& set, unsigned char& byte) {
+    if (AtEnd())
+      Fail("trailing backslash");
+    char c = pattern_[pos_++];
+    SymbolSet cls;
+    bool negate = false;
+    switch (c) {
+      case 'D':
+        negate = true;
+        // Fall through.
+      case 'd':
+        AddRange(cls, '0', '9');
+        break;
+      case 'W':
+        negate = true;
+        // Fall through.
+      case 'w':
+        AddRange(cls, 'a', 'z');
+        AddRange(cls, 'A', 'Z');
+        AddRange(cls, '0', '9');
+        cls.set('_');
+        break;
+      case 'S':
+        negate = true;
+        // Fall through.
+      case 's':
+        for (char s : std::string(" \t\n\r\f\v"))
+          cls.set(static_cast<unsigned char>(s));
+        break;
+      case 't': byte = '\t'; return false;
+      case 'n': byte = '\n'; return false;
+      case 'r': byte = '\r'; return false;
+      case 'f': byte = '\f'; return false;
+      case 'v': byte = '\v'; return false;
+      case 'x': {
+        int high = ParseHexDigit();
+        byte = static_cast<unsigned char>(high * 16 + ParseHexDigit());
+        return false;
+      }
+      default:
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9')) {
+          --pos_;
+          Fail("unsupported escape");
+        }
+        byte = static_cast<unsigned char>(c);
+        return false;
+    }
+
+    set |= negate ? AllBytes() & ~cls : cls;
+    return true;
+  }
+
+  Node ParseClass() {
+    Node node;
+    node.type = Node::Type::kSet;
+
+    bool negate = !AtEnd() && Peek() == '^';
+    if (negate)
+      ++pos_;
+
+    SymbolSet set;
+    bool first = true;
+    for (;;) {
+      if (AtEnd())
+        Fail("missing ]");
+      char c = pattern_[pos_++];
+      if (c == ']' && !first)
+        break;
+      first = false;
+
+      unsigned char low = static_cast<unsigned char>(c);
+      if (c == '\\' && ParseEscape(set, low))
+        continue;
+
+      if (pos_ + 1 < pattern_.size() && Peek() == '-' &&
+          pattern_[pos_ + 1] != ']') {
+        ++pos_;
+        unsigned char high = static_cast<unsigned char>(pattern_[pos_++]);
+        if (high == '\\' && ParseEscape(set, high))
+          Fail("class in range");
+        if (high < low)
+          Fail("invalid range");
+        AddRange(set, low, high);
+      } else {
+        AddByte(set, low);
+      }
+    }
+
+    if (negate)
+      set = AllBytes() & ~set;
+    node.set = set;
+    return node;
+  }
+
+  Node ParseAtom() {
+    Node node;
+    node.type = Node::Type::kSet;
+
+    char c = pattern_[pos_++];
+    switch (c) {
+      case '(':
+        if (pattern_.compare(pos_, 2, "?:") == 0)
+          pos_ += 2;
+        else if (!AtEnd() && Peek() == '?')
+          Fail("unsupported group");
+        node = ParseAlternate();
+        if (AtEnd() || Peek() != ')')
+          Fail("missing )");
+        ++pos_;
+        break;
+      case '[':
+        node = ParseClass();
+        break;
+      case '.':
+        node.set = AllBytes();
+        node.set.reset('\n');
+        break;
+      case '^':
+        node.set.set(kBeginSymbol);
+        break;
+      case '$':
+        node.set.set(kEndSymbol);
+        break;
+      case '\\': {
+        unsigned char byte = 0;
+        if (!ParseEscape(node.set, byte))
+          AddByte(node.set, byte);
+        break;
+      }
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        --pos_;
+        Fail("nothing to repeat");
+      default:
+        AddByte(node.set, static_cast<unsigned char>(c));
+        break;
+    }
+    return node;
+  }
+
+  bool ParseCount(int& value) {
+    std::size_t start = pos_;
+    value = 0;
+    while (!AtEnd() && Peek() >= '0' && Peek() <= '9') {
+      value = value * 10 + (Peek() - '0');
+      if (value > 1000)
+        Fail("repetition count too large");
+      ++pos_;
+    }
+    return pos_ > start;
+  }
+
+  /**
+   * Parses a "{m}", "{m,}" or "{m,n}" quantifier. A brace not followed by a
+   * valid quantifier is left for the caller to treat as a literal.
+   */
+  bool ParseBraces(int& min, int& max) {
+    std::size_t start = pos_;
+    ++pos_;
+    if (!ParseCount(min)) {
+      pos_ = start;
+      return false;
+    }
+    max = min;
+    if (!AtEnd() && Peek() == ',') {
+      ++pos_;
+      if (!ParseCount(max))
+        max = -1;
+    }
+    if (AtEnd() || Peek() != '}') {
+      pos_ = start;
+      return false;
+    }
+    ++pos_;
+    if (max != -1 && max < min)
+      Fail("invalid repetition range");
+    return true;
+  }
+
+  Node ParseRepeat() {
+    Node node;
+    if (Peek() == '{') {
+      // A brace that does not start a quantifier is a literal.
+      int min = 0, max = 0;
+      if (ParseBraces(min, max))
+        Fail("nothing to repeat");
+      ++pos_;
+      node.type = Node::Type::kSet;
+      AddByte(node.set, '{');
+    } else {
+      node = ParseAtom();
+    }
+
+    while (!AtEnd()) {
+      int min = 0, max = 0;
+      char c = Peek();
+      if (c == '*') {
+        ++pos_;
+        max = -1;
+      } else if (c == '+') {
+        ++pos_;
+        min = 1;
+        max = -1;
+      } else if (c == '?') {
+        ++pos_;
+        max = 1;
+      } else if (c != '{' || !ParseBraces(min, max)) {
+        break;
+      }
+
+      // Lazy quantifiers match the same strings as greedy ones.
+      if (!AtEnd() && Peek() == '?')
+        ++pos_;
+
+      Node repeat;
+      repeat.type = Node::Type::kRepeat;
+      repeat.min = min;
+      repeat.max = max;
+      repeat.children.push_back(std::move(node));
+      node = std::move(repeat);
+    }
+    return node;
+  }
+
+  Node ParseConcat() {
+    Node node;
+    node.type = Node::Type::kConcat;
+    while (!AtEnd() && Peek() != '|' && Peek() != ')')
+      node.children.push_back(ParseRepeat());
+    return node;
+  }
+
+ public:
+  Parser(const std::string& pattern, bool ignore_case) :
+      pattern_(pattern), ignore_case_(ignore_case) {}
+
+  Node ParseAlternate() {
+    Node node;
+    node.type = Node::Type::kAlternate;
+    node.children.push_back(ParseConcat());
+    while (!AtEnd() && Peek() == '|') {
+      ++pos_;
+      node.children.push_back(ParseConcat());
+    }
+    return node;
+  }
+
+  Node Parse() {
+    Node node = ParseAlternate();
+    if (!AtEnd())
+      Fail("unmatched )");
+    return node;
+  }
+};
+
+Regex::Regex(const std::string& pattern, bool ignore_case) {
+  Node root = Parser(pattern, ignore_case).Parse();
+
+  // Searching for a match anywhere in the input is the same as an anchored
+  // match of ".*" followed by the pattern, with "." matching all symbols.
+  start_ = NewState();
+  sets_.push_back(SymbolSet().set());
+  states_[start_].set = 0;
+  states_[start_].next = start_;
+
+  std::pair<int, int> fragment = Compile(root);
+  states_[start_].epsilon.push_back(fragment.first);
+  match_ = fragment.second;
+}
+
+int Regex::NewState() {
+  if (states_.size() >= kMaxNfaStates)
+    throw FormatError("regular expression is too large.");
+  states_.push_back(NfaState());
+  return static_cast<int>(states_.size() - 1);
+}
+
+std::pair<int, int> Regex::Compile(const Node& node) {
+  int start = NewState();
+  int end = start;
+  switch (node.type) {
+    case Node::Type::kEmpty:
+      break;
+    case Node::Type::kSet:
+      end = NewState();
+      states_[start].set = static_cast<int>(sets_.size());
+      states_[start].next = end;
+      sets_.push_back(node.set);
+      break;
+    case Node::Type::kConcat:
+      for (const auto& child : node.children) {
+        std::pair<int, int> fragment = Compile(child);
+        states_[end].epsilon.push_back(fragment.first);
+        end = fragment.second;
+      }
+      break;
+    case Node::Type::kAlternate:
+      end = NewState();
+      for (const auto& child : node.children) {
+        std::pair<int, int> fragment = Compile(child);
+        states_[start].epsilon.push_back(fragment.first);
+        states_[fragment.second].epsilon.push_back(end);
+      }
+      break;
+    case Node::Type::kRepeat: {
+      const Node& child = node.children.front();
+      for (int i = 0; i < node.min; ++i) {
+        std::pair<int, int> fragment = Compile(child);
+        states_[end].epsilon.push_back(fragment.first);
+        end = fragment.second;
+      }
+
+      if (node.max == -1) {
+        std::pair<int, int> fragment = Compile(child);
+        int loop_end = NewState();
+        states_[end].epsilon.push_back(fragment.first);
+        states_[end].epsilon.push_back(loop_end);
+        states_[fragment.second].epsilon.push_back(fragment.first);
+        states_[fragment.second].epsilon.push_back(loop_end);
+        end = loop_end;
+      } else {
+        // Each optional repetition may skip directly to the end.
+        int optional_end = NewState();
+        for (int i = node.min; i < node.max; ++i) {
+          std::pair<int, int> fragment = Compile(child);
+          states_[end].epsilon.push_back(fragment.first);
+          states_[end].epsilon.push_back(optional_end);
+          end = fragment.second;
+        }
+        states_[end].epsilon.push_back(optional_end);
+        end = optional_end;
+      }
+      break;
+    }
+  }
+  return std::make_pair(start, end);
+}
+
+Regex::Matcher::Matcher(const std::shared_ptr<const Regex>& regex) :
+    regex_(regex) {
+  Flush();
+}
+
+int Regex::Matcher::AddState(std::vector<int> nfa_states) {
+  // Epsilon closure.
+  std::vector<bool> seen(regex_->states_.size(), false);
+  std::vector<int> stack(nfa_states);
+  nfa_states.clear();
+  while (!stack.empty()) {
+    int state = stack.back();
+    stack.pop_back();
+    if (seen[state])
+      continue;
+    seen[state] = true;
+    nfa_states.push_back(state);
+    for (int next : regex_->states_[state].epsilon)
+      stack.push_back(next);
+  }
+  std::sort(nfa_states.begin(), nfa_states.end());
+
+  auto it = state_ids_.find(nfa_states);
+  if (it != state_ids_.end())
+    return it->second;
+
+  State state;
+  state.nfa_states = nfa_states;
+  state.accepting = seen[regex_->match_];
+  state.next.assign(kSymbolCount, -1);
+  states_.push_back(std::move(state));
+
+  int id = static_cast<int>(states_.size() - 1);
+  state_ids_[nfa_states] = id;
+  return id;
+}
+
+int Regex::Matcher::Next(int state, int symbol) {
+  int next = states_[state].next[symbol];
+  if (next != -1)
+    return next;
+
+  std::vector<int> nfa_states;
+  for (int nfa_state : states_[state].nfa_states) {
+    const NfaState& s = regex_->states_[nfa_state];
+    if (s.set != -1 && regex_->sets_[s.set].test(symbol))
+      nfa_states.push_back(s.next);
+  }
+
+  if (states_.size() >= kMaxDfaStates) {
+    // Keep memory bounded for patterns with many DFA states by starting over
+    // from the states that are still needed.
+    Flush();
+    state = AddState(std::move(nfa_states));
+    return state;
+  }
+
+  next = AddState(std::move(nfa_states));
+  states_[state].next[symbol] = next;
+  return next;
+}
+
+void Regex::Matcher::Flush() {
+  states_.clear();
+  state_ids_.clear();
+  start_ = AddState(std::vector<int>(1, regex_->start_));
+}
+
+bool Regex::Matcher::Search(const std::string& text) {
+  int state = Next(start_, kBeginSymbol);
+  if (states_[state].accepting)
+    return true;
+
+  for (char c : text) {
+    state = Next(state, static_cast<unsigned char>(c));
+    if (states_[state].accepting)
+      return true;
+  }
+
+  return states_[Next(state, kEndSymbol)].accepting;
+}
+
+}   // namespace onepass
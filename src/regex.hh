@@ -0,0 +1,111 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <bitset>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace onepass {
+
+/**
+ * Regular expression compiled into a Thompson NFA, matched through a lazily
+ * built DFA. Matching runs in time linear in the input regardless of the
+ * pattern.
+ *
+ * The supported syntax is a subset of ECMAScript: literals, ".", character
+ * classes with ranges and negation, the escapes \d \w \s \D \W \S \t \n \r
+ * \f \v and \xHH, anchors "^" and "$", groups, alternation and the
+ * quantifiers "*", "+", "?" and "{m,n}". As in POSIX, a "]" first in a class
+ * is a literal. Lazy quantifiers are accepted but match like greedy ones. Matching is done on bytes, so "." matches a single
+ * byte of a multi-byte UTF-8 character.
+ */
+class Regex final {
+ public:
+  /**
+   * DFA states built while matching. A matcher must not be shared between
+   * threads, use one matcher per thread instead.
+   */
+  class Matcher final {
+   private:
+    class State final {
+     public:
+      std::vector<int> nfa_states;
+      bool accepting;
+      std::vector<int> next;
+    };
+
+    std::shared_ptr<const Regex> regex_;
+    std::vector<State> states_;
+    std::map<std::vector<int>, int> state_ids_;
+    int start_ = -1;
+
+    int AddState(std::vector<int> nfa_states);
+    int Next(int state, int symbol);
+    void Flush();
+
+   public:
+    explicit Matcher(const std::shared_ptr<const Regex>& regex);
+
+    /**
+     * @return true if the regular expression matches any part of @a text.
+     */
+    bool Search(const std::string& text);
+  };
+
+ private:
+  friend class Matcher;
+
+  // Bytes plus the virtual symbols before the first and after the last byte
+  // of the input, which the anchors match.
+  static constexpr int kSymbolCount = 258;
+  static constexpr int kBeginSymbol = 256;
+  static constexpr int kEndSymbol = 257;
+
+  typedef std::bitset<kSymbolCount> SymbolSet;
+
+  class NfaState final {
+   public:
+    int set = -1;   ///< Index of the symbols consumed, -1 for none.
+    int next = -1;  ///< State after consuming a symbol.
+    std::vector<int> epsilon;
+  };
+
+  class Node;
+  class Parser;
+
+  std::vector<NfaState> states_;
+  std::vector<SymbolSet> sets_;
+  int start_ = -1;
+  int match_ = -1;
+
+  int NewState();
+  std::pair<int, int> Compile(const Node& node);
+
+ public:
+  /**
+   * @param [in] pattern Regular expression.
+   * @param [in] ignore_case Whether ASCII letters match regardless of case.
+   * @throw FormatError If @a pattern is not a valid regular expression.
+   */
+  Regex(const std::string& pattern, bool ignore_case);
+};
+
+}   // namespace onepass
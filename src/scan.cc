@@ -0,0 +1,236 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scan.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Minimum number of entries per thread when scanning in parallel.
+const std::size_t kEntriesPerThread = 64;
+
+inline char LowerAscii(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/**
+ * Compares @a size bytes of @a text to @a needle, which is already lower
+ * case if @a ignore_case is set.
+ */
+inline bool Equal(const char* text, const char* needle, std::size_t size,
+                  bool ignore_case) {
+  if (!ignore_case)
+    return std::memcmp(text, needle, size) == 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    if (LowerAscii(text[i]) != needle[i])
+      return false;
+  }
+  return true;
+}
+
+#if defined(__SSE2__)
+inline __m128i LowerAscii(__m128i chars) {
+  const __m128i upper = _mm_and_si128(
+      _mm_cmpgt_epi8(chars, _mm_set1_epi8('A' - 1)),
+      _mm_cmplt_epi8(chars, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(chars, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+/**
+ * @return true if @a needle occurs in @a text. Candidate positions are found
+ *         by comparing both the first and last byte of the needle against 16
+ *         positions at a time, only those are compared in full.
+ */
+bool Contains(const char* text, std::size_t size, const std::string& needle,
+              bool ignore_case) {
+  const std::size_t length = needle.size();
+  if (length == 0)
+    return true;
+  if (length > size)
+    return false;
+
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i first = _mm_set1_epi8(needle.front());
+  const __m128i last = _mm_set1_epi8(needle.back());
+  for (; i + length - 1 + 16 <= size; i += 16) {
+    __m128i block_first = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(text + i));
+    __m128i block_last = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(text + i + length - 1));
+    if (ignore_case) {
+      block_first = LowerAscii(block_first);
+      block_last = LowerAscii(block_last);
+    }
+
+    int candidates = _mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+    while (candidates != 0) {
+      std::size_t pos = i + __builtin_ctz(candidates);
+      if (Equal(text + pos, needle.data(), length, ignore_case))
+        return true;
+      candidates &= candidates - 1;
+    }
+  }
+#endif
+
+  for (; i + length <= size; ++i) {
+    if (!ignore_case) {
+      const void* found = std::memchr(text + i, needle.front(),
+                                      size - length + 1 - i);
+      if (found == nullptr)
+        return false;
+      i = static_cast<const char*>(found) - text;
+    }
+    if (Equal(text + i, needle.data(), length, ignore_case))
+      return true;
+  }
+  return false;
+}
+
+} // namespace
+
+namespace onepass {
+
+Scanner::Scanner(const std::string& pattern, Syntax syntax, bool ignore_case) :
+    syntax_(syntax), ignore_case_(ignore_case) {
+  if (syntax == Syntax::kRegex) {
+    regex_ = std::make_shared<const Regex>(pattern, ignore_case);
+  } else {
+    literal_ = pattern;
+    if (ignore_case)
+      std::transform(literal_.begin(), literal_.end(), literal_.begin(),
+                     [](char c) { return LowerAscii(c); });
+  }
+}
+
+bool Scanner::MatchesLiteral(const std::string& text) const {
+  return Contains(text.data(), text.size(), literal_, ignore_case_);
+}
+
+void Scanner::ScanEntry(const std::shared_ptr<Entry>& entry,
+                        Regex::Matcher* matcher,
+                        const Callback& emit) const {
+  const std::shared_ptr<Entry::Section> no_section;
+  const std::shared_ptr<Entry::Field> no_field;
+
+  auto scan = [&](Source source,
+                  const std::shared_ptr<Entry::Section>& section,
+                  const std::shared_ptr<Entry::Field>& field,
+                  const std::string& value) {
+    if (value.empty())
+      return;
+    if (matcher != nullptr ? matcher->Search(value) : MatchesLiteral(value))
+      emit(Match(entry, source, section, field, value));
+  };
+
+  auto scan_field = [&](Source source,
+                        const std::shared_ptr<Entry::Section>& section,
+                        const std::shared_ptr<Entry::Field>& field) {
+    const Entry::Value& value = field->value();
+    if (value.type() == Entry::Value::Type::kString)
+      scan(source, section, field, value.string_value());
+    else if (!value.empty())
+      scan(source, section, field, value.ToString());
+  };
+
+  scan(Source::kTitle, no_section, no_field, entry->title());
+  scan(Source::kInfo, no_section, no_field, entry->info());
+  scan(Source::kUrl, no_section, no_field, entry->url());
+  for (const auto& url : entry->urls())
+    scan(Source::kUrl, no_section, no_field, url.second);
+  for (const auto& tag : entry->tags())
+    scan(Source::kTag, no_section, no_field, tag);
+  // Keep the details alive while scanning, the matches reference them.
+  std::shared_ptr<const Entry::Details> details = entry->details();
+  scan(Source::kNotes, no_section, no_field, details->notes());
+
+  for (const auto& field : details->fields())
+    scan_field(Source::kField, no_section, field);
+  for (const auto& section : details->sections()) {
+    for (const auto& field : section->fields())
+      scan_field(Source::kSectionField, section, field);
+  }
+  for (const auto& item : details->password_history())
+    scan(Source::kPasswordHistory, no_section, no_field, item->value());
+}
+
+void Scanner::Scan(const std::vector<std::shared_ptr<Entry>>& entries,
+                   const Callback& callback, std::size_t threads) const {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, std::max<std::size_t>(
+      1, entries.size() / kEntriesPerThread));
+
+  std::mutex callback_mutex;
+  std::atomic<std::size_t> next_entry(0);
+  std::atomic<bool> stop(false);
+  std::exception_ptr error;
+
+  auto emit = [&](const Match& match) {
+    std::lock_guard<std::mutex> lock(callback_mutex);
+    if (!stop)
+      callback(match);
+  };
+
+  // Entries differ a lot in size, so threads take one entry at a time rather
+  // than a fixed range.
+  auto work = [&]() {
+    try {
+      std::unique_ptr<Regex::Matcher> matcher;
+      if (regex_)
+        matcher.reset(new Regex::Matcher(regex_));
+
+      std::size_t i;
+      while (!stop && (i = next_entry++) < entries.size())
+        ScanEntry(entries[i], matcher.get(), emit);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(callback_mutex);
+      if (!stop) {
+        stop = true;
+        error = std::current_exception();
+      }
+    }
+  };
+
+  if (threads <= 1) {
+    work();
+  } else {
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t)
+      workers.push_back(std::thread(work));
+    for (auto& worker : workers)
+      worker.join();
+  }
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+}   // namespace onepass
@@ -0,0 +1,122 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bands.hh"
+#include "regex.hh"
+
+namespace onepass {
+
+/**
+ * Brute-force search through every decrypted value of the entries: overview
+ * fields, field and section field values and the password history. Unlike
+ * the indexes no preparation is needed, the pattern is compiled once and the
+ * entries are split across threads.
+ */
+class Scanner final {
+ public:
+  enum class Syntax {
+    kLiteral,  ///< The pattern is a plain substring.
+    kRegex     ///< The pattern is a regular expression, see Regex.
+  };
+
+  enum class Source {
+    kTitle,
+    kInfo,
+    kUrl,
+    kTag,
+    kNotes,
+    kField,
+    kSectionField,
+    kPasswordHistory
+  };
+
+  class Match final {
+   private:
+    std::shared_ptr<Entry> entry_;
+    Source source_;
+    std::shared_ptr<Entry::Section> section_;
+    std::shared_ptr<Entry::Field> field_;
+    const std::string& value_;
+
+   public:
+    Match(const std::shared_ptr<Entry>& entry, Source source,
+          const std::shared_ptr<Entry::Section>& section,
+          const std::shared_ptr<Entry::Field>& field,
+          const std::string& value) :
+        entry_(entry), source_(source), section_(section), field_(field),
+        value_(value) {}
+
+    std::shared_ptr<Entry> entry() const { return entry_; }
+    Source source() const { return source_; }
+    /**
+     * @return The section of a matching section field, otherwise null.
+     */
+    std::shared_ptr<Entry::Section> section() const { return section_; }
+    /**
+     * @return The matching field or section field, otherwise null.
+     */
+    std::shared_ptr<Entry::Field> field() const { return field_; }
+    /**
+     * @return The matching value, only valid during the callback.
+     */
+    const std::string& value() const { return value_; }
+  };
+
+  /**
+   * Receives the matches. Calls are serialized but may come from different
+   * threads and in any order. An exception thrown by the callback stops the
+   * scan and is rethrown by Scan.
+   */
+  typedef std::function<void(const Match& match)> Callback;
+
+ private:
+  Syntax syntax_;
+  bool ignore_case_;
+  std::string literal_;
+  std::shared_ptr<const Regex> regex_;
+
+  bool MatchesLiteral(const std::string& text) const;
+  void ScanEntry(const std::shared_ptr<Entry>& entry, Regex::Matcher* matcher,
+                 const Callback& emit) const;
+
+ public:
+  /**
+   * @param [in] pattern Substring or regular expression to look for.
+   * @param [in] syntax How to interpret @a pattern.
+   * @param [in] ignore_case Whether ASCII letters match regardless of case.
+   * @throw FormatError If @a pattern is not a valid regular expression.
+   */
+  Scanner(const std::string& pattern, Syntax syntax, bool ignore_case);
+
+  /**
+   * Scans entries for values matching the pattern, one match per value.
+   * @param [in] entries Entries to scan.
+   * @param [in] callback Receiver of the matches.
+   * @param [in] threads Maximum number of threads, 0 to use one per core.
+   */
+  void Scan(const std::vector<std::shared_ptr<Entry>>& entries,
+            const Callback& callback, std::size_t threads = 0) const;
+};
+
+}   // namespace onepass
@@ -0,0 +1,224 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sorted_index.hh"
+
+#include <cassert>
+#include <unordered_set>
+
+#include "util.hh"
+
+namespace {
+
+// Base letters of the lower case Latin-1 letters U+00DF to U+00FF, indexed
+// by the second byte of their UTF-8 encoding minus 0x9f.
+const char* const kLatin1Base[] = {
+  "ss",                                             // U+00DF
+  "a", "a", "a", "a", "a", "a", "ae", "c",          // U+00E0
+  "e", "e", "e", "e", "i", "i", "i", "i",           // U+00E8
+  "d", "n", "o", "o", "o", "o", "o", nullptr,       // U+00F0
+  "o", "u", "u", "u", "u", "y", "th", "y"           // U+00F8
+};
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * @param [in] trim_end Whether to drop trailing whitespace, prefixes keep it
+ *                      to only match whole words before it.
+ */
+std::string MakeKey(const std::string& title, bool trim_end) {
+  std::string folded = onepass::FoldCase(title);
+
+  std::string key;
+  key.reserve(folded.size());
+  bool space = false;
+  for (std::size_t i = 0; i < folded.size(); ++i) {
+    char c = folded[i];
+    if (IsSpace(c)) {
+      space = !key.empty();
+      continue;
+    }
+    if (space) {
+      key.push_back(' ');
+      space = false;
+    }
+
+    unsigned char n = i + 1 < folded.size() ?
+        static_cast<unsigned char>(folded[i + 1]) : 0;
+    if (static_cast<unsigned char>(c) == 0xc3 && n >= 0x9f && n <= 0xbf &&
+        kLatin1Base[n - 0x9f] != nullptr) {
+      key.append(kLatin1Base[n - 0x9f]);
+      ++i;
+    } else {
+      key.push_back(c);
+    }
+  }
+  if (space && !trim_end)
+    key.push_back(' ');
+  return key;
+}
+
+} // namespace
+
+namespace onepass {
+
+std::string CollationKey(const std::string& title) {
+  return MakeKey(title, true);
+}
+
+void SortedIndex::Build(const Bands& bands) {
+  Clear();
+  for (const auto& entry : bands.entries())
+    Add(entry);
+}
+
+SortedIndex::SortedIndex(const SortedIndex& other) :
+    by_title_(other.by_title_), by_time_(other.by_time_) {
+  Relink();
+}
+
+SortedIndex& SortedIndex::operator=(const SortedIndex& other) {
+  if (this != &other) {
+    by_title_ = other.by_title_;
+    by_time_ = other.by_time_;
+    Relink();
+  }
+  return *this;
+}
+
+void SortedIndex::Relink() {
+  records_.clear();
+  for (auto it = by_title_.begin(); it != by_title_.end(); ++it)
+    records_[it->entry.get()].first = it;
+  for (auto it = by_time_.begin(); it != by_time_.end(); ++it)
+    records_[it->entry.get()].second = it;
+}
+
+void SortedIndex::Clear() {
+  by_title_.clear();
+  by_time_.clear();
+  records_.clear();
+}
+
+void SortedIndex::Update(const Bands& bands) {
+  std::unordered_set<const Entry*> current;
+  for (const auto& entry : bands.entries())
+    current.insert(entry.get());
+
+  std::vector<std::shared_ptr<Entry>> stale;
+  for (const auto& record : records_) {
+    if (current.count(record.first) == 0)
+      stale.push_back(record.second.first->entry);
+  }
+
+  for (const auto& entry : stale)
+    Remove(entry);
+  for (const auto& entry : bands.entries())
+    Add(entry);
+}
+
+void SortedIndex::Add(const std::shared_ptr<Entry>& entry) {
+  if (entry->category() == Entry::Category::kTombstone ||
+      records_.count(entry.get()) != 0) {
+    return;
+  }
+
+  TitleRecord title_record;
+  title_record.key = CollationKey(entry->title());
+  title_record.uuid = entry->uuid();
+  title_record.entry = entry;
+
+  TimeRecord time_record;
+  time_record.time = entry->modification_time();
+  time_record.uuid = entry->uuid();
+  time_record.entry = entry;
+
+  records_[entry.get()] = std::make_pair(
+      by_title_.insert(std::move(title_record)).first,
+      by_time_.insert(std::move(time_record)).first);
+}
+
+void SortedIndex::Remove(const std::shared_ptr<Entry>& entry) {
+  auto it = records_.find(entry.get());
+  if (it == records_.end())
+    return;
+
+  by_title_.erase(it->second.first);
+  by_time_.erase(it->second.second);
+  records_.erase(it);
+}
+
+SortedIndex::Page SortedIndex::List(Order order, std::size_t limit,
+                                    const Cursor& after) const {
+  std::vector<std::shared_ptr<Entry>> entries;
+  Cursor next = after;
+  bool more = false;
+
+  if (order == Order::kTitle) {
+    TitleIterator it = by_title_.begin();
+    if (after.valid_) {
+      TitleRecord record;
+      record.key = after.key_;
+      record.uuid = after.uuid_;
+      it = by_title_.upper_bound(record);
+    }
+    for (; it != by_title_.end() && entries.size() < limit; ++it) {
+      entries.push_back(it->entry);
+      next.valid_ = true;
+      next.key_ = it->key;
+      next.uuid_ = it->uuid;
+    }
+    more = it != by_title_.end();
+  } else {
+    assert(order == Order::kModified);
+    TimeIterator it = by_time_.begin();
+    if (after.valid_) {
+      TimeRecord record;
+      record.time = after.time_;
+      record.uuid = after.uuid_;
+      it = by_time_.upper_bound(record);
+    }
+    for (; it != by_time_.end() && entries.size() < limit; ++it) {
+      entries.push_back(it->entry);
+      next.valid_ = true;
+      next.time_ = it->time;
+      next.uuid_ = it->uuid;
+    }
+    more = it != by_time_.end();
+  }
+
+  return Page(std::move(entries), next, more);
+}
+
+std::vector<std::shared_ptr<Entry>> SortedIndex::Complete(
+    const std::string& prefix, std::size_t limit) const {
+  std::vector<std::shared_ptr<Entry>> entries;
+
+  TitleRecord record;
+  record.key = MakeKey(prefix, false);
+  for (auto it = by_title_.lower_bound(record);
+       it != by_title_.end() && entries.size() < limit &&
+       it->key.compare(0, record.key.size(), record.key) == 0; ++it) {
+    entries.push_back(it->entry);
+  }
+  return entries;
+}
+
+}   // namespace onepass
@@ -0,0 +1,182 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <ctime>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bands.hh"
+
+namespace onepass {
+
+/**
+ * Entries kept in sorted order by title and by modification time. Titles
+ * are compared through precomputed collation keys, so sorting and lookups
+ * never fold case on the fly. Both orders are balanced trees, which makes
+ * adding or removing an entry O(log n) and fetching a page or prefix range
+ * O(log n + page).
+ *
+ * Tombstones are not listed.
+ */
+class SortedIndex final {
+ public:
+  enum class Order {
+    kTitle,     ///< By title, ascending.
+    kModified   ///< By modification time, most recent first.
+  };
+
+  /**
+   * Position in a listing, referring to the last entry of a page by its
+   * sort key rather than by offset. Paging stays stable when entries are
+   * added or removed between requests.
+   */
+  class Cursor final {
+   private:
+    friend class SortedIndex;
+
+    bool valid_;
+    std::string key_;
+    std::time_t time_;
+    Uuid uuid_;
+
+   public:
+    Cursor() : valid_(false), time_(0) {}
+
+    /**
+     * @return false for the cursor before the first entry.
+     */
+    bool valid() const { return valid_; }
+  };
+
+  class Page final {
+   private:
+    std::vector<std::shared_ptr<Entry>> entries_;
+    Cursor next_;
+    bool more_;
+
+   public:
+    Page(std::vector<std::shared_ptr<Entry>> entries, const Cursor& next,
+         bool more) :
+        entries_(std::move(entries)), next_(next), more_(more) {}
+
+    const std::vector<std::shared_ptr<Entry>>& entries() const {
+      return entries_;
+    }
+    /**
+     * @return The cursor for requesting the following page.
+     */
+    const Cursor& next() const { return next_; }
+    /**
+     * @return true if there are entries following this page.
+     */
+    bool more() const { return more_; }
+  };
+
+ private:
+  class TitleRecord final {
+   public:
+    std::string key;
+    Uuid uuid;
+    std::shared_ptr<Entry> entry;
+
+    bool operator<(const TitleRecord& other) const {
+      return key < other.key || (key == other.key && uuid < other.uuid);
+    }
+  };
+
+  class TimeRecord final {
+   public:
+    std::time_t time;
+    Uuid uuid;
+    std::shared_ptr<Entry> entry;
+
+    bool operator<(const TimeRecord& other) const {
+      return time > other.time || (time == other.time && uuid < other.uuid);
+    }
+  };
+
+  typedef std::set<TitleRecord>::const_iterator TitleIterator;
+  typedef std::set<TimeRecord>::const_iterator TimeIterator;
+
+  std::set<TitleRecord> by_title_;
+  std::set<TimeRecord> by_time_;
+  std::unordered_map<const Entry*,
+                     std::pair<TitleIterator, TimeIterator>> records_;
+
+  void Relink();
+
+ public:
+  SortedIndex() = default;
+  /**
+   * Copies the index. The records are shared with @a other, the lookup of
+   * records by entry is rebuilt to refer to the copy.
+   */
+  SortedIndex(const SortedIndex& other);
+  SortedIndex& operator=(const SortedIndex& other);
+
+  void Build(const Bands& bands);
+  void Clear();
+
+  /**
+   * Updates the index to reflect a new set of entries. Entries are compared
+   * by identity, like TextIndex::Update.
+   */
+  void Update(const Bands& bands);
+
+  void Add(const std::shared_ptr<Entry>& entry);
+  void Remove(const std::shared_ptr<Entry>& entry);
+
+  /**
+   * Lists entries in sorted order.
+   * @param [in] order Sort order.
+   * @param [in] limit Maximum number of entries on the page.
+   * @param [in] after Cursor of the previous page, or a default constructed
+   *                   cursor for the first page. The cursor must come from a
+   *                   page of the same order.
+   * @return Page of entries.
+   */
+  Page List(Order order, std::size_t limit,
+            const Cursor& after = Cursor()) const;
+
+  /**
+   * Finds entries with titles starting with a prefix, ignoring case and
+   * accents, in title order.
+   * @param [in] prefix Title prefix.
+   * @param [in] limit Maximum number of entries to return.
+   * @return Matching entries.
+   */
+  std::vector<std::shared_ptr<Entry>> Complete(const std::string& prefix,
+                                               std::size_t limit) const;
+
+  std::size_t size() const { return records_.size(); }
+};
+
+/**
+ * Computes the collation key of a title. The key is case folded, has the
+ * accents of Latin-1 letters removed and runs of whitespace replaced by a
+ * single space, with leading and trailing whitespace dropped.
+ * @param [in] title UTF-8 title.
+ * @return Key which compares bytewise in collation order.
+ */
+std::string CollationKey(const std::string& title);
+
+}   // namespace onepass
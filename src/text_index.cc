@@ -0,0 +1,407 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "text_index.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_set>
+
+#include "util.hh"
+
+namespace {
+
+// Weights of the fields, in the order of the field bits.
+const uint32_t kFieldWeights[] = { 8, 4, 2, 3, 1 };
+
+// Weights of how a term matches a field.
+const uint32_t kMatchAnywhere = 1;
+const uint32_t kMatchWordStart = 2;
+const uint32_t kMatchWhole = 4;
+
+// Compact the index when more than half of the documents are removed.
+const std::size_t kMinCompactSize = 64;
+
+// Separates values within a field, such as tags.
+const char kValueSeparator = '\n';
+
+inline uint32_t Trigram(const std::string& text, std::size_t pos) {
+  return (static_cast<uint32_t>(static_cast<uint8_t>(text[pos])) << 16) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(text[pos + 1])) << 8) |
+         static_cast<uint32_t>(static_cast<uint8_t>(text[pos + 2]));
+}
+
+inline bool IsWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+      (c >= 'A' && c <= 'Z') || (static_cast<unsigned char>(c) & 0x80);
+}
+
+inline void PutVarint(std::vector<uint8_t>& dst, uint32_t val) {
+  while (val >= 0x80) {
+    dst.push_back(static_cast<uint8_t>(val | 0x80));
+    val >>= 7;
+  }
+  dst.push_back(static_cast<uint8_t>(val));
+}
+
+inline uint32_t GetVarint(const uint8_t*& src) {
+  uint32_t val = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t b = *src++;
+    val |= static_cast<uint32_t>(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      break;
+  }
+  return val;
+}
+
+/**
+ * Finds the best match of a term in a field.
+ * @return Match weight, or zero if the term does not match the field.
+ */
+uint32_t MatchField(const std::string& text, const std::string& term,
+                    onepass::TextIndex::Mode mode) {
+  uint32_t best = 0;
+  for (std::string::size_type pos = text.find(term);
+       pos != std::string::npos && best < kMatchWhole;
+       pos = text.find(term, pos + 1)) {
+    std::string::size_type end = pos + term.size();
+
+    bool word_start = pos == 0 || !IsWordChar(text[pos - 1]);
+    bool value_start = pos == 0 || text[pos - 1] == kValueSeparator;
+    bool value_end = end == text.size() || text[end] == kValueSeparator;
+
+    if (value_start && value_end) {
+      best = kMatchWhole;
+    } else if (word_start) {
+      best = std::max(best, kMatchWordStart);
+    } else if (mode == onepass::TextIndex::Mode::kSubstring) {
+      best = std::max(best, kMatchAnywhere);
+    }
+  }
+  return best;
+}
+
+} // namespace
+
+namespace onepass {
+
+void TextIndex::PostingList::Append(uint32_t doc, uint8_t fields) {
+  assert(count == 0 || doc > last_doc);
+  PutVarint(data, doc - last_doc);
+  data.push_back(fields);
+  last_doc = doc;
+  ++count;
+}
+
+void TextIndex::Build(const Bands& bands) {
+  Clear();
+  docs_.reserve(bands.entries().size());
+  for (const auto& entry : bands.entries())
+    Add(entry);
+}
+
+void TextIndex::Clear() {
+  docs_.clear();
+  doc_ids_.clear();
+  postings_.clear();
+  removed_ = 0;
+}
+
+void TextIndex::Update(const Bands& bands) {
+  std::unordered_set<const Entry*> current;
+  for (const auto& entry : bands.entries())
+    current.insert(entry.get());
+
+  std::vector<std::shared_ptr<Entry>> stale;
+  for (const auto& doc : docs_) {
+    if (doc.entry && current.count(doc.entry.get()) == 0)
+      stale.push_back(doc.entry);
+  }
+
+  for (const auto& entry : stale)
+    Remove(entry);
+  for (const auto& entry : bands.entries())
+    Add(entry);
+}
+
+void TextIndex::Add(const std::shared_ptr<Entry>& entry) {
+  if (doc_ids_.count(entry.get()) != 0)
+    return;
+
+  Document doc;
+  doc.entry = entry;
+
+  std::string tags, urls = entry->url();
+  for (const auto& tag : entry->tags()) {
+    if (!tags.empty())
+      tags.push_back(kValueSeparator);
+    tags.append(tag);
+  }
+  for (const auto& url : entry->urls()) {
+    if (url.second == entry->url())
+      continue;
+    if (!urls.empty())
+      urls.push_back(kValueSeparator);
+    urls.append(url.second);
+  }
+
+  doc.text[0] = FoldCase(entry->title());
+  doc.text[1] = FoldCase(tags);
+  doc.text[2] = FoldCase(entry->info());
+  doc.text[3] = FoldCase(urls);
+  if (index_notes_)
+    doc.text[4] = FoldCase(entry->notes());
+
+  std::unordered_map<uint32_t, uint8_t> trigrams;
+  for (std::size_t field = 0; field < kFieldCount; ++field) {
+    const std::string& text = doc.text[field];
+    for (std::size_t i = 0; i + 3 <= text.size(); ++i)
+      trigrams[Trigram(text, i)] |= static_cast<uint8_t>(1 << field);
+  }
+
+  uint32_t id = static_cast<uint32_t>(docs_.size());
+  for (const auto& trigram : trigrams)
+    postings_[trigram.first].Append(id, trigram.second);
+
+  docs_.push_back(std::move(doc));
+  doc_ids_.insert(std::make_pair(entry.get(), id));
+}
+
+void TextIndex::Remove(const std::shared_ptr<Entry>& entry) {
+  auto it = doc_ids_.find(entry.get());
+  if (it == doc_ids_.end())
+    return;
+
+  // The posting lists are left as is, removed documents are skipped when
+  // querying until the index is compacted.
+  docs_[it->second] = Document();
+  doc_ids_.erase(it);
+  ++removed_;
+
+  if (docs_.size() >= kMinCompactSize && removed_ * 2 > docs_.size())
+    Compact();
+}
+
+void TextIndex::Compact() {
+  std::vector<std::shared_ptr<Entry>> entries;
+  entries.reserve(doc_ids_.size());
+  for (const auto& doc : docs_) {
+    if (doc.entry)
+      entries.push_back(doc.entry);
+  }
+
+  Clear();
+  for (const auto& entry : entries)
+    Add(entry);
+}
+
+std::vector<std::pair<uint32_t, uint8_t>> TextIndex::Candidates(
+    const std::string& term) const {
+  std::vector<std::pair<uint32_t, uint8_t>> candidates;
+
+  // Terms too short for trigrams are verified against every document.
+  if (term.size() < 3) {
+    for (uint32_t id = 0; id < docs_.size(); ++id) {
+      if (docs_[id].entry)
+        candidates.push_back(std::make_pair(id, 0xff));
+    }
+    return candidates;
+  }
+
+  std::vector<const PostingList*> lists;
+  std::unordered_set<uint32_t> seen;
+  for (std::size_t i = 0; i + 3 <= term.size(); ++i) {
+    uint32_t trigram = Trigram(term, i);
+    if (!seen.insert(trigram).second)
+      continue;
+
+    auto it = postings_.find(trigram);
+    if (it == postings_.end())
+      return candidates;
+    lists.push_back(&it->second);
+  }
+
+  // Intersect starting with the shortest list.
+  std::sort(lists.begin(), lists.end(),
+            [](const PostingList* a, const PostingList* b) {
+    return a->count < b->count;
+  });
+
+  const uint8_t* src = lists[0]->data.data();
+  uint32_t doc = 0;
+  candidates.reserve(lists[0]->count);
+  for (uint32_t i = 0; i < lists[0]->count; ++i) {
+    doc += GetVarint(src);
+    uint8_t fields = *src++;
+    if (docs_[doc].entry)
+      candidates.push_back(std::make_pair(doc, fields));
+  }
+
+  for (std::size_t l = 1; l < lists.size() && !candidates.empty(); ++l) {
+    const uint8_t* src = lists[l]->data.data();
+    uint32_t doc = 0;
+
+    std::size_t out = 0, c = 0;
+    for (uint32_t i = 0; i < lists[l]->count && c < candidates.size(); ++i) {
+      doc += GetVarint(src);
+      uint8_t fields = *src++;
+
+      while (c < candidates.size() && candidates[c].first < doc)
+        ++c;
+      if (c < candidates.size() && candidates[c].first == doc) {
+        uint8_t common = candidates[c].second & fields;
+        if (common != 0)
+          candidates[out++] = std::make_pair(doc, common);
+        ++c;
+      }
+    }
+    candidates.resize(out);
+  }
+
+  return candidates;
+}
+
+std::vector<TextIndex::Hit> TextIndex::Search(const std::string& query,
+                                              std::size_t limit,
+                                              Mode mode) const {
+  std::vector<Hit> hits;
+
+  std::vector<std::string> terms;
+  std::string folded = FoldCase(query);
+  for (std::string::size_type pos = 0; pos < folded.size();) {
+    std::string::size_type start = folded.find_first_not_of(" \t\r\n", pos);
+    if (start == std::string::npos)
+      break;
+    std::string::size_type end = folded.find_first_of(" \t\r\n", start);
+    if (end == std::string::npos)
+      end = folded.size();
+    terms.push_back(folded.substr(start, end - start));
+    pos = end;
+  }
+
+  if (terms.empty())
+    return hits;
+
+  // The longest term is likely the most selective one.
+  std::sort(terms.begin(), terms.end(),
+            [](const std::string& a, const std::string& b) {
+    return a.size() > b.size();
+  });
+
+  std::vector<std::pair<uint32_t, uint8_t>> candidates = Candidates(terms[0]);
+  std::vector<uint8_t> masks;
+  masks.reserve(candidates.size() * terms.size());
+  for (const auto& candidate : candidates)
+    masks.push_back(candidate.second);
+
+  // Narrow the candidates by the other terms, keeping one field mask per
+  // candidate and term.
+  std::vector<uint32_t> docs;
+  for (const auto& candidate : candidates)
+    docs.push_back(candidate.first);
+
+  for (std::size_t t = 1; t < terms.size() && !docs.empty(); ++t) {
+    std::vector<std::pair<uint32_t, uint8_t>> other = Candidates(terms[t]);
+
+    std::vector<uint32_t> next_docs;
+    std::vector<uint8_t> next_masks;
+    std::size_t i = 0, j = 0;
+    while (i < docs.size() && j < other.size()) {
+      if (docs[i] < other[j].first) {
+        ++i;
+      } else if (other[j].first < docs[i]) {
+        ++j;
+      } else {
+        next_docs.push_back(docs[i]);
+        next_masks.insert(next_masks.end(), masks.begin() + i * t,
+                          masks.begin() + (i + 1) * t);
+        next_masks.push_back(other[j].second);
+        ++i;
+        ++j;
+      }
+    }
+
+    docs.swap(next_docs);
+    masks.swap(next_masks);
+  }
+
+  // Verify the candidates and score them.
+  for (std::size_t i = 0; i < docs.size(); ++i) {
+    const Document& doc = docs_[docs[i]];
+
+    uint32_t score = 0;
+    uint8_t matched = 0;
+    bool all_terms = true;
+    for (std::size_t t = 0; t < terms.size() && all_terms; ++t) {
+      uint8_t mask = masks[i * terms.size() + t];
+
+      uint32_t term_score = 0;
+      for (std::size_t field = 0; field < kFieldCount; ++field) {
+        if (!(mask & (1 << field)))
+          continue;
+
+        uint32_t match = MatchField(doc.text[field], terms[t], mode);
+        if (match != 0) {
+          term_score += match * kFieldWeights[field];
+          matched |= static_cast<uint8_t>(1 << field);
+        }
+      }
+
+      all_terms = term_score != 0;
+      score += term_score;
+    }
+
+    if (all_terms)
+      hits.push_back(Hit(doc.entry, score, matched));
+  }
+
+  // Hits are in document order, ties are kept in that order.
+  std::vector<std::size_t> order(hits.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+
+  auto better = [&](std::size_t a, std::size_t b) {
+    if (hits[a].score() != hits[b].score())
+      return hits[a].score() > hits[b].score();
+    return a < b;
+  };
+  if (limit != 0 && limit < order.size()) {
+    std::partial_sort(order.begin(), order.begin() + limit, order.end(),
+                      better);
+    order.resize(limit);
+  } else {
+    std::sort(order.begin(), order.end(), better);
+  }
+
+  std::vector<Hit> ranked;
+  ranked.reserve(order.size());
+  for (std::size_t i : order)
+    ranked.push_back(hits[i]);
+
+  return ranked;
+}
+
+std::size_t TextIndex::posting_bytes() const {
+  std::size_t bytes = 0;
+  for (const auto& posting : postings_)
+    bytes += posting.second.data.size();
+  return bytes;
+}
+
+}   // namespace onepass
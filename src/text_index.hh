@@ -0,0 +1,147 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bands.hh"
+
+namespace onepass {
+
+/**
+ * In-memory inverted index over the searchable text of entries. Every
+ * trigram of the case folded text maps to a delta and varint compressed list
+ * of the documents containing it, together with a mask of the fields it
+ * occurs in. Queries intersect the lists of the query trigrams and verify the
+ * remaining candidates against the indexed text.
+ *
+ * The notes are indexed too unless disabled by set_index_notes, in which
+ * case building the index does not decrypt the details of the entries and
+ * searches do not find text in the notes.
+ */
+class TextIndex final {
+ public:
+  enum Field : uint8_t {
+    kTitle = 1 << 0,
+    kTags = 1 << 1,
+    kInfo = 1 << 2,
+    kUrl = 1 << 3,
+    kNotes = 1 << 4
+  };
+
+  enum class Mode {
+    kSubstring,  ///< Terms may match anywhere.
+    kPrefix      ///< Terms must match at the start of a word.
+  };
+
+  class Hit final {
+   private:
+    std::shared_ptr<Entry> entry_;
+    uint32_t score_;
+    uint8_t fields_;
+
+   public:
+    Hit(const std::shared_ptr<Entry>& entry, uint32_t score, uint8_t fields) :
+        entry_(entry), score_(score), fields_(fields) {}
+
+    std::shared_ptr<Entry> entry() const { return entry_; }
+    uint32_t score() const { return score_; }
+    /**
+     * @return Mask of the fields that matched the query.
+     */
+    uint8_t fields() const { return fields_; }
+  };
+
+ private:
+  static constexpr std::size_t kFieldCount = 5;
+
+  class PostingList final {
+   public:
+    std::vector<uint8_t> data;
+    uint32_t last_doc = 0;
+    uint32_t count = 0;
+
+    void Append(uint32_t doc, uint8_t fields);
+  };
+
+  class Document final {
+   public:
+    std::shared_ptr<Entry> entry;
+    std::array<std::string, kFieldCount> text;  ///< Case folded text.
+  };
+
+  std::vector<Document> docs_;
+  std::unordered_map<const Entry*, uint32_t> doc_ids_;
+  std::unordered_map<uint32_t, PostingList> postings_;
+  std::size_t removed_ = 0;
+  bool index_notes_ = true;
+
+  std::vector<std::pair<uint32_t, uint8_t>> Candidates(
+      const std::string& term) const;
+  void Compact();
+
+ public:
+  void Build(const Bands& bands);
+  void Clear();
+
+  /**
+   * Updates the index to reflect a new set of entries, indexing entries not
+   * seen before and dropping entries no longer present. Entries are compared
+   * by identity, so unchanged entries kept across a reload are not
+   * reindexed.
+   */
+  void Update(const Bands& bands);
+
+  void Add(const std::shared_ptr<Entry>& entry);
+  void Remove(const std::shared_ptr<Entry>& entry);
+
+  /**
+   * Whether to index the notes of the entries added from now on, which
+   * decrypts their details. Enabled by default.
+   */
+  void set_index_notes(bool index_notes) { index_notes_ = index_notes; }
+  bool index_notes() const { return index_notes_; }
+
+  /**
+   * Searches for entries containing all whitespace separated terms of a
+   * query. Matches are ranked by the fields they occur in, with title
+   * matches ranked highest, and by whether terms match whole fields or the
+   * start of words.
+   * @param [in] query Query string.
+   * @param [in] limit Maximum number of hits to return, zero for no limit.
+   * @param [in] mode Whether terms must match at the start of words.
+   * @return Matching entries, best matches first.
+   */
+  std::vector<Hit> Search(const std::string& query, std::size_t limit = 0,
+                          Mode mode = Mode::kSubstring) const;
+
+  /**
+   * @return The number of indexed entries.
+   */
+  std::size_t size() const { return doc_ids_.size(); }
+  /**
+   * @return The size in bytes of the compressed posting lists.
+   */
+  std::size_t posting_bytes() const;
+};
+
+}   // namespace onepass
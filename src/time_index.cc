@@ -0,0 +1,191 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "time_index.hh"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+namespace onepass {
+
+void TimeIndex::Build(const Folders& folders, const Bands& bands) {
+  Clear();
+  for (const auto& folder : folders.folders())
+    Add(folder);
+  for (const auto& entry : bands.entries())
+    Add(entry);
+}
+
+TimeIndex::TimeIndex(const TimeIndex& other) :
+    by_transaction_(other.by_transaction_),
+    by_modification_(other.by_modification_),
+    folders_by_transaction_(other.folders_by_transaction_) {
+  Relink();
+}
+
+TimeIndex& TimeIndex::operator=(const TimeIndex& other) {
+  if (this != &other) {
+    by_transaction_ = other.by_transaction_;
+    by_modification_ = other.by_modification_;
+    folders_by_transaction_ = other.folders_by_transaction_;
+    Relink();
+  }
+  return *this;
+}
+
+void TimeIndex::Relink() {
+  entries_.clear();
+  folders_.clear();
+  for (auto it = by_transaction_.begin(); it != by_transaction_.end(); ++it)
+    entries_[it->item.get()].first = it;
+  for (auto it = by_modification_.begin(); it != by_modification_.end(); ++it)
+    entries_[it->item.get()].second = it;
+  for (auto it = folders_by_transaction_.begin();
+       it != folders_by_transaction_.end(); ++it)
+    folders_[it->item.get()] = it;
+}
+
+void TimeIndex::Clear() {
+  by_transaction_.clear();
+  by_modification_.clear();
+  folders_by_transaction_.clear();
+  entries_.clear();
+  folders_.clear();
+}
+
+void TimeIndex::Update(const Folders& folders, const Bands& bands) {
+  std::unordered_set<const void*> current;
+  for (const auto& folder : folders.folders())
+    current.insert(folder.get());
+  for (const auto& entry : bands.entries())
+    current.insert(entry.get());
+
+  std::vector<std::shared_ptr<Folder>> stale_folders;
+  for (const auto& folder : folders_) {
+    if (current.count(folder.first) == 0)
+      stale_folders.push_back(folder.second->item);
+  }
+  std::vector<std::shared_ptr<Entry>> stale_entries;
+  for (const auto& entry : entries_) {
+    if (current.count(entry.first) == 0)
+      stale_entries.push_back(entry.second.first->item);
+  }
+
+  for (const auto& folder : stale_folders)
+    Remove(folder);
+  for (const auto& entry : stale_entries)
+    Remove(entry);
+  for (const auto& folder : folders.folders())
+    Add(folder);
+  for (const auto& entry : bands.entries())
+    Add(entry);
+}
+
+void TimeIndex::Add(const std::shared_ptr<Entry>& entry) {
+  if (entries_.count(entry.get()) != 0)
+    return;
+
+  Record<Entry> transaction = { entry->transaction_time(), entry->uuid(),
+                                entry };
+  Record<Entry> modification = { entry->modification_time(), entry->uuid(),
+                                 entry };
+  entries_[entry.get()] = std::make_pair(
+      by_transaction_.insert(transaction).first,
+      by_modification_.insert(modification).first);
+}
+
+void TimeIndex::Remove(const std::shared_ptr<Entry>& entry) {
+  auto it = entries_.find(entry.get());
+  if (it == entries_.end())
+    return;
+
+  by_transaction_.erase(it->second.first);
+  by_modification_.erase(it->second.second);
+  entries_.erase(it);
+}
+
+void TimeIndex::Add(const std::shared_ptr<Folder>& folder) {
+  if (folders_.count(folder.get()) != 0)
+    return;
+
+  Record<Folder> record = { folder->transaction_time(), folder->uuid(),
+                            folder };
+  folders_[folder.get()] = folders_by_transaction_.insert(record).first;
+}
+
+void TimeIndex::Remove(const std::shared_ptr<Folder>& folder) {
+  auto it = folders_.find(folder.get());
+  if (it == folders_.end())
+    return;
+
+  folders_by_transaction_.erase(it->second);
+  folders_.erase(it);
+}
+
+std::vector<std::shared_ptr<Entry>> TimeIndex::Between(
+    Field field, std::time_t first, std::time_t last) const {
+  const EntrySet& set = field == Field::kTransaction ? by_transaction_ :
+                                                       by_modification_;
+
+  // The nil UUID sorts before all others with the same time.
+  Record<Entry> lower = { first, Uuid(), nullptr };
+
+  std::vector<std::shared_ptr<Entry>> entries;
+  for (auto it = set.lower_bound(lower); it != set.end() && it->time < last;
+       ++it) {
+    entries.push_back(it->item);
+  }
+  return entries;
+}
+
+TimeIndex::Changes TimeIndex::ChangedSince(std::time_t watermark,
+                                           std::time_t read_time) const {
+  std::time_t latest = watermark;
+
+  std::vector<std::shared_ptr<Entry>> entries =
+      Between(Field::kTransaction, watermark + 1,
+              std::numeric_limits<std::time_t>::max());
+  if (!entries.empty())
+    latest = std::max(latest, entries.back()->transaction_time());
+
+  std::vector<std::shared_ptr<Folder>> folders;
+  Record<Folder> lower = { watermark + 1, Uuid(), nullptr };
+  for (auto it = folders_by_transaction_.lower_bound(lower);
+       it != folders_by_transaction_.end(); ++it) {
+    folders.push_back(it->item);
+    latest = std::max(latest, it->time);
+  }
+
+  // Items written later in the second the vault was read get the same
+  // transaction time as the items just seen, keep the watermark below that
+  // second so that the next call reports them.
+  latest = std::max(watermark, std::min(latest, read_time - 1));
+  return Changes(std::move(entries), std::move(folders), latest);
+}
+
+std::time_t TimeIndex::watermark() const {
+  std::time_t latest = 0;
+  if (!by_transaction_.empty())
+    latest = by_transaction_.rbegin()->time;
+  if (!folders_by_transaction_.empty())
+    latest = std::max(latest, folders_by_transaction_.rbegin()->time);
+  return latest;
+}
+
+}   // namespace onepass
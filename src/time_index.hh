@@ -0,0 +1,154 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <ctime>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bands.hh"
+#include "folders.hh"
+
+namespace onepass {
+
+/**
+ * Entries ordered by transaction and modification time, and folders ordered
+ * by transaction time. The transaction time increases with every change
+ * written to the vault, which makes it usable as a watermark for finding
+ * what changed since a previous sync.
+ */
+class TimeIndex final {
+ public:
+  enum class Field {
+    kTransaction,
+    kModification
+  };
+
+  class Changes final {
+   private:
+    std::vector<std::shared_ptr<Entry>> entries_;
+    std::vector<std::shared_ptr<Folder>> folders_;
+    std::time_t watermark_;
+
+   public:
+    Changes(std::vector<std::shared_ptr<Entry>> entries,
+            std::vector<std::shared_ptr<Folder>> folders,
+            std::time_t watermark) :
+        entries_(std::move(entries)), folders_(std::move(folders)),
+        watermark_(watermark) {}
+
+    /**
+     * @return Changed entries, in transaction order.
+     */
+    const std::vector<std::shared_ptr<Entry>>& entries() const {
+      return entries_;
+    }
+    /**
+     * @return Changed folders, in transaction order.
+     */
+    const std::vector<std::shared_ptr<Folder>>& folders() const {
+      return folders_;
+    }
+    /**
+     * @return The watermark to pass on the next call, the latest
+     *         transaction time seen but at most the second before the vault
+     *         was read.
+     */
+    std::time_t watermark() const { return watermark_; }
+  };
+
+ private:
+  template <typename T>
+  class Record final {
+   public:
+    std::time_t time;
+    Uuid uuid;
+    std::shared_ptr<T> item;
+
+    bool operator<(const Record& other) const {
+      return time < other.time || (time == other.time && uuid < other.uuid);
+    }
+  };
+
+  typedef std::set<Record<Entry>> EntrySet;
+  typedef std::set<Record<Folder>> FolderSet;
+
+  EntrySet by_transaction_;
+  EntrySet by_modification_;
+  FolderSet folders_by_transaction_;
+  std::unordered_map<const Entry*,
+                     std::pair<EntrySet::const_iterator,
+                               EntrySet::const_iterator>> entries_;
+  std::unordered_map<const Folder*, FolderSet::const_iterator> folders_;
+
+  void Relink();
+
+ public:
+  TimeIndex() = default;
+  /**
+   * Copies the index. The lookup of records by item is rebuilt to refer to
+   * the copy.
+   */
+  TimeIndex(const TimeIndex& other);
+  TimeIndex& operator=(const TimeIndex& other);
+
+  void Build(const Folders& folders, const Bands& bands);
+  void Clear();
+
+  /**
+   * Updates the index to reflect a new set of folders and entries. Items are
+   * compared by identity, like TextIndex::Update.
+   */
+  void Update(const Folders& folders, const Bands& bands);
+
+  void Add(const std::shared_ptr<Entry>& entry);
+  void Remove(const std::shared_ptr<Entry>& entry);
+  void Add(const std::shared_ptr<Folder>& folder);
+  void Remove(const std::shared_ptr<Folder>& folder);
+
+  /**
+   * @return Entries with a time within [first, last), in time order.
+   */
+  std::vector<std::shared_ptr<Entry>> Between(Field field, std::time_t first,
+                                              std::time_t last) const;
+
+  /**
+   * Transaction times have a resolution of one second, so items written in
+   * the second the vault was read may be missing from the index and still
+   * share the transaction time of items in it. The returned watermark never
+   * reaches that second, which means the items changed in it are reported
+   * again by the next call. Callers need to tolerate seeing such items
+   * twice, for example by comparing their HMAC.
+   * @param [in] watermark Transaction time of the last change seen, zero
+   *                       for all items.
+   * @param [in] read_time Time the indexed vault files were read.
+   * @return Entries and folders with a transaction time after
+   *         @a watermark.
+   */
+  Changes ChangedSince(std::time_t watermark, std::time_t read_time) const;
+
+  /**
+   * @return The latest transaction time of any entry or folder.
+   */
+  std::time_t watermark() const;
+};
+
+}   // namespace onepass
@@ -0,0 +1,251 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "url.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "exception.hh"
+
+namespace {
+
+// Public suffixes having more than one label. Single label suffixes need not
+// be listed since the public suffix algorithm treats any top level domain as
+// a public suffix.
+const char* const kBuiltinSuffixRules[] = {
+  // ICANN.
+  "ac.uk", "co.uk", "gov.uk", "ltd.uk", "me.uk", "net.uk", "nhs.uk",
+  "org.uk", "plc.uk", "police.uk", "sch.uk",
+  "asn.au", "com.au", "edu.au", "gov.au", "id.au", "net.au", "org.au",
+  "ac.nz", "co.nz", "geek.nz", "gen.nz", "govt.nz", "net.nz", "org.nz",
+  "school.nz",
+  "ac.jp", "co.jp", "ed.jp", "go.jp", "gr.jp", "lg.jp", "ne.jp", "or.jp",
+  "ac.kr", "co.kr", "go.kr", "ne.kr", "or.kr", "re.kr",
+  "com.br", "edu.br", "gov.br", "net.br", "org.br",
+  "com.cn", "edu.cn", "gov.cn", "net.cn", "org.cn",
+  "com.hk", "edu.hk", "gov.hk", "net.hk", "org.hk",
+  "com.tw", "edu.tw", "gov.tw", "net.tw", "org.tw",
+  "ac.in", "co.in", "edu.in", "gov.in", "net.in", "org.in",
+  "ac.za", "co.za", "gov.za", "net.za", "org.za",
+  "ac.il", "co.il", "gov.il", "net.il", "org.il",
+  "com.ar", "com.co", "com.mx", "com.my", "com.pe", "com.ph", "com.pk",
+  "com.sa", "com.sg", "com.tr", "com.ua", "com.vn", "co.id", "co.th",
+  "ac.at", "co.at", "gv.at", "or.at",
+  "com.es", "nom.es", "org.es",
+  "com.pl", "net.pl", "org.pl",
+  "com.ru", "net.ru", "org.ru",
+  "*.ck", "!www.ck", "*.bd", "*.er", "*.fk", "*.jm", "*.kh", "*.mm", "*.np",
+  "*.pg",
+  // Private domains.
+  "appspot.com", "azurewebsites.net", "blogspot.com", "cloudapp.net",
+  "cloudfront.net", "elasticbeanstalk.com", "firebaseapp.com", "github.io",
+  "gitlab.io", "herokuapp.com", "netlify.app", "pages.dev",
+  "s3.amazonaws.com", "vercel.app", "web.app", "workers.dev",
+};
+
+std::string ToLower(std::string str) {
+  for (char& c : str) {
+    if (c >= 'A' && c <= 'Z')
+      c = static_cast<char>(c - 'A' + 'a');
+  }
+  return str;
+}
+
+uint16_t DefaultPort(const std::string& scheme) {
+  if (scheme == "http")
+    return 80;
+  if (scheme == "https")
+    return 443;
+  if (scheme == "ftp")
+    return 21;
+  if (scheme == "ssh" || scheme == "sftp")
+    return 22;
+  return 0;
+}
+
+/**
+ * @return Position of the first label of @a host ending at @a end, where
+ *         @a end is either the size of @a host or the position of a dot.
+ */
+std::string::size_type LabelStart(const std::string& host,
+                                  std::string::size_type end) {
+  std::string::size_type dot = end == 0 ?
+      std::string::npos : host.rfind('.', end - 1);
+  return dot == std::string::npos ? 0 : dot + 1;
+}
+
+} // namespace
+
+namespace onepass {
+
+Url::Url(const std::string& url) {
+  std::string::size_type first = url.find_first_not_of(" \t\r\n");
+  std::string::size_type last = url.find_last_not_of(" \t\r\n");
+  if (first == std::string::npos)
+    return;
+
+  std::string str = url.substr(first, last - first + 1);
+
+  std::string::size_type pos = 0;
+  std::string::size_type scheme_end = str.find("://");
+  if (scheme_end != std::string::npos &&
+      str.find_first_of("/?#") > scheme_end) {
+    scheme_ = ToLower(str.substr(0, scheme_end));
+    pos = scheme_end + 3;
+  }
+
+  std::string::size_type authority_end = str.find_first_of("/?#", pos);
+  if (authority_end == std::string::npos)
+    authority_end = str.size();
+
+  std::string authority = str.substr(pos, authority_end - pos);
+  path_ = str.substr(authority_end);
+
+  std::string::size_type at = authority.rfind('@');
+  if (at != std::string::npos)
+    authority = authority.substr(at + 1);
+
+  std::string::size_type port_sep = std::string::npos;
+  if (!authority.empty() && authority[0] == '[') {
+    std::string::size_type bracket = authority.find(']');
+    if (bracket != std::string::npos && bracket + 1 < authority.size() &&
+        authority[bracket + 1] == ':') {
+      port_sep = bracket + 1;
+    }
+  } else {
+    port_sep = authority.rfind(':');
+  }
+
+  if (port_sep != std::string::npos) {
+    std::string port = authority.substr(port_sep + 1);
+    authority = authority.substr(0, port_sep);
+
+    // An empty port means the default port. Anything else that is not a
+    // port number makes the URL invalid, it must not match the host on its
+    // default port.
+    if (!port.empty()) {
+      unsigned long value = 0;
+      for (char c : port) {
+        if (c < '0' || c > '9' || value > 0xffff) {
+          value = 0;
+          break;
+        }
+        value = value * 10 + static_cast<unsigned long>(c - '0');
+      }
+      if (value == 0 || value > 0xffff) {
+        scheme_.clear();
+        path_.clear();
+        return;
+      }
+      port_ = static_cast<uint16_t>(value);
+    }
+  }
+
+  while (!authority.empty() && authority.back() == '.')
+    authority.pop_back();
+
+  host_ = ToLower(authority);
+  if (port_ == DefaultPort(scheme_))
+    port_ = 0;
+}
+
+bool Url::IsAddress() const {
+  if (!host_.empty() && host_[0] == '[')
+    return true;
+
+  return !host_.empty() &&
+      host_.find_first_not_of("0123456789.") == std::string::npos;
+}
+
+PublicSuffixList::PublicSuffixList() {
+  for (const char* rule : kBuiltinSuffixRules)
+    AddRule(rule);
+}
+
+void PublicSuffixList::AddRule(const std::string& rule) {
+  if (rule.empty())
+    return;
+
+  if (rule[0] == '!') {
+    exceptions_.insert(ToLower(rule.substr(1)));
+  } else if (rule.compare(0, 2, "*.") == 0) {
+    wildcards_.insert(ToLower(rule.substr(2)));
+  } else {
+    rules_.insert(ToLower(rule));
+  }
+}
+
+void PublicSuffixList::Load(const std::string& path) {
+  std::ifstream src(path, std::ios::in | std::ios::binary);
+  if (!src.is_open())
+    throw FileNotFoundError();
+
+  rules_.clear();
+  wildcards_.clear();
+  exceptions_.clear();
+
+  std::string line;
+  while (std::getline(src, line)) {
+    if (line.compare(0, 2, "//") == 0)
+      continue;
+
+    std::istringstream tokens(line);
+    std::string rule;
+    if (tokens >> rule)
+      AddRule(rule);
+  }
+}
+
+std::string PublicSuffixList::PublicSuffix(const std::string& host) const {
+  // Walk the suffixes of the host from the longest to the shortest, the
+  // first matching rule is the prevailing one.
+  for (std::string::size_type start = 0; start < host.size();) {
+    std::string::size_type dot = host.find('.', start);
+    std::string suffix = host.substr(start);
+
+    if (exceptions_.count(suffix) != 0)
+      return dot == std::string::npos ? std::string() : host.substr(dot + 1);
+    if (rules_.count(suffix) != 0)
+      return suffix;
+    if (dot != std::string::npos && wildcards_.count(host.substr(dot + 1)))
+      return suffix;
+
+    if (dot == std::string::npos)
+      break;
+    start = dot + 1;
+  }
+
+  // The default rule makes the last label a public suffix.
+  return host.substr(LabelStart(host, host.size()));
+}
+
+std::string PublicSuffixList::RegistrableDomain(const std::string& host) const {
+  std::string suffix = PublicSuffix(host);
+  if (suffix.size() >= host.size())
+    return std::string();
+
+  std::string::size_type suffix_start = host.size() - suffix.size();
+  if (suffix_start == 0 || host[suffix_start - 1] != '.')
+    return std::string();
+
+  return host.substr(LabelStart(host, suffix_start - 1));
+}
+
+}   // namespace onepass
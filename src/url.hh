@@ -0,0 +1,101 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace onepass {
+
+/**
+ * Normalized URL, as used for matching entries against web pages.
+ */
+class Url final {
+ private:
+  std::string scheme_;
+  std::string host_;
+  uint16_t port_ = 0;
+  std::string path_;
+
+ public:
+  Url() = default;
+  /**
+   * Parses and normalizes an URL. The scheme and host are converted to lower
+   * case, user information and trailing dots are removed and ports equal to
+   * the default port of the scheme are dropped. URLs without a scheme, such
+   * as "www.example.com", are accepted and leave the scheme empty. URLs
+   * with an invalid port are left empty.
+   * @param [in] url URL to parse.
+   */
+  explicit Url(const std::string& url);
+
+  const std::string& scheme() const { return scheme_; }
+  const std::string& host() const { return host_; }
+  /**
+   * @return The port, or zero if the URL uses the default port of its
+   *         scheme.
+   */
+  uint16_t port() const { return port_; }
+  const std::string& path() const { return path_; }
+
+  bool empty() const { return host_.empty(); }
+  /**
+   * @return true if the host is an IPv4 or IPv6 address, false otherwise.
+   */
+  bool IsAddress() const;
+};
+
+/**
+ * Set of public suffix rules, in the format of the list maintained at
+ * https://publicsuffix.org/. A built-in set of the most common multi-label
+ * suffixes is used unless a full list is loaded.
+ */
+class PublicSuffixList final {
+ private:
+  std::unordered_set<std::string> rules_;
+  std::unordered_set<std::string> wildcards_;
+  std::unordered_set<std::string> exceptions_;
+
+  void AddRule(const std::string& rule);
+
+ public:
+  PublicSuffixList();
+
+  /**
+   * Replaces the current rules with the rules from a public suffix list file.
+   * @param [in] path Path to the list file.
+   */
+  void Load(const std::string& path);
+
+  /**
+   * @param [in] host Normalized host name.
+   * @return The public suffix of @a host, such as "co.uk" for
+   *         "www.example.co.uk".
+   */
+  std::string PublicSuffix(const std::string& host) const;
+
+  /**
+   * @param [in] host Normalized host name.
+   * @return The registrable domain of @a host, that is the public suffix
+   *         plus one label, or an empty string if @a host is a public suffix.
+   */
+  std::string RegistrableDomain(const std::string& host) const;
+};
+
+}   // namespace onepass
@@ -0,0 +1,310 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "url_index.hh"
+
+#include <algorithm>
+#include <set>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+
+#include "util.hh"
+
+namespace {
+
+/**
+ * Splits a host name into its labels, starting with the top level domain.
+ */
+std::vector<std::string> ReversedLabels(const std::string& host) {
+  std::vector<std::string> labels;
+
+  std::string::size_type end = host.size();
+  while (true) {
+    std::string::size_type dot = end == 0 ?
+        std::string::npos : host.rfind('.', end - 1);
+    std::string::size_type start = dot == std::string::npos ? 0 : dot + 1;
+    labels.push_back(host.substr(start, end - start));
+
+    if (dot == std::string::npos)
+      break;
+    end = dot;
+  }
+
+  return labels;
+}
+
+bool IsWebScheme(const std::string& scheme) {
+  return scheme == "http" || scheme == "https";
+}
+
+bool IsCompatibleScheme(const std::string& entry_scheme,
+                        const std::string& page_scheme) {
+  return entry_scheme.empty() || page_scheme.empty() ||
+      entry_scheme == page_scheme ||
+      (IsWebScheme(entry_scheme) && IsWebScheme(page_scheme));
+}
+
+} // namespace
+
+namespace onepass {
+
+void UrlIndex::LoadPublicSuffixList(const std::string& path) {
+  suffixes_.Load(path);
+}
+
+void UrlIndex::Insert(const Url& url, const std::shared_ptr<Entry>& entry,
+                      std::size_t order) {
+  Node* node = &root_;
+  for (const auto& label : ReversedLabels(url.host())) {
+    std::shared_ptr<Node>& child = node->children[label];
+    if (!child)
+      child = std::make_shared<Node>();
+    node = child.get();
+  }
+
+  node->postings.push_back(Posting { entry, url.scheme(), url.port(), order });
+  ++size_;
+}
+
+void UrlIndex::Build(const Bands& bands) {
+  Clear();
+
+  std::size_t order = 0;
+  for (const auto& entry : bands.entries()) {
+    // An entry commonly lists its main URL among the additional ones too.
+    std::set<std::tuple<std::string, std::string, uint16_t>> seen;
+
+    auto insert = [&](const std::string& str) {
+      Url url(str);
+      if (url.empty())
+        return;
+      if (seen.insert(std::make_tuple(url.host(), url.scheme(),
+                                      url.port())).second) {
+        Insert(url, entry, order);
+      }
+    };
+
+    insert(entry->url());
+    for (const auto& url : entry->urls())
+      insert(url.second);
+
+    ++order;
+  }
+}
+
+void UrlIndex::Clear() {
+  root_.children.clear();
+  root_.postings.clear();
+  size_ = 0;
+}
+
+std::vector<UrlIndex::Match> UrlIndex::Find(const std::string& url) const {
+  std::vector<Match> matches;
+
+  Url page(url);
+  if (page.empty())
+    return matches;
+
+  std::vector<std::string> labels = ReversedLabels(page.host());
+
+  // Addresses and hosts without a registrable domain, such as "localhost",
+  // only match exactly.
+  std::size_t domain_depth = labels.size();
+  bool exact_only = true;
+  if (!page.IsAddress()) {
+    std::string domain = suffixes_.RegistrableDomain(page.host());
+    if (!domain.empty()) {
+      domain_depth = std::count(domain.begin(), domain.end(), '.') + 1;
+      exact_only = false;
+    }
+  }
+
+  // Nodes along the page host, path[i] being at depth i + 1.
+  std::vector<const Node*> path;
+  const Node* node = &root_;
+  for (const auto& label : labels) {
+    auto it = node->children.find(label);
+    if (it == node->children.end())
+      break;
+
+    node = it->second.get();
+    path.push_back(node);
+  }
+
+  if (path.size() < domain_depth)
+    return matches;
+
+  std::vector<std::size_t> orders;
+  std::unordered_map<const Entry*, std::size_t> positions;
+  auto add = [&](const Posting& posting, Match::Quality quality) {
+    if (posting.port != page.port() ||
+        !IsCompatibleScheme(posting.scheme, page.scheme())) {
+      return;
+    }
+
+    Match match(posting.entry, quality, posting.scheme == page.scheme());
+
+    auto it = positions.find(posting.entry.get());
+    if (it == positions.end()) {
+      positions.insert(std::make_pair(posting.entry.get(), matches.size()));
+      matches.push_back(match);
+      orders.push_back(posting.order);
+    } else {
+      const Match& prev = matches[it->second];
+      if (std::make_pair(quality, match.same_scheme()) >
+          std::make_pair(prev.quality(), prev.same_scheme())) {
+        matches[it->second] = match;
+      }
+    }
+  };
+
+  // Entries for the page host and its parent domains.
+  for (std::size_t depth = domain_depth; depth <= path.size(); ++depth) {
+    Match::Quality quality = depth == labels.size() ?
+        Match::Quality::kExactHost : Match::Quality::kParentDomain;
+    for (const auto& posting : path[depth - 1]->postings)
+      add(posting, quality);
+  }
+
+  // Entries for other subdomains of the registrable domain.
+  std::vector<std::tuple<const Node*, std::size_t, bool>> stack;
+  if (!exact_only) {
+    stack.push_back(std::make_tuple(path[domain_depth - 1], domain_depth,
+                                    true));
+  }
+  while (!stack.empty()) {
+    const Node* cur = std::get<0>(stack.back());
+    std::size_t depth = std::get<1>(stack.back());
+    bool on_path = std::get<2>(stack.back());
+    stack.pop_back();
+
+    if (!on_path) {
+      for (const auto& posting : cur->postings)
+        add(posting, Match::Quality::kSameDomain);
+    }
+
+    for (const auto& child : cur->children) {
+      bool child_on_path = on_path && depth < path.size() &&
+          path[depth] == child.second.get();
+      stack.push_back(std::make_tuple(child.second.get(), depth + 1,
+                                      child_on_path));
+    }
+  }
+
+  std::vector<std::size_t> ranks(matches.size());
+  for (std::size_t i = 0; i < ranks.size(); ++i)
+    ranks[i] = i;
+
+  std::sort(ranks.begin(), ranks.end(), [&](std::size_t a, std::size_t b) {
+    const Match& lhs = matches[a];
+    const Match& rhs = matches[b];
+    if (lhs.quality() != rhs.quality())
+      return lhs.quality() > rhs.quality();
+    if (lhs.same_scheme() != rhs.same_scheme())
+      return lhs.same_scheme();
+    return orders[a] < orders[b];
+  });
+
+  std::vector<Match> sorted;
+  sorted.reserve(matches.size());
+  for (std::size_t rank : ranks)
+    sorted.push_back(matches[rank]);
+
+  return sorted;
+}
+
+std::vector<std::vector<UrlIndex::Match>> UrlIndex::Find(
+    const std::vector<std::string>& urls) const {
+  std::vector<std::vector<Match>> matches;
+  matches.reserve(urls.size());
+
+  // Tabs commonly share pages, only resolve each distinct URL once.
+  std::unordered_map<std::string, std::size_t> resolved;
+  for (const auto& url : urls) {
+    auto it = resolved.find(url);
+    if (it != resolved.end()) {
+      std::vector<Match> copy = matches[it->second];
+      matches.push_back(copy);
+    } else {
+      resolved.insert(std::make_pair(url, matches.size()));
+      matches.push_back(Find(url));
+    }
+  }
+
+  return matches;
+}
+
+std::vector<std::shared_ptr<Entry>> UrlIndex::FindHosts(
+    const std::string& pattern) const {
+  std::vector<std::shared_ptr<Entry>> entries;
+
+  // The labels following the last wildcard are matched literally, they
+  // select the subtree holding all possible matches.
+  std::string suffix = pattern;
+  std::string::size_type wildcard = pattern.find_last_of("*?");
+  if (wildcard != std::string::npos) {
+    std::string::size_type dot = pattern.find('.', wildcard);
+    suffix = dot == std::string::npos ? std::string() : pattern.substr(dot + 1);
+  }
+
+  const Node* start = &root_;
+  if (!suffix.empty()) {
+    for (const auto& label : ReversedLabels(suffix)) {
+      auto it = start->children.find(label);
+      if (it == start->children.end())
+        return entries;
+      start = it->second.get();
+    }
+  }
+
+  std::vector<std::pair<std::size_t, std::shared_ptr<Entry>>> found;
+  std::unordered_set<const Entry*> seen;
+  std::vector<std::pair<const Node*, std::string>> stack;
+  stack.push_back(std::make_pair(start, suffix));
+  while (!stack.empty()) {
+    const Node* node = stack.back().first;
+    std::string host = std::move(stack.back().second);
+    stack.pop_back();
+
+    if (!node->postings.empty() && GlobMatch(pattern, host)) {
+      for (const auto& posting : node->postings) {
+        if (seen.insert(posting.entry.get()).second)
+          found.push_back(std::make_pair(posting.order, posting.entry));
+      }
+    }
+
+    for (const auto& child : node->children) {
+      stack.push_back(std::make_pair(child.second.get(), host.empty() ?
+          child.first : child.first + "." + host));
+    }
+  }
+
+  std::sort(found.begin(), found.end(),
+            [](const std::pair<std::size_t, std::shared_ptr<Entry>>& lhs,
+               const std::pair<std::size_t, std::shared_ptr<Entry>>& rhs) {
+    return lhs.first < rhs.first;
+  });
+  entries.reserve(found.size());
+  for (const auto& match : found)
+    entries.push_back(match.second);
+
+  return entries;
+}
+
+}   // namespace onepass
@@ -0,0 +1,124 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bands.hh"
+#include "url.hh"
+
+namespace onepass {
+
+/**
+ * Index over the URLs of entries, answering which entries apply to a web
+ * page. Hosts are stored in a trie keyed by their labels in reverse order,
+ * so that all entries on a domain and its subdomains share a subtree.
+ */
+class UrlIndex final {
+ public:
+  class Match final {
+   public:
+    /**
+     * How the host of the entry URL relates to the host of the page, from
+     * the weakest to the strongest match.
+     */
+    enum class Quality {
+      kSameDomain = 1,  ///< Same registrable domain, different subdomain.
+      kParentDomain,    ///< The entry is for a parent domain of the page.
+      kExactHost
+    };
+
+   private:
+    std::shared_ptr<Entry> entry_;
+    Quality quality_;
+    bool same_scheme_;
+
+   public:
+    Match(const std::shared_ptr<Entry>& entry, Quality quality,
+          bool same_scheme) :
+        entry_(entry), quality_(quality), same_scheme_(same_scheme) {}
+
+    std::shared_ptr<Entry> entry() const { return entry_; }
+    Quality quality() const { return quality_; }
+    bool same_scheme() const { return same_scheme_; }
+  };
+
+ private:
+  class Posting final {
+   public:
+    std::shared_ptr<Entry> entry;
+    std::string scheme;
+    uint16_t port;
+    std::size_t order;
+  };
+
+  class Node final {
+   public:
+    std::unordered_map<std::string, std::shared_ptr<Node>> children;
+    std::vector<Posting> postings;
+  };
+
+  PublicSuffixList suffixes_;
+  Node root_;
+  std::size_t size_ = 0;
+
+  void Insert(const Url& url, const std::shared_ptr<Entry>& entry,
+              std::size_t order);
+
+ public:
+  /**
+   * Replaces the built-in public suffix rules with a list loaded from disk.
+   * Needs to be called before building the index.
+   */
+  void LoadPublicSuffixList(const std::string& path);
+
+  void Build(const Bands& bands);
+  void Clear();
+
+  /**
+   * Finds the entries applying to a page. Entries match when their host is
+   * within the registrable domain of the page host, the scheme is compatible
+   * (http entries are allowed on https pages and vice versa) and non-default
+   * ports are equal.
+   * @param [in] url Page URL.
+   * @return Matching entries, best matches first.
+   */
+  std::vector<Match> Find(const std::string& url) const;
+  std::vector<std::vector<Match>> Find(
+      const std::vector<std::string>& urls) const;
+
+  /**
+   * Finds the entries with a URL host matching a glob pattern, see
+   * GlobMatch. Only the hosts below the labels the pattern ends with are
+   * visited, so "*.example.com" does not look at other domains.
+   * @param [in] pattern Lower case pattern, such as "*.corp".
+   * @return Matching entries, in load order.
+   */
+  std::vector<std::shared_ptr<Entry>> FindHosts(
+      const std::string& pattern) const;
+
+  /**
+   * @return The number of indexed URLs.
+   */
+  std::size_t size() const { return size_; }
+};
+
+}   // namespace onepass
@@ -18,10 +18,138 @@
 
 #include "util.hh"
 
-#include <locale>
-
 #include "exception.hh"
 
+namespace {
+
+// Returns the position following the JSON string starting at pos.
+std::size_t SkipString(const std::string& json, std::size_t pos) {
+  for (++pos; pos < json.size(); ++pos) {
+    if (json[pos] == '\\')
+      ++pos;
+    else if (json[pos] == '"')
+      return pos + 1;
+  }
+  throw onepass::FormatError("Unterminated JSON string.");
+}
+
+std::size_t SkipSpace(const std::string& json, std::size_t pos) {
+  while (pos < json.size() &&
+         (json[pos] == ' ' || json[pos] == '\t' || json[pos] == '\n' ||
+          json[pos] == '\r'))
+    ++pos;
+  return pos;
+}
+
+// Returns the position following the JSON value starting at pos.
+std::size_t SkipValue(const std::string& json, std::size_t pos) {
+  int depth = 0;
+  while (pos < json.size()) {
+    char c = json[pos];
+    if (c == '"') {
+      pos = SkipString(json, pos);
+      if (depth == 0)
+        return pos;
+      continue;
+    }
+
+    if (c == '{' || c == '[') {
+      ++depth;
+    } else if (c == '}' || c == ']') {
+      // A closing bracket at depth zero ends the enclosing object instead.
+      if (depth == 0)
+        return pos;
+      if (--depth == 0)
+        return pos + 1;
+    } else if (depth == 0 && (c == ',' || c == ' ' || c == '\t' ||
+                              c == '\n' || c == '\r')) {
+      return pos;
+    }
+    ++pos;
+  }
+  return pos;
+}
+
+const int kEof = std::char_traits<char>::eof();
+
+bool IsSpace(int c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Returns the next character without consuming it, after skipping any
+// white space.
+int SkipSpace(std::streambuf& buf) {
+  int c = buf.sgetc();
+  while (IsSpace(c))
+    c = buf.snextc();
+  return c;
+}
+
+// Appends the JSON string following an already consumed opening quote to
+// out, as it appears in the source. The closing quote is consumed but not
+// appended.
+void ReadString(std::streambuf& buf, std::string& out) {
+  for (;;) {
+    int c = buf.sbumpc();
+    if (c == kEof)
+      throw onepass::FormatError("Unterminated JSON string.");
+    if (c == '"')
+      return;
+
+    out.push_back(static_cast<char>(c));
+    if (c == '\\') {
+      c = buf.sbumpc();
+      if (c == kEof)
+        throw onepass::FormatError("Unterminated JSON string.");
+      out.push_back(static_cast<char>(c));
+    }
+  }
+}
+
+// Appends the JSON value starting at the current position to out. The
+// character following the value is left unconsumed.
+void ReadValue(std::streambuf& buf, std::string& out) {
+  int depth = 0;
+  for (;;) {
+    int c = buf.sgetc();
+    if (c == kEof) {
+      if (depth > 0)
+        throw onepass::FormatError("Unterminated JSON value.");
+      return;
+    }
+
+    if (c == '"') {
+      buf.sbumpc();
+      out.push_back('"');
+      ReadString(buf, out);
+      out.push_back('"');
+      if (depth == 0)
+        return;
+      continue;
+    }
+
+    if (c == '}' || c == ']') {
+      // A closing bracket at depth zero ends the enclosing object instead.
+      if (depth == 0)
+        return;
+      out.push_back(static_cast<char>(c));
+      buf.sbumpc();
+      if (--depth == 0)
+        return;
+      continue;
+    }
+
+    if (c == '{' || c == '[')
+      ++depth;
+    else if (depth == 0 && (c == ',' || IsSpace(c)))
+      return;
+    out.push_back(static_cast<char>(c));
+    buf.sbumpc();
+  }
+}
+
+} // namespace
+
 namespace onepass {
 
 std::string ExtractJson(const std::string& text) {
@@ -36,36 +164,119 @@ std::string ExtractJson(const std::string& text) {
   return text.substr(start, end - start + 1);
 }
 
-std::array<uint8_t, 16> ParseUuid(const std::string hex) {
-  if (hex.size() != 32)
-    throw FormatError("Invalid UUID length.");
+std::string ExtractJsonMember(const std::string& json,
+                              const std::string& key) {
+  // Only strings directly within the outer object followed by a colon are
+  // member names, nested objects and string values are skipped.
+  int depth = 0;
+  std::size_t pos = 0;
+  while (pos < json.size()) {
+    char c = json[pos];
+    if (c != '"') {
+      if (c == '{' || c == '[')
+        ++depth;
+      else if (c == '}' || c == ']')
+        --depth;
+      ++pos;
+      continue;
+    }
+
+    std::size_t end = SkipString(json, pos);
+    if (depth == 1) {
+      std::size_t colon = SkipSpace(json, end);
+      if (colon < json.size() && json[colon] == ':' &&
+          end - pos - 2 == key.size() &&
+          json.compare(pos + 1, key.size(), key) == 0) {
+        std::size_t begin = SkipSpace(json, colon + 1);
+        return json.substr(begin, SkipValue(json, begin) - begin);
+      }
+    }
+    pos = end;
+  }
+  return std::string();
+}
+
+void ForEachJsonMember(
+    std::istream& src,
+    const std::function<bool(const std::string& key,
+                             const std::string& value)>& callback) {
+  std::streambuf& buf = *src.rdbuf();
 
-  std::array<uint8_t, 16> uuid = { 0 };
-  for (std::size_t i = 0, j = 0; i < hex.size(); i += 2, ++j) {
-    char c0 = std::tolower(hex[i], std::locale::classic());
-    char c1 = std::tolower(hex[i + 1], std::locale::classic());
+  // Skip the text preceding the object, such as the JavaScript wrapping of
+  // the 1Password files.
+  for (int c = buf.sbumpc(); c != '{'; c = buf.sbumpc()) {
+    if (c == kEof)
+      throw FormatError("Unable to extract JSON from JavaScript source.");
+  }
 
-    uint8_t v = 0;
-    if (c0 >= 'a' && c0 <= 'f') {
-      v = (static_cast<uint8_t>(c0 - 'a') + 10) * 16;
-    } else if (c0 >= '0' && c0 <= '9') {
-      v = static_cast<uint8_t>(c0 - '0') * 16;
-    } else {
-      throw FormatError("Unexpected character in UUID.");
+  // The key and value buffers are reused, only the member currently being
+  // reported is held in memory.
+  std::string key;
+  std::string value;
+  for (;;) {
+    int c = SkipSpace(buf);
+    if (c == ',') {
+      buf.sbumpc();
+      continue;
     }
+    if (c == '}')
+      return;
+    if (c != '"')
+      throw FormatError("Malformed JSON object.");
+
+    buf.sbumpc();
+    key.clear();
+    ReadString(buf, key);
+    if (SkipSpace(buf) != ':')
+      throw FormatError("Malformed JSON object.");
+
+    buf.sbumpc();
+    SkipSpace(buf);
+    value.clear();
+    ReadValue(buf, value);
+    if (!callback(key, value))
+      return;
+  }
+}
 
-    if (c1 >= 'a' && c1 <= 'f') {
-      v += (static_cast<uint8_t>(c1 - 'a') + 10);
-    } else if (c1 >= '0' && c1 <= '9') {
-      v += static_cast<uint8_t>(c1 - '0');
+bool GlobMatch(const std::string& pattern, const std::string& text) {
+  std::size_t p = 0, t = 0;
+  std::size_t star = std::string::npos, resume = 0;
+  while (t < text.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+      ++p;
+      ++t;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      resume = t;
+    } else if (star != std::string::npos) {
+      p = star + 1;
+      t = ++resume;
     } else {
-      throw FormatError("Unexpected character in UUID.");
+      return false;
     }
-
-    uuid[j] = v;
   }
+  while (p < pattern.size() && pattern[p] == '*')
+    ++p;
+  return p == pattern.size();
+}
 
-  return uuid;
+std::string FoldCase(const std::string& str) {
+  std::string folded(str);
+  for (std::size_t i = 0; i < folded.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(folded[i]);
+    if (c >= 'A' && c <= 'Z') {
+      folded[i] = static_cast<char>(c + ('a' - 'A'));
+    } else if (c == 0xc3 && i + 1 < folded.size()) {
+      // U+00C0 to U+00DE are the upper case Latin-1 letters, except for the
+      // multiplication sign U+00D7.
+      unsigned char n = static_cast<unsigned char>(folded[i + 1]);
+      if (n >= 0x80 && n <= 0x9e && n != 0x97)
+        folded[i + 1] = static_cast<char>(n + 0x20);
+      ++i;
+    }
+  }
+  return folded;
 }
 
 }   // namespace onepass
@@ -18,6 +18,8 @@
 
 #pragma once
 #include <array>
+#include <functional>
+#include <istream>
 #include <string>
 
 namespace onepass {
@@ -44,10 +46,50 @@ inline T clamp(T min, T max, T val) {
 std::string ExtractJson(const std::string& text);
 
 /**
- * Parses a string of 16 hexadecimal characters into a an UUID byte array.
- * @param [in] hex String of hexadecimal characters to parse.
- * @return UUID.
+ * Finds a member of the top level object in a JSON document without parsing
+ * the rest of the document.
+ * @param [in] json JSON document containing an object.
+ * @param [in] key Member name, compared exactly.
+ * @return JSON text of the member value, or an empty string if the object
+ *         has no such member.
+ * @throw FormatError If a string in @a json is unterminated.
  */
-std::array<uint8_t, 16> ParseUuid(const std::string hex);
+std::string ExtractJsonMember(const std::string& json, const std::string& key);
+
+/**
+ * Calls a function for each member of the top level object in a JSON
+ * document, in document order, without parsing the member values. The
+ * document is read incrementally, only the member being reported is held in
+ * memory. Text preceding the object, such as the JavaScript wrapping of the
+ * 1Password files, is skipped.
+ * @param [in] src Stream containing the document.
+ * @param [in] callback Called with the name, as it appears in the document,
+ *                      and the JSON text of the value of each member.
+ *                      Returns false to stop.
+ * @throw FormatError If @a src contains no object or the object is
+ *                    malformed.
+ */
+void ForEachJsonMember(
+    std::istream& src,
+    const std::function<bool(const std::string& key,
+                             const std::string& value)>& callback);
+
+/**
+ * Matches a string against a glob pattern.
+ * @param [in] pattern Pattern with "*" matching any sequence and "?" any
+ *                     single character, other characters match themselves.
+ * @param [in] text String to match.
+ * @return true if the whole of @a text matches @a pattern.
+ */
+bool GlobMatch(const std::string& pattern, const std::string& text);
+
+/**
+ * Folds the case of an UTF-8 string for case-insensitive comparison. Letters
+ * in the ASCII and Latin-1 ranges are folded, other characters are kept as
+ * is.
+ * @param [in] str UTF-8 string.
+ * @return Case folded @a str.
+ */
+std::string FoldCase(const std::string& str);
 
 }   // namespace onepass
@@ -0,0 +1,162 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uuid.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "exception.hh"
+
+namespace {
+
+#if defined(__SSE2__)
+
+/**
+ * Converts 16 hexadecimal characters into their nibble values.
+ * @param [in] chars Hexadecimal characters.
+ * @param [out] valid Set to zero if any character is not hexadecimal.
+ * @return Nibble values, one per byte.
+ */
+inline __m128i HexToNibbles(__m128i chars, int& valid) {
+  const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+  // Setting the 0x20 bit maps upper case letters to lower case.
+  const __m128i alpha = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)),
+                                     _mm_set1_epi8('a'));
+
+  // Unsigned range checks through signed compares, by biasing with 0x80.
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+  const __m128i is_digit = _mm_cmplt_epi8(_mm_xor_si128(digit, bias),
+                                          _mm_set1_epi8(-128 + 10));
+  const __m128i is_alpha = _mm_cmplt_epi8(_mm_xor_si128(alpha, bias),
+                                          _mm_set1_epi8(-128 + 6));
+
+  valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) == 0xffff;
+
+  return _mm_or_si128(
+      _mm_and_si128(is_digit, digit),
+      _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+/**
+ * Combines pairs of nibbles, where the first nibble is the high one, into
+ * bytes. The result is stored in the low 8 bits of each 16-bit lane.
+ */
+inline __m128i CombineNibbles(__m128i nibbles) {
+  const __m128i hi = _mm_slli_epi16(
+      _mm_and_si128(nibbles, _mm_set1_epi16(0x00ff)), 4);
+  const __m128i lo = _mm_srli_epi16(nibbles, 8);
+  return _mm_or_si128(hi, lo);
+}
+
+/**
+ * Converts 16 nibble values into upper case hexadecimal characters.
+ */
+inline __m128i NibblesToHex(__m128i nibbles) {
+  const __m128i is_alpha = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+  return _mm_add_epi8(
+      _mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+      _mm_and_si128(is_alpha, _mm_set1_epi8('A' - '0' - 10)));
+}
+
+#else
+
+inline int HexToNibble(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+#endif
+
+} // namespace
+
+namespace onepass {
+
+bool Uuid::IsNil() const {
+  for (uint8_t b : bytes_) {
+    if (b != 0)
+      return false;
+  }
+  return true;
+}
+
+std::string Uuid::ToString() const {
+  std::string hex(32, '0');
+
+#if defined(__SSE2__)
+  const __m128i src = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(bytes_.data()));
+  const __m128i hi = _mm_and_si128(_mm_srli_epi16(src, 4),
+                                   _mm_set1_epi8(0x0f));
+  const __m128i lo = _mm_and_si128(src, _mm_set1_epi8(0x0f));
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&hex[0]),
+                   NibblesToHex(_mm_unpacklo_epi8(hi, lo)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&hex[16]),
+                   NibblesToHex(_mm_unpackhi_epi8(hi, lo)));
+#else
+  static const char kHex[] = "0123456789ABCDEF";
+  for (std::size_t i = 0; i < bytes_.size(); ++i) {
+    hex[i * 2] = kHex[bytes_[i] >> 4];
+    hex[i * 2 + 1] = kHex[bytes_[i] & 0x0f];
+  }
+#endif
+
+  return hex;
+}
+
+Uuid ParseUuid(const std::string& hex) {
+  if (hex.size() != 32)
+    throw FormatError("Invalid UUID length.");
+
+  std::array<uint8_t, 16> bytes;
+
+#if defined(__SSE2__)
+  int valid0 = 0, valid1 = 0;
+  const __m128i nibbles0 = HexToNibbles(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex.data())), valid0);
+  const __m128i nibbles1 = HexToNibbles(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex.data() + 16)),
+      valid1);
+  if (!valid0 || !valid1)
+    throw FormatError("Unexpected character in UUID.");
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes.data()),
+                   _mm_packus_epi16(CombineNibbles(nibbles0),
+                                    CombineNibbles(nibbles1)));
+#else
+  for (std::size_t i = 0; i < bytes.size(); ++i) {
+    int hi = HexToNibble(hex[i * 2]);
+    int lo = HexToNibble(hex[i * 2 + 1]);
+    if (hi < 0 || lo < 0)
+      throw FormatError("Unexpected character in UUID.");
+
+    bytes[i] = static_cast<uint8_t>((hi << 4) | lo);
+  }
+#endif
+
+  return Uuid(bytes);
+}
+
+}   // namespace onepass
@@ -0,0 +1,86 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace onepass {
+
+/**
+ * 128-bit UUID value, as used for identifying profiles, folders and entries.
+ */
+class Uuid final {
+ private:
+  std::array<uint8_t, 16> bytes_ = { { 0 } };
+
+ public:
+  Uuid() = default;
+  explicit Uuid(const std::array<uint8_t, 16>& bytes) : bytes_(bytes) {}
+
+  const std::array<uint8_t, 16>& bytes() const { return bytes_; }
+
+  /**
+   * @return true if all bits of the UUID are zero, false otherwise.
+   */
+  bool IsNil() const;
+
+  /**
+   * Formats the UUID as 32 upper case hexadecimal characters, which is the
+   * form used in the 1Password database files.
+   * @return UUID string.
+   */
+  std::string ToString() const;
+
+  std::size_t Hash() const {
+    // UUIDs in 1Password databases are random, so folding the two halves
+    // gives a well distributed hash.
+    uint64_t lo = 0, hi = 0;
+    std::memcpy(&lo, bytes_.data(), sizeof(lo));
+    std::memcpy(&hi, bytes_.data() + sizeof(lo), sizeof(hi));
+    return static_cast<std::size_t>(lo ^ (hi * 0x9e3779b97f4a7c15ull));
+  }
+
+  bool operator==(const Uuid& other) const { return bytes_ == other.bytes_; }
+  bool operator!=(const Uuid& other) const { return bytes_ != other.bytes_; }
+  bool operator<(const Uuid& other) const { return bytes_ < other.bytes_; }
+};
+
+/**
+ * Parses a string of 32 hexadecimal characters into an UUID.
+ * @param [in] hex String of hexadecimal characters to parse.
+ * @return UUID.
+ * @throw FormatError If @a hex is not a valid UUID string.
+ */
+Uuid ParseUuid(const std::string& hex);
+
+}   // namespace onepass
+
+namespace std {
+
+template <>
+struct hash<onepass::Uuid> {
+  std::size_t operator()(const onepass::Uuid& uuid) const {
+    return uuid.Hash();
+  }
+};
+
+}   // namespace std
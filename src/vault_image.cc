@@ -0,0 +1,355 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "vault_image.hh"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#include "exception.hh"
+#include "mapped_file.hh"
+#include "profile.hh"
+
+namespace {
+
+const char kMagic[8] = { 'O', 'P', 'V', 'I', 'M', 'G', '\0', '\0' };
+constexpr uint32_t kVersion = 3;
+constexpr std::size_t kSealSize = 32;
+// The bands followed by the folders file.
+constexpr std::size_t kFileCount = onepass::Bands::kBandCount + 1;
+const std::string kSealContext = "onepass vault image";
+
+class FingerprintRecord final {
+ public:
+  uint64_t exists;
+  uint64_t size;
+  int64_t modification_time;
+  uint64_t hash;
+  int64_t checked_time;
+};
+
+class Header final {
+ public:
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_count;
+  uint64_t folders_offset;
+  uint64_t folders_size;
+  uint64_t records_offset;
+  uint64_t blobs_offset;
+  FingerprintRecord fingerprints[kFileCount];
+  // SHA-256 of the description of the load options the image was written
+  // with, the image only holds the entries passing them.
+  uint8_t filters[32];
+};
+
+class Record final {
+ public:
+  uint8_t uuid[16];
+  uint8_t folder_uuid[16];
+  uint8_t hmac[32];
+  int64_t creation_time;
+  int64_t modification_time;
+  int64_t transaction_time;
+  uint32_t category;
+  uint32_t fave;
+  uint32_t trashed;
+  uint32_t band;
+  // Offsets are relative to the start of the encrypted data.
+  uint64_t key_offset;
+  uint64_t key_size;
+  uint64_t overview_offset;
+  uint64_t overview_size;
+  uint64_t details_offset;
+  uint64_t details_size;
+};
+
+std::array<uint8_t, 32> Seal(const char* data, std::size_t size,
+                             onepass::Profile& profile) {
+  // The seal key is derived from the master MAC key, keeping the MACs of
+  // images apart from those of the vault data.
+  std::array<uint8_t, 32> key;
+  unsigned int len = key.size();
+  HMAC(EVP_sha256(), profile.master_mac_key().data(),
+       profile.master_mac_key().size(),
+       reinterpret_cast<const uint8_t*>(kSealContext.data()),
+       kSealContext.size(), key.data(), &len);
+  assert(len == key.size());
+
+  std::array<uint8_t, 32> seal;
+  len = seal.size();
+  HMAC(EVP_sha256(), key.data(), key.size(),
+       reinterpret_cast<const uint8_t*>(data), size, seal.data(), &len);
+  assert(len == seal.size());
+  key.fill(0);
+  return seal;
+}
+
+std::array<uint8_t, 32> FiltersDigest(const onepass::LoadOptions& options) {
+  std::string description = options.Describe();
+  std::array<uint8_t, 32> digest;
+  SHA256(reinterpret_cast<const uint8_t*>(description.data()),
+         description.size(), digest.data());
+  return digest;
+}
+
+FingerprintRecord ToRecord(const onepass::FileFingerprint& fingerprint) {
+  FingerprintRecord record;
+  record.exists = fingerprint.exists() ? 1 : 0;
+  record.size = fingerprint.size();
+  record.modification_time = fingerprint.modification_time();
+  record.hash = fingerprint.hash();
+  record.checked_time = fingerprint.checked_time();
+  return record;
+}
+
+onepass::FileFingerprint FromRecord(const FingerprintRecord& record) {
+  return onepass::FileFingerprint(record.exists != 0, record.size,
+                         static_cast<std::time_t>(record.modification_time),
+                         record.hash,
+                         static_cast<std::time_t>(record.checked_time));
+}
+
+template <typename T>
+void Append(std::string& buffer, const T& value) {
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void Align(std::string& buffer) {
+  buffer.resize((buffer.size() + 7) & ~static_cast<std::size_t>(7), '\0');
+}
+
+} // namespace
+
+namespace onepass {
+
+void VaultImage::Write(const std::string& path,
+                       const FileFingerprint& folders_fingerprint,
+                       const Folders& folders, const Bands& bands,
+                       Profile& profile) {
+  assert(!profile.IsLocked());
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  for (std::size_t i = 0; i < Bands::kBandCount; ++i) {
+    header.fingerprints[i] = ToRecord(bands.bands_[i].fingerprint);
+    header.entry_count += bands.bands_[i].entries.size();
+  }
+  header.fingerprints[Bands::kBandCount] = ToRecord(folders_fingerprint);
+  std::array<uint8_t, 32> filters = FiltersDigest(bands.options_);
+  std::memcpy(header.filters, filters.data(), filters.size());
+
+  std::string json = folders.ToJson();
+  header.folders_offset = sizeof(Header);
+  header.folders_size = json.size();
+  header.records_offset = (header.folders_offset + json.size() + 7) &
+      ~static_cast<uint64_t>(7);
+  header.blobs_offset = header.records_offset +
+      header.entry_count * sizeof(Record);
+
+  std::string buffer;
+  Append(buffer, header);
+  buffer.append(json);
+  Align(buffer);
+  assert(buffer.size() == header.records_offset);
+
+  std::string blobs;
+  auto add_blob = [&blobs](const std::string& blob, uint64_t& offset,
+                           uint64_t& size) {
+    offset = blobs.size();
+    size = blob.size();
+    blobs.append(blob);
+  };
+  for (std::size_t i = 0; i < Bands::kBandCount; ++i) {
+    for (const auto& entry : bands.bands_[i].entries) {
+      Entry::Sealed sealed = entry->sealed();
+      Record record;
+      std::memset(&record, 0, sizeof(record));
+      std::memcpy(record.uuid, sealed.uuid.bytes().data(), 16);
+      std::memcpy(record.folder_uuid, sealed.folder_uuid.bytes().data(), 16);
+      std::memcpy(record.hmac, sealed.hmac.data(), 32);
+      record.creation_time = sealed.creation_time;
+      record.modification_time = sealed.modification_time;
+      record.transaction_time = sealed.transaction_time;
+      record.category = static_cast<uint32_t>(sealed.category);
+      record.fave = sealed.fave;
+      record.trashed = sealed.trashed ? 1 : 0;
+      record.band = static_cast<uint32_t>(i);
+      add_blob(sealed.key_data, record.key_offset, record.key_size);
+      add_blob(sealed.overview_data, record.overview_offset,
+               record.overview_size);
+      add_blob(sealed.details_data, record.details_offset,
+               record.details_size);
+      Append(buffer, record);
+    }
+  }
+  buffer.append(blobs);
+
+  std::array<uint8_t, 32> seal = Seal(buffer.data(), buffer.size(), profile);
+  buffer.append(reinterpret_cast<const char*>(seal.data()), seal.size());
+
+  // Write to a temporary file first, readers never see a partial image.
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream dst(temp_path, std::ios::out | std::ios::binary |
+                                 std::ios::trunc);
+    if (!dst.is_open())
+      throw IoError("Unable to open " + temp_path + ".");
+    dst.write(buffer.data(), buffer.size());
+    if (!dst.good())
+      throw IoError("Unable to write " + temp_path + ".");
+  }
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    throw IoError("Unable to replace " + path + ".");
+  }
+}
+
+bool VaultImage::Read(const std::string& path, const std::string& dir_path,
+                      Profile& profile, const LoadOptions& options,
+                      FileFingerprint& folders_fingerprint, Folders& folders,
+                      Bands& bands) {
+  assert(!profile.IsLocked());
+
+  MappedFile file(path);
+  if (file.data() == nullptr || file.size() < sizeof(Header) + kSealSize)
+    return false;
+
+  // Verify the seal before trusting any offsets.
+  std::size_t size = file.size() - kSealSize;
+  std::array<uint8_t, 32> seal = Seal(file.data(), size, profile);
+  if (CRYPTO_memcmp(seal.data(), file.data() + size, kSealSize) != 0)
+    return false;
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion)
+    return false;
+  // Compare sizes against the space left rather than adding offsets, which
+  // could wrap around for a damaged header.
+  if (header.records_offset > size ||
+      header.folders_offset > header.records_offset ||
+      header.folders_size > header.records_offset - header.folders_offset ||
+      header.records_offset % 8 != 0 ||
+      header.blobs_offset != header.records_offset +
+          static_cast<uint64_t>(header.entry_count) * sizeof(Record) ||
+      header.blobs_offset > size)
+    return false;
+
+  // An image written with filters lacks the entries not passing them, it
+  // can only be used with the same filters. An image written without
+  // filters can be used with any, they are applied while reading.
+  if (std::memcmp(header.filters, FiltersDigest(options).data(), 32) != 0 &&
+      std::memcmp(header.filters, FiltersDigest(LoadOptions()).data(),
+                  32) != 0)
+    return false;
+
+  // The image is stale once any of the vault files changed.
+  FileFingerprint fingerprints[kFileCount];
+  for (std::size_t i = 0; i < kFileCount; ++i) {
+    std::string file_path = dir_path + "/" +
+        (i < Bands::kBandCount ? Bands::BandFileName(i) : "folders.js");
+    std::string text;
+    fingerprints[i] = FromRecord(header.fingerprints[i]);
+    if (fingerprints[i].Refresh(file_path, text))
+      return false;
+  }
+
+  Folders loaded_folders;
+  try {
+    loaded_folders.Parse(std::string(file.data() + header.folders_offset,
+                                     header.folders_size),
+                         profile);
+  } catch (const FormatError&) {
+    return false;
+  }
+
+  const char* records = file.data() + header.records_offset;
+  const char* blobs = file.data() + header.blobs_offset;
+  uint64_t blobs_size = size - header.blobs_offset;
+  auto blob = [&](uint64_t offset, uint64_t blob_size, std::string& data) {
+    if (offset > blobs_size || blob_size > blobs_size - offset)
+      return false;
+    data.assign(blobs + offset, blob_size);
+    return true;
+  };
+
+  Bands loaded_bands;
+  loaded_bands.options_ = options;
+  for (std::size_t i = 0; i < header.entry_count; ++i) {
+    Record record;
+    std::memcpy(&record, records + i * sizeof(Record), sizeof(record));
+    if (record.band >= Bands::kBandCount)
+      return false;
+
+    Entry::Sealed sealed;
+    std::array<uint8_t, 16> bytes;
+    std::memcpy(bytes.data(), record.uuid, 16);
+    sealed.uuid = Uuid(bytes);
+    std::memcpy(bytes.data(), record.folder_uuid, 16);
+    sealed.folder_uuid = Uuid(bytes);
+    std::memcpy(sealed.hmac.data(), record.hmac, 32);
+    sealed.creation_time = static_cast<std::time_t>(record.creation_time);
+    sealed.modification_time =
+        static_cast<std::time_t>(record.modification_time);
+    sealed.transaction_time =
+        static_cast<std::time_t>(record.transaction_time);
+    sealed.category = static_cast<Entry::Category>(record.category);
+    sealed.fave = record.fave;
+    sealed.trashed = record.trashed != 0;
+    if (!options.Accepts(sealed))
+      continue;
+
+    if (!blob(record.key_offset, record.key_size, sealed.key_data) ||
+        !blob(record.overview_offset, record.overview_size,
+              sealed.overview_data) ||
+        !blob(record.details_offset, record.details_size,
+              sealed.details_data))
+      return false;
+
+    std::shared_ptr<Entry> entry;
+    try {
+      entry = std::make_shared<Entry>(sealed, &profile);
+    } catch (const FormatError&) {
+      return false;
+    } catch (const IntegrityError&) {
+      return false;
+    }
+    entry->set_details_cache(options.details_cache());
+    loaded_bands.bands_[record.band].entries.push_back(entry);
+  }
+  for (std::size_t i = 0; i < Bands::kBandCount; ++i)
+    loaded_bands.bands_[i].fingerprint = fingerprints[i];
+  loaded_bands.RebuildEntries();
+
+  folders_fingerprint = fingerprints[Bands::kBandCount];
+  folders = loaded_folders;
+  bands = loaded_bands;
+  return true;
+}
+
+}   // namespace onepass
@@ -0,0 +1,84 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <string>
+
+#include "bands.hh"
+#include "fingerprint.hh"
+#include "folders.hh"
+
+namespace onepass {
+
+class Profile;
+
+/**
+ * Binary image of a loaded vault, sparing a restart the band files. The
+ * image holds the fingerprints of the vault files, the folders, a table with
+ * the plain text attributes of each entry and offsets to its encrypted data,
+ * followed by the encrypted data itself. Nothing in the image is decrypted
+ * beyond what the band files store in plain text. The image is sealed with
+ * an HMAC keyed by the vault master key, and is read by mapping it into
+ * memory.
+ *
+ * Reading an image saves reading the band files and the JSON parsing and
+ * base64 decoding of the entries. It still verifies the seal over the whole
+ * image, copies the encrypted data of each entry out of the mapping and
+ * decrypts the item keys and overview of each entry, so the cost of a
+ * restart remains proportional to the number of entries. The indexes are
+ * not part of the image, they are derived from the decrypted overviews and
+ * rebuilt by the reader.
+ */
+class VaultImage final {
+ public:
+  /**
+   * Writes an image, replacing any previous image atomically.
+   * @param [in] path Path of the image file.
+   * @param [in] folders_fingerprint Fingerprint of the folders file.
+   * @param [in] folders Loaded folders.
+   * @param [in] bands Loaded bands.
+   * @param [in] profile Unlocked profile used to seal the image.
+   * @throw IoError If the image can not be written.
+   */
+  static void Write(const std::string& path,
+                    const FileFingerprint& folders_fingerprint,
+                    const Folders& folders, const Bands& bands,
+                    Profile& profile);
+
+  /**
+   * Reads an image, provided it is intact, the vault files did not change
+   * since it was written and it was written either without filters or with
+   * the same filters as @a options.
+   * @param [in] path Path of the image file.
+   * @param [in] dir_path Path to the directory containing the vault files.
+   * @param [in] profile Unlocked profile used to verify the image and
+   *                     decrypt the entries.
+   * @param [in] options Filters for the entries to load.
+   * @param [out] folders_fingerprint Fingerprint of the folders file.
+   * @param [out] folders Loaded folders.
+   * @param [out] bands Loaded bands.
+   * @return false if the image is missing, stale or invalid, in which case
+   *         the output arguments are left untouched.
+   */
+  static bool Read(const std::string& path, const std::string& dir_path,
+                   Profile& profile, const LoadOptions& options,
+                   FileFingerprint& folders_fingerprint, Folders& folders,
+                   Bands& bands);
+};
+
+}   // namespace onepass
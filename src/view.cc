@@ -0,0 +1,118 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "view.hh"
+
+#include <algorithm>
+#include <limits>
+
+namespace onepass {
+
+Predicate Predicate::InCategory(Entry::Category category) {
+  return Predicate(Cost::kMetadata, [category](const Entry& entry) {
+    return entry.category() == category;
+  });
+}
+
+Predicate Predicate::InFolder(const Uuid& folder_uuid) {
+  return Predicate(Cost::kMetadata, [folder_uuid](const Entry& entry) {
+    return entry.folder_uuid() == folder_uuid;
+  });
+}
+
+Predicate Predicate::Trashed(bool trashed) {
+  return Predicate(Cost::kMetadata, [trashed](const Entry& entry) {
+    return entry.trashed() == trashed;
+  });
+}
+
+Predicate Predicate::ModifiedBetween(std::time_t first, std::time_t last) {
+  return Predicate(Cost::kMetadata, [first, last](const Entry& entry) {
+    return entry.modification_time() >= first &&
+        entry.modification_time() < last;
+  });
+}
+
+Predicate Predicate::ModifiedSince(std::time_t time) {
+  return ModifiedBetween(time, std::numeric_limits<std::time_t>::max());
+}
+
+Predicate Predicate::CreatedBetween(std::time_t first, std::time_t last) {
+  return Predicate(Cost::kMetadata, [first, last](const Entry& entry) {
+    return entry.creation_time() >= first && entry.creation_time() < last;
+  });
+}
+
+Predicate Predicate::HasTag(const std::string& tag) {
+  return Predicate(Cost::kOverview, [tag](const Entry& entry) {
+    return std::find(entry.tags().begin(), entry.tags().end(), tag) !=
+        entry.tags().end();
+  });
+}
+
+Predicate operator&&(const Predicate& lhs, const Predicate& rhs) {
+  const Predicate& first = rhs.cost() < lhs.cost() ? rhs : lhs;
+  const Predicate& second = rhs.cost() < lhs.cost() ? lhs : rhs;
+  return Predicate(second.cost(), [first, second](const Entry& entry) {
+    return first(entry) && second(entry);
+  });
+}
+
+Predicate operator||(const Predicate& lhs, const Predicate& rhs) {
+  const Predicate& first = rhs.cost() < lhs.cost() ? rhs : lhs;
+  const Predicate& second = rhs.cost() < lhs.cost() ? lhs : rhs;
+  return Predicate(second.cost(), [first, second](const Entry& entry) {
+    return first(entry) || second(entry);
+  });
+}
+
+Predicate operator!(const Predicate& predicate) {
+  return Predicate(predicate.cost(), [predicate](const Entry& entry) {
+    return !predicate(entry);
+  });
+}
+
+void EntryView::Iterator::SkipRejected() {
+  while (it_ != view_->entries_->end() && !view_->Matches(**it_))
+    ++it_;
+}
+
+EntryView EntryView::Where(const Predicate& predicate) const {
+  EntryView view(*this);
+  auto pos = std::upper_bound(
+      view.predicates_.begin(), view.predicates_.end(), predicate,
+      [](const Predicate& lhs, const Predicate& rhs) {
+        return lhs.cost() < rhs.cost();
+      });
+  view.predicates_.insert(pos, predicate);
+  return view;
+}
+
+bool EntryView::Matches(const Entry& entry) const {
+  for (const auto& predicate : predicates_) {
+    if (!predicate(entry))
+      return false;
+  }
+  return true;
+}
+
+std::size_t EntryView::Count() const {
+  return static_cast<std::size_t>(std::distance(begin(), end()));
+}
+
+}   // namespace onepass
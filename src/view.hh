@@ -0,0 +1,166 @@
+/*
+ * libonepass - 1Password key database importer
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <ctime>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bands.hh"
+
+namespace onepass {
+
+/**
+ * Composable condition on entries. Each predicate knows which part of an
+ * entry it needs, so that combinations and views can evaluate the plaintext
+ * metadata before anything requiring decryption.
+ */
+class Predicate final {
+ public:
+  /**
+   * Entry data needed for evaluating a predicate, in order of cost.
+   */
+  enum class Cost {
+    kMetadata,  ///< Plaintext metadata such as category, folder and times.
+    kOverview,  ///< Decrypted overview such as title, URLs and tags. The
+                ///< overview is decrypted when an entry is loaded, so this
+                ///< only orders the predicate before the details.
+    kDetails    ///< Decrypted details such as fields and notes.
+  };
+
+  typedef std::function<bool(const Entry& entry)> Function;
+
+ private:
+  Cost cost_;
+  Function function_;
+
+ public:
+  Predicate(Cost cost, const Function& function) :
+      cost_(cost), function_(function) {}
+
+  Cost cost() const { return cost_; }
+
+  bool operator()(const Entry& entry) const { return function_(entry); }
+
+  static Predicate InCategory(Entry::Category category);
+  /**
+   * @param [in] folder_uuid Folder UUID, or the nil UUID for entries not in
+   *                         any folder.
+   */
+  static Predicate InFolder(const Uuid& folder_uuid);
+  static Predicate Trashed(bool trashed = true);
+  /**
+   * @return Predicate matching entries modified within [first, last).
+   */
+  static Predicate ModifiedBetween(std::time_t first, std::time_t last);
+  static Predicate ModifiedSince(std::time_t time);
+  /**
+   * @return Predicate matching entries created within [first, last).
+   */
+  static Predicate CreatedBetween(std::time_t first, std::time_t last);
+  static Predicate HasTag(const std::string& tag);
+};
+
+/**
+ * Combinations evaluate the cheaper predicate first and short circuit.
+ */
+Predicate operator&&(const Predicate& lhs, const Predicate& rhs);
+Predicate operator||(const Predicate& lhs, const Predicate& rhs);
+Predicate operator!(const Predicate& predicate);
+
+/**
+ * Lazy view over a list of entries. The predicates are evaluated while
+ * iterating, cheapest first, and the view yields the entries themselves
+ * without copying any data. The view references the underlying list which
+ * needs to outlive it.
+ */
+class EntryView final {
+ public:
+  class Iterator final : public std::iterator<std::forward_iterator_tag,
+                                              const std::shared_ptr<Entry>> {
+   private:
+    const EntryView* view_;
+    std::vector<std::shared_ptr<Entry>>::const_iterator it_;
+
+    void SkipRejected();
+
+   public:
+    Iterator(const EntryView* view,
+             std::vector<std::shared_ptr<Entry>>::const_iterator it) :
+        view_(view), it_(it) {
+      SkipRejected();
+    }
+
+    const std::shared_ptr<Entry>& operator*() const { return *it_; }
+    const std::shared_ptr<Entry>* operator->() const { return &*it_; }
+
+    Iterator& operator++() {
+      ++it_;
+      SkipRejected();
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    bool operator==(const Iterator& other) const { return it_ == other.it_; }
+    bool operator!=(const Iterator& other) const { return it_ != other.it_; }
+  };
+
+ private:
+  const std::vector<std::shared_ptr<Entry>>* entries_;
+  // Keeps whatever holds the entries alive for as long as the view exists.
+  std::shared_ptr<const void> owner_;
+  // Sorted by cost, the order among predicates of equal cost is kept.
+  std::vector<Predicate> predicates_;
+
+ public:
+  explicit EntryView(const std::vector<std::shared_ptr<Entry>>& entries) :
+      entries_(&entries) {}
+  /**
+   * @param [in] entries Entries to view.
+   * @param [in] owner Object owning @a entries, kept alive by the view.
+   */
+  EntryView(const std::vector<std::shared_ptr<Entry>>& entries,
+            const std::shared_ptr<const void>& owner) :
+      entries_(&entries), owner_(owner) {}
+
+  /**
+   * @return A view of the entries in this view also matching @a predicate.
+   */
+  EntryView Where(const Predicate& predicate) const;
+
+  bool Matches(const Entry& entry) const;
+
+  Iterator begin() const { return Iterator(this, entries_->begin()); }
+  Iterator end() const { return Iterator(this, entries_->end()); }
+
+  bool empty() const { return begin() == end(); }
+  /**
+   * Counts the matching entries, which means evaluating all predicates.
+   */
+  std::size_t Count() const;
+};
+
+}   // namespace onepass
@@ -0,0 +1,270 @@
+/*
+ * libonepass - 1Password key database importer/exporter
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "attachment.hh"
+#include "database.hh"
+#include "exception.hh"
+#include "profile.hh"
+
+using namespace onepass;
+
+namespace {
+
+std::string GetTestPath(const std::string& name) {
+  return "./test/data/" + name;
+}
+
+std::string GetTestProfilePath(const std::string& name) {
+  return GetTestPath(name) + "/default/profile.js";
+}
+
+std::string ReadContents(const Attachment& attachment,
+                         std::size_t chunk_size) {
+  std::string contents;
+  attachment.Read([&](const char* data, std::size_t size) {
+    contents.append(data, size);
+  }, chunk_size);
+  return contents;
+}
+
+/**
+ * Copies an attachment file to a temporary file, flipping a bit of the last
+ * cipher text block.
+ * @return Path to the copy.
+ */
+std::string CopyTampered(const std::string& src_path) {
+  std::string data;
+  {
+    std::ifstream src(src_path, std::ios::in | std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(src),
+                std::istreambuf_iterator<char>());
+  }
+  if (data.size() < 100)
+    return std::string();
+  data[data.size() - 40] ^= 1;
+
+  char path[] = "/tmp/onepass-test-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1)
+    return std::string();
+  close(fd);
+
+  std::ofstream dst(path, std::ios::out | std::ios::binary);
+  dst.write(data.data(), data.size());
+  return path;
+}
+
+} // namespace
+
+TEST(AttachmentTest, Read) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::shared_ptr<Entry> entry = Database::LoadEntry(
+      GetTestPath("freddy-2013-12-04"),
+      ParseUuid("F2DB5DA3FCA64372A751E0E85C67A538"), profile);
+  ASSERT_TRUE(entry != nullptr);
+
+  auto attachments = Database::LoadAttachments(
+      GetTestPath("freddy-2013-12-04"), *entry, profile);
+  ASSERT_EQ(attachments.size(), 2);
+  EXPECT_EQ(attachments[0]->uuid(),
+            ParseUuid("23F6167DC1FB457A8DE7033ACDCD06DB"));
+  EXPECT_EQ(attachments[1]->uuid(),
+            ParseUuid("AFBDA49A5F684179A78161E40CA2AAD3"));
+
+  EXPECT_EQ(attachments[0]->file_name(),
+            "maria_sibylla_merians_366th_birthday_-1256008-hp.jpg");
+  EXPECT_EQ(attachments[1]->file_name(), "turing-doodle-static.jpg");
+
+  for (const auto& attachment : attachments) {
+    EXPECT_EQ(attachment->entry_uuid(), entry->uuid());
+    EXPECT_FALSE(attachment->Icon().empty());
+
+    std::string contents = ReadContents(*attachment,
+                                        Attachment::kDefaultChunkSize);
+    EXPECT_EQ(contents.size(), attachment->size());
+    // Both attachments are JPEG images.
+    EXPECT_EQ(contents.compare(0, 3, "\xff\xd8\xff"), 0);
+    // Chunks not aligned to blocks are rounded down.
+    EXPECT_EQ(ReadContents(*attachment, 1000), contents);
+    EXPECT_EQ(ReadContents(*attachment, 1), contents);
+  }
+
+  // Entries without attachments.
+  std::shared_ptr<Entry> hulu = Database::LoadEntry(
+      GetTestPath("freddy-2013-12-04"),
+      ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC"), profile);
+  ASSERT_TRUE(hulu != nullptr);
+  EXPECT_TRUE(Database::LoadAttachments(
+      GetTestPath("freddy-2013-12-04"), *hulu, profile).empty());
+  EXPECT_THROW(Attachment(attachments[0]->path(), *hulu, profile),
+               FormatError);
+}
+
+TEST(AttachmentTest, Integrity) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::shared_ptr<Entry> entry = Database::LoadEntry(
+      GetTestPath("freddy-2013-12-04"),
+      ParseUuid("2A632FDD32F5445E91EB5636C7580447"), profile);
+  ASSERT_TRUE(entry != nullptr);
+
+  std::string path = CopyTampered(
+      GetTestPath("freddy-2013-12-04") + "/default/"
+      "2A632FDD32F5445E91EB5636C7580447_8FA293F2B001459D8F8F78C21E6BF9F6"
+      ".attachment");
+  ASSERT_FALSE(path.empty());
+
+  Attachment attachment(path, *entry, profile);
+  EXPECT_THROW(ReadContents(attachment, Attachment::kDefaultChunkSize),
+               IntegrityError);
+
+  // The sink receives the contents before the check fails at the end.
+  std::size_t received = 0;
+  EXPECT_THROW(attachment.Read([&](const char*, std::size_t size) {
+    received += size;
+  }, 1024), IntegrityError);
+  EXPECT_GT(received, 0);
+  EXPECT_LE(received, attachment.size());
+  EXPECT_THROW(attachment.Verify(), IntegrityError);
+  std::remove(path.c_str());
+}
+
+TEST(AttachmentTest, Stream) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::shared_ptr<Entry> entry = Database::LoadEntry(
+      GetTestPath("freddy-2013-12-04"),
+      ParseUuid("FF445AB1497241A28812363154E1A738"), profile);
+  ASSERT_TRUE(entry != nullptr);
+  auto attachments = Database::LoadAttachments(
+      GetTestPath("freddy-2013-12-04"), *entry, profile);
+  ASSERT_EQ(attachments.size(), 1);
+  std::string contents = ReadContents(*attachments[0],
+                                      Attachment::kDefaultChunkSize);
+  ASSERT_GT(contents.size(), 4 * AttachmentStream::kPageSize);
+
+  for (std::size_t cache_size : { std::size_t(0),
+                                  AttachmentStream::kDefaultCacheSize }) {
+    AttachmentStream stream(attachments[0],
+                            AttachmentStream::Verification::kFirstRead,
+                            cache_size);
+    EXPECT_EQ(stream.size(), contents.size());
+    EXPECT_EQ(stream.Read(0, 16), contents.substr(0, 16));
+    // Reads within, across and at the end of pages.
+    const std::size_t page = AttachmentStream::kPageSize;
+    for (uint64_t offset : { page - 20, 3 * page + 5, uint64_t(1) }) {
+      EXPECT_EQ(stream.Read(offset, page + 40),
+                contents.substr(offset, page + 40));
+    }
+    EXPECT_EQ(stream.Read(contents.size() - 10, 100),
+              contents.substr(contents.size() - 10));
+    EXPECT_EQ(stream.Read(contents.size(), 100), "");
+    EXPECT_EQ(stream.Read(0, contents.size()), contents);
+    EXPECT_NO_THROW(stream.Verify());
+  }
+
+  std::string path = CopyTampered(attachments[0]->path());
+  ASSERT_FALSE(path.empty());
+  auto tampered = std::make_shared<Attachment>(path, *entry, profile);
+  {
+    AttachmentStream stream(tampered);
+    EXPECT_THROW(stream.Read(0, 16), IntegrityError);
+    EXPECT_THROW(stream.Read(0, 16), IntegrityError);
+  }
+  {
+    // Reads may succeed until the background check has failed.
+    AttachmentStream stream(tampered,
+                            AttachmentStream::Verification::kBackground);
+    EXPECT_THROW(stream.Verify(), IntegrityError);
+    EXPECT_THROW(stream.Read(0, 16), IntegrityError);
+  }
+  {
+    AttachmentStream stream(attachments[0],
+                            AttachmentStream::Verification::kBackground);
+    EXPECT_EQ(stream.Read(100, 10), contents.substr(100, 10));
+    EXPECT_NO_THROW(stream.Verify());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(AttachmentTest, Decrypt) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::shared_ptr<Entry> entry = Database::LoadEntry(
+      GetTestPath("freddy-2013-12-04"),
+      ParseUuid("FF445AB1497241A28812363154E1A738"), profile);
+  ASSERT_TRUE(entry != nullptr);
+  auto attachments = Database::LoadAttachments(
+      GetTestPath("freddy-2013-12-04"), *entry, profile);
+  ASSERT_EQ(attachments.size(), 1);
+  const Attachment& attachment = *attachments[0];
+  std::string contents = ReadContents(attachment,
+                                      Attachment::kDefaultChunkSize);
+
+  // Small chunks spread the contents over all threads.
+  for (std::size_t threads : { 1, 4 }) {
+    for (std::size_t chunk_size : { std::size_t(4000),
+                                    Attachment::kParallelChunkSize }) {
+      std::string decrypted(attachment.size(), '\0');
+      EXPECT_NO_THROW(attachment.Decrypt(&decrypted[0], threads, chunk_size));
+      EXPECT_EQ(decrypted, contents);
+    }
+  }
+
+  char path[] = "/tmp/onepass-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  close(fd);
+  EXPECT_NO_THROW(attachment.Save(path, 3, 8192));
+  {
+    std::ifstream src(path, std::ios::in | std::ios::binary);
+    std::string saved((std::istreambuf_iterator<char>(src)),
+                      std::istreambuf_iterator<char>());
+    EXPECT_EQ(saved, contents);
+  }
+
+  std::string tampered_path = CopyTampered(attachment.path());
+  ASSERT_FALSE(tampered_path.empty());
+  Attachment tampered(tampered_path, *entry, profile);
+  std::string decrypted(tampered.size(), 'x');
+  EXPECT_THROW(tampered.Decrypt(&decrypted[0], 4, 4000), IntegrityError);
+  EXPECT_EQ(decrypted, std::string(tampered.size(), '\0'));
+  EXPECT_THROW(tampered.Save(path, 4, 4000), IntegrityError);
+  EXPECT_FALSE(std::ifstream(path).is_open());
+  std::remove(tampered_path.c_str());
+}
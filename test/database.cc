@@ -16,12 +16,24 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <set>
+#include <thread>
 
 #include <gtest/gtest.h>
+#include <openssl/hmac.h>
 
 #include "database.hh"
+#include "details_cache.hh"
+#include "exception.hh"
 #include "profile.hh"
+#include "util.hh"
 
 using namespace onepass;
 
@@ -35,6 +47,66 @@ std::string GetTestProfilePath(const std::string& name) {
   return GetTestPath(name) + "/default/profile.js";
 }
 
+/**
+ * Copies a test vault into a temporary directory which the test may modify.
+ */
+std::string CopyTestVault(const std::string& name) {
+  char dir[] = "/tmp/onepass-test-XXXXXX";
+  if (mkdtemp(dir) == nullptr)
+    return std::string();
+  std::string cmd = "cp -R " + GetTestPath(name) + "/. " + dir;
+  if (std::system(cmd.c_str()) != 0)
+    return std::string();
+  return dir;
+}
+
+void RemoveTestVault(const std::string& path) {
+  std::string cmd = "rm -rf " + path;
+  EXPECT_EQ(std::system(cmd.c_str()), 0);
+}
+
+json11::Json::object ReadBand(const std::string& path) {
+  std::ifstream src(path, std::ios::in | std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(src)),
+                   std::istreambuf_iterator<char>());
+  std::string err;
+  return json11::Json::parse(ExtractJson(text), err).object_items();
+}
+
+void WriteBand(const std::string& path, const json11::Json::object& band) {
+  std::ofstream dst(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  dst << "ld(" << json11::Json(band).dump() << ");";
+}
+
+// Overwrites 8 bytes of a vault image and seals it again, giving an image
+// that passes the seal check but holds damaged offsets.
+void PatchImage(const std::string& path, Profile& profile,
+                std::size_t offset, uint64_t value) {
+  std::string data;
+  {
+    std::ifstream src(path, std::ios::in | std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(src),
+                std::istreambuf_iterator<char>());
+  }
+  ASSERT_GT(data.size(), offset + 8 + 32);
+  std::memcpy(&data[offset], &value, sizeof(value));
+
+  const std::string context = "onepass vault image";
+  uint8_t key[32];
+  unsigned int len = sizeof(key);
+  HMAC(EVP_sha256(), profile.master_mac_key().data(),
+       profile.master_mac_key().size(),
+       reinterpret_cast<const uint8_t*>(context.data()), context.size(),
+       key, &len);
+  len = 32;
+  HMAC(EVP_sha256(), key, sizeof(key),
+       reinterpret_cast<const uint8_t*>(data.data()), data.size() - 32,
+       reinterpret_cast<uint8_t*>(&data[data.size() - 32]), &len);
+
+  std::ofstream dst(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  dst.write(data.data(), data.size());
+}
+
 } // namespace
 
 TEST(DatabaseTest, GetPasswords) {
@@ -64,7 +136,1058 @@ TEST(DatabaseTest, GetPasswords) {
   EXPECT_EQ(logins[7].url(), "http://www.tuaw.com");
   EXPECT_EQ(logins[7].password(), "tiac1nut2jab1eiv2oc5");
   EXPECT_EQ(logins[8].url(), "https://www.bankofamerica.com/");
-  EXPECT_EQ(logins[8].password(), "");
+  EXPECT_EQ(logins[8].password(), "reTDx8KHhW8eAc");
   EXPECT_EQ(logins[9].url(), "https://www.icloud.com/");
   EXPECT_EQ(logins[9].password(), "iINe4uig8suLny");
 }
+
+TEST(DatabaseTest, DesignatedFields) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  std::shared_ptr<const Database::Snapshot> snapshot = db.snapshot();
+  const std::vector<Database::LoginItem>& logins = snapshot->GetLoginItems();
+  ASSERT_EQ(logins.size(), 10);
+  EXPECT_EQ(logins[0].username(), "wendy@appleseed.com");
+  EXPECT_EQ(logins[0].entry()->password_field()->type(), "P");
+  EXPECT_EQ(logins[1].username(), "WendyAppleseed");
+  EXPECT_EQ(logins[8].entry()->password_field()->designation(), "password");
+  EXPECT_TRUE(logins[0].entry()->totp().empty());
+  EXPECT_EQ(&snapshot->GetLoginItems(), &logins);
+}
+
+TEST(DatabaseTest, FieldValues) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+
+  std::shared_ptr<Entry> license;
+  std::shared_ptr<Entry> card;
+  for (const auto& entry : bands.entries()) {
+    if (entry->category() == Entry::Category::kDriverLicense)
+      license = entry;
+    else if (entry->title() == "CapitalOne MasterCard ***3456")
+      card = entry;
+  }
+  ASSERT_TRUE(license != nullptr);
+  ASSERT_TRUE(card != nullptr);
+  ASSERT_EQ(license->sections().size(), 1);
+
+  std::set<std::string> seen;
+  for (const auto& field : license->sections()[0]->fields()) {
+    const Entry::Value& value = field->value();
+    if (field->name() == "fullname") {
+      EXPECT_EQ(value.type(), Entry::Value::Type::kString);
+      EXPECT_EQ(value.string_value(), "Wendy Appleseed");
+    } else if (field->name() == "birthdate") {
+      EXPECT_EQ(value.type(), Entry::Value::Type::kDate);
+      EXPECT_EQ(value.date_value(), 359100000);
+      EXPECT_EQ(value.ToString(), "359100000");
+    } else if (field->name() == "expiry_date") {
+      // Stored as 2515, which is not on the form YYYYMM.
+      EXPECT_EQ(value.type(), Entry::Value::Type::kNumber);
+      EXPECT_EQ(value.number_value(), 2515);
+    } else {
+      continue;
+    }
+    seen.insert(field->name());
+  }
+  EXPECT_EQ(seen.size(), 3);
+
+  bool found_expiry = false;
+  for (const auto& section : card->sections()) {
+    for (const auto& field : section->fields()) {
+      if (field->name() != "expiry")
+        continue;
+      const Entry::Value& value = field->value();
+      EXPECT_EQ(value.type(), Entry::Value::Type::kMonthYear);
+      EXPECT_EQ(value.year(), 2014);
+      EXPECT_EQ(value.month(), 11);
+      found_expiry = true;
+    }
+  }
+  EXPECT_TRUE(found_expiry);
+
+  // Numbers that do not hold a month are not month year values.
+  EXPECT_EQ(Entry::Value(json11::Json(201400), "monthYear").type(),
+            Entry::Value::Type::kNumber);
+  EXPECT_EQ(Entry::Value(json11::Json(201413), "monthYear").type(),
+            Entry::Value::Type::kNumber);
+  EXPECT_EQ(Entry::Value(json11::Json(201412), "monthYear").type(),
+            Entry::Value::Type::kMonthYear);
+}
+
+TEST(DatabaseTest, Indexes) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  std::shared_ptr<Entry> hulu =
+      db.Find(ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC"));
+  ASSERT_TRUE(hulu != nullptr);
+  EXPECT_EQ(hulu->title(), "Hulu");
+  EXPECT_TRUE(db.Find(Uuid()) == nullptr);
+
+  Uuid folder_uuid = ParseUuid("379A3A7E5D5A47A6AA3A69C4D1E57D1B");
+  ASSERT_TRUE(db.FindFolder(folder_uuid) != nullptr);
+
+  std::set<std::string> titles;
+  for (const auto& entry : db.EntriesInFolder(folder_uuid))
+    titles.insert(entry->title());
+  EXPECT_EQ(titles, std::set<std::string>({ "Tumblr", "YouTube" }));
+
+  titles.clear();
+  for (const auto& entry : db.EntriesWithTag("Personal"))
+    titles.insert(entry->title());
+  EXPECT_EQ(titles, std::set<std::string>({ "Bank of America", "Personal" }));
+
+  EXPECT_TRUE(db.EntriesWithTag("NoSuchTag").empty());
+  EXPECT_EQ(db.EntriesInCategory(Entry::Category::kLogin).size(), 10);
+  EXPECT_EQ(db.EntriesInCategory(Entry::Category::kCreditCard).size(), 2);
+
+  // Entries in several folders are merged back into load order.
+  Folders folders;
+  EXPECT_NO_THROW(folders.Load(
+      GetTestPath("freddy-2013-12-04") + "/default/folders.js", profile));
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+  Index index;
+  index.Build(folders, bands);
+  std::vector<Uuid> folder_uuids;
+  for (const auto& folder : folders.folders())
+    folder_uuids.push_back(folder->uuid());
+  folder_uuids.push_back(Uuid());
+  std::reverse(folder_uuids.begin(), folder_uuids.end());
+  std::size_t expected_size = 0;
+  for (const auto& uuid : folder_uuids)
+    expected_size += index.EntriesInFolder(uuid).size();
+  Index::EntryList in_folders = index.EntriesInFolders(folder_uuids);
+  EXPECT_EQ(in_folders.size(), expected_size);
+  auto it = bands.entries().begin();
+  for (const auto& entry : in_folders) {
+    it = std::find(it, bands.entries().end(), entry);
+    EXPECT_NE(it, bands.entries().end());
+  }
+}
+
+TEST(DatabaseTest, FindByUrl) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  std::vector<UrlIndex::Match> matches =
+      db.FindByUrl("https://www.hulu.com/watch/123");
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].entry()->title(), "Hulu");
+  EXPECT_EQ(matches[0].quality(), UrlIndex::Match::Quality::kExactHost);
+  EXPECT_FALSE(matches[0].same_scheme());
+
+  matches = db.FindByUrl("https://login.skype.com/");
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].entry()->title(), "Skype");
+  EXPECT_EQ(matches[0].quality(), UrlIndex::Match::Quality::kSameDomain);
+
+  matches = db.FindByUrl("http://a.b.tuaw.com");
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].entry()->title(), "The Unofficial Apple Weblog");
+
+  EXPECT_TRUE(db.FindByUrl("https://www.hulu.com:8443/").empty());
+  EXPECT_TRUE(db.FindByUrl("https://www.hulu.com:99999/").empty());
+  EXPECT_TRUE(db.FindByUrl("https://www.hulu.com:abc/").empty());
+  EXPECT_TRUE(db.FindByUrl("https://hulu.org/").empty());
+  EXPECT_TRUE(db.FindByUrl("https://com/").empty());
+  EXPECT_TRUE(db.FindByUrl("ssh://ftp.dreamhost.com").empty());
+
+  std::vector<std::vector<UrlIndex::Match>> batch = db.FindByUrls(
+      { "ftp://ftp.dreamhost.com/", "https://example.org", "www.icloud.com" });
+  ASSERT_EQ(batch.size(), 3);
+  ASSERT_EQ(batch[0].size(), 1);
+  EXPECT_EQ(batch[0][0].entry()->title(), "Company's FTP");
+  EXPECT_TRUE(batch[1].empty());
+  ASSERT_EQ(batch[2].size(), 1);
+  EXPECT_EQ(batch[2][0].entry()->title(), "MobileMe");
+}
+
+TEST(DatabaseTest, Search) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  std::vector<TextIndex::Hit> hits = db.Search("HULU");
+  ASSERT_EQ(hits.size(), 1);
+  EXPECT_EQ(hits[0].entry()->title(), "Hulu");
+  EXPECT_TRUE(hits[0].fields() & TextIndex::kTitle);
+  EXPECT_TRUE(hits[0].fields() & TextIndex::kUrl);
+
+  hits = db.Search("skype wendy");
+  ASSERT_EQ(hits.size(), 1);
+  EXPECT_EQ(hits[0].entry()->title(), "Skype");
+
+  // Title matches rank above matches in other fields.
+  hits = db.Search("mobileme");
+  ASSERT_FALSE(hits.empty());
+  EXPECT_EQ(hits[0].entry()->title(), "MobileMe");
+
+  hits = db.Search("personal", 1);
+  ASSERT_EQ(hits.size(), 1);
+  EXPECT_EQ(hits[0].entry()->title(), "Personal");
+
+  // Matches in notes.
+  hits = db.Search("look like wendy");
+  ASSERT_EQ(hits.size(), 1);
+  EXPECT_EQ(hits[0].entry()->category(), Entry::Category::kDriverLicense);
+  EXPECT_TRUE(hits[0].fields() & TextIndex::kNotes);
+
+  EXPECT_EQ(db.Search("pple").size(), db.Search("appl").size());
+  EXPECT_TRUE(db.Search("pple", 0, TextIndex::Mode::kPrefix).empty());
+  EXPECT_FALSE(db.Search("tu", 0, TextIndex::Mode::kPrefix).empty());
+  EXPECT_TRUE(db.Search("no such text").empty());
+  EXPECT_TRUE(db.Search("  ").empty());
+
+  // Indexing the notes decrypts the details of every entry.
+  auto cache = std::make_shared<DetailsCache>(0);
+  LoadOptions options;
+  options.set_details_cache(cache);
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile,
+                          options));
+  EXPECT_EQ(cache->statistics().misses, db.entries().size());
+  EXPECT_EQ(db.Search("look like wendy").size(), 1);
+
+  // Without the notes building the index leaves the details encrypted.
+  options.set_index_notes(false);
+  auto misses = cache->statistics().misses;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile,
+                          options));
+  EXPECT_EQ(db.Search("hulu").size(), 1);
+  EXPECT_EQ(cache->statistics().misses, misses);
+  EXPECT_TRUE(db.Search("look like wendy").empty());
+}
+
+TEST(DatabaseTest, SearchIndexUpdate) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+
+  TextIndex index;
+  index.Build(bands);
+  EXPECT_EQ(index.size(), bands.entries().size());
+  ASSERT_EQ(index.Search("hulu").size(), 1);
+
+  std::shared_ptr<Entry> hulu = index.Search("hulu")[0].entry();
+  index.Remove(hulu);
+  EXPECT_TRUE(index.Search("hulu").empty());
+  EXPECT_EQ(index.size(), bands.entries().size() - 1);
+
+  index.Update(bands);
+  EXPECT_EQ(index.Search("hulu").size(), 1);
+  EXPECT_EQ(index.size(), bands.entries().size());
+}
+
+TEST(DatabaseTest, FuzzySearch) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  std::vector<FuzzyIndex::Match> matches = db.FuzzySearch("boa", 3);
+  ASSERT_FALSE(matches.empty());
+  EXPECT_EQ(matches[0].entry()->title(), "Bank of America");
+  EXPECT_EQ(matches[0].positions(), std::vector<uint32_t>({ 0, 5, 8 }));
+
+  matches = db.FuzzySearch("Dr Lic", 10);
+  ASSERT_FALSE(matches.empty());
+  EXPECT_EQ(matches[0].entry()->title(), "Wendy's driver's license");
+
+  matches = db.FuzzySearch("e", 5);
+  EXPECT_EQ(matches.size(), 5);
+  for (std::size_t i = 1; i < matches.size(); ++i)
+    EXPECT_GE(matches[i - 1].score(), matches[i].score());
+
+  EXPECT_TRUE(db.FuzzySearch("zzzz", 10).empty());
+  EXPECT_TRUE(db.FuzzySearch("", 10).empty());
+  EXPECT_TRUE(db.FuzzySearch("hulu", 0).empty());
+}
+
+TEST(DatabaseTest, Scan) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  std::vector<Scanner::Source> sources;
+  auto collect = [&](const Scanner::Match& match) {
+    sources.push_back(match.source());
+  };
+
+  db.Scan("speg5nu5di1mol4niev9", Scanner::Syntax::kLiteral, false, collect);
+  EXPECT_EQ(sources, std::vector<Scanner::Source>(
+      { Scanner::Source::kPasswordHistory }));
+
+  sources.clear();
+  db.Scan("reTDx8KHhW8eAc", Scanner::Syntax::kLiteral, false, collect);
+  EXPECT_EQ(sources, std::vector<Scanner::Source>(
+      { Scanner::Source::kField }));
+
+  sources.clear();
+  db.Scan("RETDX8KHHW8EAC", Scanner::Syntax::kLiteral, false, collect);
+  EXPECT_TRUE(sources.empty());
+  db.Scan("RETDX8KHHW8EAC", Scanner::Syntax::kLiteral, true, collect);
+  EXPECT_EQ(sources.size(), 1);
+
+  sources.clear();
+  db.Scan("doesn't look like", Scanner::Syntax::kLiteral, false, collect);
+  EXPECT_EQ(sources, std::vector<Scanner::Source>(
+      { Scanner::Source::kNotes }));
+
+  std::vector<std::string> values;
+  db.Scan("^WENDY\\.appleseed@\\w+\\.com$", Scanner::Syntax::kRegex, true,
+          [&](const Scanner::Match& match) {
+    values.push_back(match.value());
+  });
+  EXPECT_FALSE(values.empty());
+  for (const auto& value : values)
+    EXPECT_EQ(value, "wendy.appleseed@me.com");
+
+  EXPECT_THROW(db.Scan("(wendy", Scanner::Syntax::kRegex, false, collect),
+               FormatError);
+  EXPECT_THROW(db.Scan("wendy", Scanner::Syntax::kLiteral, false,
+                       [](const Scanner::Match&) {
+                         throw InternalError("stop");
+                       }),
+               InternalError);
+}
+
+TEST(DatabaseTest, Select) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  EXPECT_EQ(db.Select("category:login not trashed:yes").size(), 10);
+  EXPECT_EQ(db.Select("category:login folder:business").size(), 1);
+  EXPECT_EQ(db.Select(
+      "folder:617F428170E1455D9503EC75AA103859 -category:login").size(), 3);
+  EXPECT_EQ(db.Select("updated>=2013-12-01").size(), 3);
+  EXPECT_EQ(db.Select("updated>=2013-12-01 trashed:no").size(), 1);
+  EXPECT_EQ(db.Select("created:1325483949").size(), 3);
+
+  Index::EntryList entries = db.Select("url:*.hulu.com");
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0]->title(), "Hulu");
+
+  entries = db.Select("(tag:Business or tag:Personal) -category:identity");
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0]->title(), "Bank of America");
+
+  entries = db.Select("hulu");
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0]->title(), "Hulu");
+  EXPECT_EQ(db.Select("title:\"driver's license\"").size(), 1);
+
+  // The most selective index drives the plan, the remaining terms are
+  // filters ordered by cost.
+  EXPECT_EQ(db.Plan("category:login tag:Personal").Explain(),
+            "scan tag index Personal (2 entries)\n"
+            "filter category:login [metadata]\n");
+  EXPECT_EQ(db.Plan("has:password url:*.com not trashed:yes").Explain(),
+            "scan url index *.com (9 entries)\n"
+            "filter not trashed:yes [metadata]\n"
+            "filter has:password [details]\n");
+  EXPECT_EQ(db.Plan("url:*/login has:password").Explain(),
+            "scan all entries (29 entries)\n"
+            "filter url:*/login [overview]\n"
+            "filter has:password [details]\n");
+  EXPECT_EQ(db.Select("category:login has:password").size(), 10);
+
+  // Results come in load order whatever the source of the candidates, and
+  // the URL index finds the same entries as matching each URL.
+  const Index::EntryList all = db.entries();
+  auto in_load_order = [&](const Index::EntryList& list) {
+    auto it = all.begin();
+    for (const auto& entry : list) {
+      it = std::find(it, all.end(), entry);
+      if (it == all.end())
+        return false;
+    }
+    return true;
+  };
+  for (const char* pattern : { "*.com", "*", "www.*", "*o?.com", "*.hulu.com",
+                               "apple.com", "*.unknown" }) {
+    Index::EntryList expected;
+    for (const auto& entry : all) {
+      bool match = false;
+      auto check = [&](const std::string& url) {
+        Url parsed(url);
+        match = match || (!parsed.empty() && GlobMatch(pattern, parsed.host()));
+      };
+      check(entry->url());
+      for (const auto& url : entry->urls())
+        check(url.second);
+      if (match)
+        expected.push_back(entry);
+    }
+    EXPECT_EQ(db.Select(std::string("url:") + pattern), expected) << pattern;
+  }
+  entries = db.Select("apple");
+  EXPECT_GT(entries.size(), 1);
+  EXPECT_TRUE(in_load_order(entries));
+  EXPECT_TRUE(in_load_order(db.Select("apple category:login")));
+
+  EXPECT_EQ(Query("a b or c -(d or e:\"f g\")").ToString(),
+            "((a and b) or (c and not (d or e:\"f g\")))");
+
+  EXPECT_THROW(db.Select("category:"), FormatError);
+  EXPECT_THROW(db.Select("(tag:Sample"), FormatError);
+  EXPECT_THROW(db.Select("tag:Sample)"), FormatError);
+  EXPECT_THROW(db.Select("updated>yesterday"), FormatError);
+  EXPECT_THROW(db.Select("tag>Sample"), FormatError);
+  EXPECT_THROW(db.Select("bogus:1"), FormatError);
+  EXPECT_THROW(db.Select("category:unicorn"), FormatError);
+  EXPECT_THROW(db.Select("category:\"\""), FormatError);
+  EXPECT_THROW(db.Select("category:99999999999"), FormatError);
+  EXPECT_THROW(db.Select("updated:99999999999999999999"), FormatError);
+  EXPECT_THROW(db.Select("updated>9223372036854775807"), FormatError);
+  EXPECT_THROW(db.Select(""), FormatError);
+}
+
+TEST(DatabaseTest, SortedListing) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+
+  // Tombstones are not listed.
+  std::vector<std::shared_ptr<Entry>> listed;
+  SortedIndex::Cursor cursor;
+  for (;;) {
+    SortedIndex::Page page = db.List(SortedIndex::Order::kTitle, 5, cursor);
+    EXPECT_LE(page.entries().size(), 5);
+    listed.insert(listed.end(), page.entries().begin(), page.entries().end());
+    cursor = page.next();
+    if (!page.more())
+      break;
+  }
+  ASSERT_EQ(listed.size(), 28);
+  for (std::size_t i = 1; i < listed.size(); ++i) {
+    EXPECT_LE(CollationKey(listed[i - 1]->title()),
+              CollationKey(listed[i]->title()));
+  }
+  EXPECT_EQ(listed.front()->title(), "1Password");
+  EXPECT_TRUE(db.List(SortedIndex::Order::kTitle, 5, cursor).entries().empty());
+
+  SortedIndex::Page recent = db.List(SortedIndex::Order::kModified, 3);
+  ASSERT_EQ(recent.entries().size(), 3);
+  EXPECT_EQ(recent.entries()[0]->title(), "A note with some attachments");
+  EXPECT_EQ(recent.entries()[1]->title(), "A note to Trash");
+  EXPECT_TRUE(recent.more());
+
+  std::vector<std::shared_ptr<Entry>> completions = db.Complete("wendy's", 10);
+  ASSERT_EQ(completions.size(), 2);
+  EXPECT_EQ(completions[0]->title(), "Wendy's driver's license");
+  EXPECT_EQ(completions[1]->title(), "Wendy's passport");
+  EXPECT_EQ(db.Complete("WENDY'S", 1).size(), 1);
+  EXPECT_EQ(db.Complete("the  UNOFF", 10).size(), 1);
+  EXPECT_TRUE(db.Complete("wendyx", 10).empty());
+}
+
+TEST(DatabaseTest, ChangedSince) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(GetTestPath("freddy-2013-12-04"), profile));
+  TimeIndex::Changes changes = db.ChangedSince(0);
+  EXPECT_EQ(changes.entries().size(), 29);
+  EXPECT_EQ(changes.folders().size(), 3);
+  EXPECT_EQ(changes.watermark(), 1386214885);
+  for (std::size_t i = 1; i < changes.entries().size(); ++i) {
+    EXPECT_LE(changes.entries()[i - 1]->transaction_time(),
+              changes.entries()[i]->transaction_time());
+  }
+
+  changes = db.ChangedSince(1373754000);
+  EXPECT_EQ(changes.entries().size(), 7);
+  ASSERT_EQ(changes.folders().size(), 1);
+  EXPECT_EQ(changes.folders()[0]->title(), "Has attachment");
+
+  changes = db.ChangedSince(1386214431);
+  ASSERT_EQ(changes.entries().size(), 2);
+  EXPECT_EQ(changes.entries()[0]->title(), "A note to Trash");
+  EXPECT_TRUE(changes.folders().empty());
+
+  changes = db.ChangedSince(changes.watermark());
+  EXPECT_TRUE(changes.entries().empty());
+  EXPECT_TRUE(changes.folders().empty());
+  EXPECT_EQ(changes.watermark(), 1386214885);
+
+  // Read in the second of the latest change, the watermark stays below it
+  // and the items changed in that second are reported again.
+  Folders folders;
+  EXPECT_NO_THROW(folders.Load(
+      GetTestPath("freddy-2013-12-04") + "/default/folders.js", profile));
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+  TimeIndex index;
+  index.Build(folders, bands);
+  changes = index.ChangedSince(1386214431, 1386214885);
+  ASSERT_EQ(changes.entries().size(), 2);
+  EXPECT_EQ(changes.watermark(), 1386214884);
+  changes = index.ChangedSince(changes.watermark(), 1386214885);
+  ASSERT_EQ(changes.entries().size(), 1);
+  EXPECT_EQ(changes.entries()[0]->transaction_time(), 1386214885);
+  EXPECT_EQ(changes.watermark(), 1386214884);
+  EXPECT_EQ(index.ChangedSince(changes.watermark(), 1386214886).watermark(),
+            1386214885);
+
+  std::vector<std::shared_ptr<Entry>> modified = db.EntriesBetween(
+      TimeIndex::Field::kModification, 1386214000, 1386214850);
+  ASSERT_EQ(modified.size(), 2);
+  EXPECT_EQ(modified[0]->uuid(),
+            ParseUuid("0C4F27910A64488BB339AED63565D148"));
+  EXPECT_EQ(modified[1]->title(), "A note to Trash");
+}
+
+TEST(DatabaseTest, LoadEntry) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::string path = GetTestPath("freddy-2013-12-04");
+  std::shared_ptr<Entry> hulu = Database::LoadEntry(
+      path, ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC"), profile);
+  ASSERT_TRUE(hulu != nullptr);
+  EXPECT_EQ(hulu->title(), "Hulu");
+  EXPECT_EQ(hulu->password(), "frirp7i1ob7wig4d");
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(path, profile));
+  for (const auto& entry : db.entries()) {
+    std::shared_ptr<Entry> loaded =
+        Database::LoadEntry(path, entry->uuid(), profile);
+    ASSERT_TRUE(loaded != nullptr);
+    EXPECT_EQ(loaded->category(), entry->category());
+    EXPECT_EQ(loaded->transaction_time(), entry->transaction_time());
+    EXPECT_EQ(loaded->notes(), entry->notes());
+  }
+
+  // Folder UUIDs appear as values in the bands but are not entries.
+  EXPECT_TRUE(Database::LoadEntry(
+      path, ParseUuid("617F428170E1455D9503EC75AA103859"), profile) == nullptr);
+  EXPECT_TRUE(Database::LoadEntry(path, Uuid(), profile) == nullptr);
+
+  // The details are kept in the details cache of the options, and entries
+  // not passing the filters are not loaded.
+  auto cache = std::make_shared<DetailsCache>(0);
+  LoadOptions options;
+  options.set_details_cache(cache);
+  hulu = Database::LoadEntry(
+      path, ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC"), profile, options);
+  ASSERT_TRUE(hulu != nullptr);
+  EXPECT_EQ(hulu->password(), "frirp7i1ob7wig4d");
+  EXPECT_EQ(cache->statistics().entries, 1);
+  EXPECT_GT(cache->statistics().size, 0);
+
+  options.set_categories({ Entry::Category::kSecureNote });
+  EXPECT_TRUE(Database::LoadEntry(
+      path, ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC"), profile,
+      options) == nullptr);
+}
+
+TEST(DatabaseTest, ForEachEntry) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::string path = GetTestPath("freddy-2013-12-04");
+  Database db;
+  EXPECT_NO_THROW(db.Load(path, profile));
+
+  std::set<Uuid> uuids;
+  EXPECT_NO_THROW(Database::ForEachEntry(path, profile, LoadOptions(),
+      [&](const Entry& entry) {
+        EXPECT_TRUE(uuids.insert(entry.uuid()).second);
+        std::shared_ptr<Entry> loaded = db.Find(entry.uuid());
+        ASSERT_TRUE(loaded != nullptr);
+        EXPECT_EQ(entry.title(), loaded->title());
+        EXPECT_EQ(entry.notes(), loaded->notes());
+        EXPECT_EQ(entry.password(), loaded->password());
+      }));
+  EXPECT_EQ(uuids.size(), db.entries().size());
+
+  LoadOptions options;
+  options.set_categories({ Entry::Category::kLogin });
+  std::size_t logins = 0;
+  EXPECT_NO_THROW(Database::ForEachEntry(path, profile, options,
+      [&](const Entry& entry) {
+        EXPECT_EQ(entry.category(), Entry::Category::kLogin);
+        ++logins;
+      }));
+  EXPECT_EQ(logins, 10);
+}
+
+TEST(DatabaseTest, LoadOptions) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::string path = GetTestPath("freddy-2013-12-04");
+  Database all;
+  EXPECT_NO_THROW(all.Load(path, profile));
+
+  Database db;
+  LoadOptions options;
+  options.set_categories({ Entry::Category::kLogin });
+  EXPECT_NO_THROW(db.Load(path, profile, options));
+  EXPECT_EQ(db.entries().size(), 10);
+  EXPECT_EQ(db.GetLoginItems().size(), 10);
+
+  options = LoadOptions();
+  options.set_tombstones(false);
+  EXPECT_NO_THROW(db.Load(path, profile, options));
+  EXPECT_EQ(db.entries().size(), 28);
+  EXPECT_FALSE(db.Find(ParseUuid("0C4F27910A64488BB339AED63565D148")));
+
+  Uuid business = ParseUuid("617F428170E1455D9503EC75AA103859");
+  options = LoadOptions();
+  options.set_folders({ business });
+  EXPECT_NO_THROW(db.Load(path, profile, options));
+  EXPECT_EQ(db.entries().size(), 4);
+
+  options.set_folders({ Uuid() });
+  EXPECT_NO_THROW(db.Load(path, profile, options));
+
+  std::size_t unfiled = 0;
+  std::size_t trashed = 0;
+  std::size_t recent = 0;
+  for (const auto& entry : all.entries()) {
+    unfiled += entry->folder_uuid().IsNil() ? 1 : 0;
+    trashed += entry->trashed() ? 1 : 0;
+    recent += entry->modification_time() >= 1386000000 ? 1 : 0;
+  }
+  EXPECT_EQ(db.entries().size(), unfiled);
+
+  options = LoadOptions();
+  options.set_trashed(false);
+  EXPECT_NO_THROW(db.Load(path, profile, options));
+  EXPECT_EQ(db.entries().size(), all.entries().size() - trashed);
+
+  options = LoadOptions();
+  options.set_updated_since(1386000000);
+  EXPECT_NO_THROW(db.Load(path, profile, options));
+  EXPECT_EQ(db.entries().size(), recent);
+
+  // An item without a category is filtered the same way from a band file
+  // and from a vault image.
+  json11::Json item = json11::Json::object {
+    { "uuid", "5A2B3C4D5E6F40718293A4B5C6D7E8F9" },
+    { "trashed", false },
+    { "updated", 1386000000 },
+  };
+  Entry uncategorized(ParseUuid("5A2B3C4D5E6F40718293A4B5C6D7E8F9"), item);
+  EXPECT_EQ(uncategorized.category(), Entry::Category::kUnknown);
+  Entry::Sealed sealed = uncategorized.sealed();
+
+  options = LoadOptions();
+  EXPECT_TRUE(options.Accepts(item));
+  EXPECT_TRUE(options.Accepts(sealed));
+  options.set_categories({ Entry::Category::kLogin });
+  EXPECT_FALSE(options.Accepts(item));
+  EXPECT_FALSE(options.Accepts(sealed));
+  options.set_categories({ Entry::Category::kUnknown });
+  EXPECT_TRUE(options.Accepts(item));
+  EXPECT_TRUE(options.Accepts(sealed));
+}
+
+TEST(DatabaseTest, LoadProgressively) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::string path = GetTestPath("freddy-2013-12-04");
+  Database all;
+  EXPECT_NO_THROW(all.Load(path, profile));
+
+  Database db;
+  std::vector<std::pair<std::size_t, std::size_t>> steps;
+  std::vector<std::shared_ptr<Entry>> first;
+  EXPECT_NO_THROW(db.LoadProgressively(
+      path, profile, ProgressiveLoader::Order::kRecentFirst,
+      [&](std::size_t loaded, std::size_t total) {
+        steps.push_back(std::make_pair(loaded, total));
+        if (first.empty())
+          first = db.entries();
+      }));
+  ASSERT_EQ(steps.size(), 2);
+  EXPECT_EQ(steps[0].first, 16);
+  EXPECT_EQ(steps[1].first, 29);
+  EXPECT_EQ(steps[1].second, 29);
+
+  // The first step holds the most recently modified entries.
+  ASSERT_EQ(first.size(), 16);
+  for (std::size_t i = 1; i < first.size(); ++i)
+    EXPECT_GE(first[i - 1]->modification_time(),
+              first[i]->modification_time());
+  std::set<Uuid> loaded;
+  for (const auto& entry : first)
+    loaded.insert(entry->uuid());
+  for (const auto& entry : all.entries()) {
+    if (loaded.count(entry->uuid()) == 0) {
+      EXPECT_LE(entry->modification_time(),
+                first.back()->modification_time());
+    }
+  }
+
+  // Once done, the result is the same as loading everything at once.
+  ASSERT_EQ(db.entries().size(), all.entries().size());
+  for (std::size_t i = 0; i < all.entries().size(); ++i)
+    EXPECT_EQ(db.entries()[i]->uuid(), all.entries()[i]->uuid());
+  EXPECT_EQ(db.GetLoginItems().size(), 10);
+  EXPECT_EQ(db.Search("hulu").size(), 1);
+  EXPECT_TRUE(db.Refresh().empty());
+
+  steps.clear();
+  LoadOptions options;
+  options.set_categories({ Entry::Category::kLogin });
+  EXPECT_NO_THROW(db.LoadProgressively(
+      path, profile, ProgressiveLoader::Order::kFavoritesFirst,
+      [&](std::size_t loaded, std::size_t total) {
+        steps.push_back(std::make_pair(loaded, total));
+      }, options));
+  ASSERT_EQ(steps.size(), 1);
+  EXPECT_EQ(steps[0].first, 10);
+  EXPECT_EQ(steps[0].second, 10);
+}
+
+TEST(DatabaseTest, Refresh) {
+  std::string path = CopyTestVault("freddy-2013-12-04");
+  ASSERT_FALSE(path.empty());
+
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(path + "/default/profile.js"));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(path, profile));
+  ASSERT_EQ(db.entries().size(), 29);
+
+  std::vector<Database::Delta> deltas;
+  int id = db.Subscribe([&](const Database::Delta& delta) {
+    deltas.push_back(delta);
+  });
+
+  EXPECT_TRUE(db.Refresh().empty());
+
+  // Rewriting a band without changing it.
+  std::string band0 = path + "/default/band_0.js";
+  std::string band1 = path + "/default/band_1.js";
+  json11::Json::object band = ReadBand(band0);
+  WriteBand(band0, band);
+  EXPECT_TRUE(db.Refresh().empty());
+  EXPECT_TRUE(deltas.empty());
+
+  // Removing an entry, the other entries are kept as is.
+  Uuid tombstone = ParseUuid("0C4F27910A64488BB339AED63565D148");
+  std::shared_ptr<Entry> personal =
+      db.Find(ParseUuid("0EDE2B13D7AC4E2C9105842682ACB187"));
+  json11::Json removed = band["0C4F27910A64488BB339AED63565D148"];
+  band.erase("0C4F27910A64488BB339AED63565D148");
+  WriteBand(band0, band);
+
+  Database::Delta delta = db.Refresh();
+  ASSERT_EQ(delta.removed().size(), 1);
+  EXPECT_EQ(delta.removed()[0]->uuid(), tombstone);
+  EXPECT_TRUE(delta.added().empty());
+  EXPECT_TRUE(delta.modified().empty());
+  EXPECT_FALSE(delta.folders_changed());
+  EXPECT_EQ(db.entries().size(), 28);
+  EXPECT_FALSE(db.Find(tombstone));
+  EXPECT_EQ(db.Find(personal->uuid()), personal);
+  EXPECT_EQ(deltas.size(), 1);
+
+  // Modifying an entry replaces it.
+  Uuid hulu_uuid = ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC");
+  std::shared_ptr<Entry> hulu = db.Find(hulu_uuid);
+  json11::Json::object other = ReadBand(band1);
+  json11::Json::object item = other["13C8E12AC8E54B1F873BAB0824E521BC"]
+      .object_items();
+  item["tx"] = 1400000000;
+  other["13C8E12AC8E54B1F873BAB0824E521BC"] = item;
+  WriteBand(band1, other);
+
+  delta = db.Refresh();
+  ASSERT_EQ(delta.modified().size(), 1);
+  EXPECT_NE(delta.modified()[0], hulu);
+  EXPECT_EQ(db.Find(hulu_uuid), delta.modified()[0]);
+  EXPECT_EQ(db.Find(hulu_uuid)->password(), "frirp7i1ob7wig4d");
+  EXPECT_EQ(db.GetLoginItems().size(), 10);
+  ASSERT_EQ(db.ChangedSince(1386214885).entries().size(), 1);
+  EXPECT_EQ(db.ChangedSince(1386214885).entries()[0]->uuid(), hulu_uuid);
+  EXPECT_EQ(db.Search("hulu").size(), 1);
+
+  // Adding the removed entry back.
+  db.Unsubscribe(id);
+  band[tombstone.ToString()] = removed;
+  WriteBand(band0, band);
+  delta = db.Refresh();
+  ASSERT_EQ(delta.added().size(), 1);
+  EXPECT_EQ(delta.added()[0]->uuid(), tombstone);
+  EXPECT_EQ(db.entries().size(), 29);
+  EXPECT_EQ(deltas.size(), 2);
+
+  RemoveTestVault(path);
+}
+
+TEST(DatabaseTest, Snapshot) {
+  std::string path = CopyTestVault("freddy-2013-12-04");
+  ASSERT_FALSE(path.empty());
+
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(path + "/default/profile.js"));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Database db;
+  EXPECT_TRUE(db.snapshot()->entries().empty());
+  EXPECT_NO_THROW(db.Load(path, profile));
+
+  std::shared_ptr<const Database::Snapshot> pinned = db.snapshot();
+  EntryView view = db.View();
+  EXPECT_EQ(pinned->version(), 1);
+  EXPECT_EQ(pinned->entries().size(), 29);
+
+  // Readers keep querying while the database is refreshed.
+  std::string band0 = path + "/default/band_0.js";
+  json11::Json::object band = ReadBand(band0);
+  band.erase("0C4F27910A64488BB339AED63565D148");
+  WriteBand(band0, band);
+
+  std::atomic<bool> done(false);
+  std::atomic<int> inconsistent(0);
+  std::thread reader([&]() {
+    while (!done) {
+      std::shared_ptr<const Database::Snapshot> snapshot = db.snapshot();
+      std::size_t size = snapshot->entries().size();
+      if (size != (snapshot->version() == 1 ? 29 : 28) ||
+          snapshot->Select("category:login").size() != 10)
+        ++inconsistent;
+    }
+  });
+  std::future<Database::Delta> refresh = db.RefreshAsync();
+  EXPECT_EQ(refresh.get().removed().size(), 1);
+  done = true;
+  reader.join();
+  EXPECT_EQ(inconsistent, 0);
+
+  // The pinned snapshot and the view still see the removed entry.
+  Uuid tombstone = ParseUuid("0C4F27910A64488BB339AED63565D148");
+  EXPECT_EQ(db.snapshot()->version(), 2);
+  EXPECT_EQ(db.entries().size(), 28);
+  EXPECT_FALSE(db.Find(tombstone));
+  EXPECT_TRUE(pinned->Find(tombstone) != nullptr);
+  EXPECT_EQ(pinned->entries().size(), 29);
+  pinned.reset();
+  EXPECT_EQ(view.Count(), 29);
+
+  RemoveTestVault(path);
+}
+
+TEST(DatabaseTest, LockUnlock) {
+  std::string path = CopyTestVault("freddy-2013-12-04");
+  ASSERT_FALSE(path.empty());
+
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(path + "/default/profile.js"));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  auto cache = std::make_shared<DetailsCache>(0);
+  LoadOptions options;
+  options.set_details_cache(cache);
+  options.set_index_notes(false);
+
+  Database db;
+  EXPECT_NO_THROW(db.Load(path, profile, options));
+  std::shared_ptr<const Database::Snapshot> unlocked = db.snapshot();
+
+  Uuid hulu_uuid = ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC");
+  Uuid business = ParseUuid("617F428170E1455D9503EC75AA103859");
+  EXPECT_NO_THROW(db.Lock());
+  EXPECT_TRUE(db.IsLocked());
+  EXPECT_TRUE(profile.IsLocked());
+
+  // The structural indexes are kept, the plain text is gone.
+  EXPECT_EQ(db.entries().size(), 29);
+  EXPECT_EQ(db.EntriesInCategory(Entry::Category::kLogin).size(), 10);
+  EXPECT_EQ(db.EntriesInFolder(business).size(), 4);
+  EXPECT_EQ(db.EntriesBetween(TimeIndex::Field::kTransaction, 0,
+                              1386214886).size(), 29);
+  std::shared_ptr<Entry> hulu = db.Find(hulu_uuid);
+  ASSERT_TRUE(hulu != nullptr);
+  EXPECT_TRUE(hulu->locked());
+  EXPECT_TRUE(hulu->title().empty());
+  EXPECT_THROW(hulu->details(), InternalError);
+  EXPECT_TRUE(db.GetLoginItems().empty());
+  EXPECT_TRUE(db.Search("hulu").empty());
+  EXPECT_TRUE(db.folders().empty());
+  EXPECT_THROW(db.Refresh(), InternalError);
+
+  // Readers holding the previous snapshot are not affected.
+  EXPECT_EQ(unlocked->Find(hulu_uuid)->title(), "Hulu");
+  unlocked.reset();
+
+  // Unlocking does not read the vault again.
+  for (std::size_t i = 0; i < Bands::kBandCount; ++i)
+    std::remove((path + "/default/" + Bands::BandFileName(i)).c_str());
+  std::remove((path + "/default/folders.js").c_str());
+
+  EXPECT_THROW(db.Unlock("wrong"), PasswordError);
+  EXPECT_TRUE(db.IsLocked());
+  EXPECT_NO_THROW(db.Unlock("freddy"));
+  EXPECT_FALSE(db.IsLocked());
+  EXPECT_FALSE(profile.IsLocked());
+  EXPECT_EQ(db.GetLoginItems().size(), 10);
+  EXPECT_EQ(db.Search("hulu").size(), 1);
+  EXPECT_EQ(db.FindFolder(business)->title(), "Business");
+
+  // The details stay encrypted until accessed.
+  EXPECT_EQ(cache->statistics().misses, 0);
+  EXPECT_EQ(db.Find(hulu_uuid)->password(), "frirp7i1ob7wig4d");
+  EXPECT_EQ(cache->statistics().misses, 1);
+
+  RemoveTestVault(path);
+}
+
+TEST(DatabaseTest, Image) {
+  std::string path = CopyTestVault("freddy-2013-12-04");
+  ASSERT_FALSE(path.empty());
+  std::string image = path + "/image.bin";
+
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(path + "/default/profile.js"));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  // Without an image the vault is loaded and an image saved.
+  Database db;
+  EXPECT_FALSE(db.LoadImage(path, profile, image));
+  ASSERT_EQ(db.entries().size(), 29);
+
+  Database cached;
+  EXPECT_TRUE(cached.LoadImage(path, profile, image));
+  std::vector<std::shared_ptr<Entry>> loaded = db.entries();
+  std::vector<std::shared_ptr<Entry>> restored = cached.entries();
+  ASSERT_EQ(restored.size(), loaded.size());
+  for (std::size_t i = 0; i < loaded.size(); ++i) {
+    const auto& lhs = loaded[i];
+    const auto& rhs = restored[i];
+    EXPECT_EQ(lhs->uuid(), rhs->uuid());
+    EXPECT_EQ(lhs->title(), rhs->title());
+    EXPECT_EQ(lhs->transaction_time(), rhs->transaction_time());
+    EXPECT_EQ(lhs->notes(), rhs->notes());
+  }
+  EXPECT_EQ(cached.folders().size(), db.folders().size());
+  EXPECT_EQ(cached.GetLoginItems().size(), 10);
+  EXPECT_EQ(cached.Find(ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC"))
+                ->password(), "frirp7i1ob7wig4d");
+  EXPECT_TRUE(cached.Refresh().empty());
+
+  LoadOptions options;
+  options.set_categories({ Entry::Category::kLogin });
+  EXPECT_TRUE(cached.LoadImage(path, profile, image, options));
+  EXPECT_EQ(cached.entries().size(), 10);
+
+  // An image saved with filters lacks the filtered entries, it is not used
+  // with other filters.
+  std::string filtered = path + "/filtered.bin";
+  Database logins;
+  EXPECT_FALSE(logins.LoadImage(path, profile, filtered, options));
+  EXPECT_EQ(logins.entries().size(), 10);
+  EXPECT_TRUE(logins.LoadImage(path, profile, filtered, options));
+  EXPECT_EQ(logins.entries().size(), 10);
+  EXPECT_FALSE(logins.LoadImage(path, profile, filtered));
+  EXPECT_EQ(logins.entries().size(), 29);
+  EXPECT_TRUE(logins.LoadImage(path, profile, filtered, options));
+  EXPECT_EQ(logins.entries().size(), 10);
+
+  // A changed band makes the image stale, it is then saved again.
+  std::string band0 = path + "/default/band_0.js";
+  json11::Json::object band = ReadBand(band0);
+  band.erase("0C4F27910A64488BB339AED63565D148");
+  WriteBand(band0, band);
+  EXPECT_FALSE(cached.LoadImage(path, profile, image));
+  EXPECT_EQ(cached.entries().size(), 28);
+  EXPECT_TRUE(cached.LoadImage(path, profile, image));
+  EXPECT_EQ(cached.entries().size(), 28);
+
+  // A tampered image is not used.
+  {
+    std::fstream file(image, std::ios::in | std::ios::out |
+                             std::ios::binary);
+    file.seekp(200);
+    file.put('x');
+  }
+  EXPECT_FALSE(cached.LoadImage(path, profile, image));
+  EXPECT_EQ(cached.entries().size(), 28);
+
+  // A sealed image with damaged offsets is not used either, the vault is
+  // loaded and the image saved again. The offsets patched are the folders
+  // size in the header, and the band and key offset of the first record.
+  const std::size_t kFoldersSize = 24;
+  const std::size_t kRecordsOffset = 32;
+  uint64_t records_offset = 0;
+  {
+    std::ifstream src(image, std::ios::in | std::ios::binary);
+    src.seekg(kRecordsOffset);
+    src.read(reinterpret_cast<char*>(&records_offset),
+             sizeof(records_offset));
+  }
+  const std::pair<std::size_t, uint64_t> patches[] = {
+    { kFoldersSize, ~static_cast<uint64_t>(0) - 8 },
+    { records_offset + 96, static_cast<uint64_t>(99) << 32 },
+    { records_offset + 104, ~static_cast<uint64_t>(0) - 8 }
+  };
+  for (const auto& patch : patches) {
+    PatchImage(image, profile, patch.first, patch.second);
+    EXPECT_NO_THROW(EXPECT_FALSE(cached.LoadImage(path, profile, image)));
+    EXPECT_EQ(cached.entries().size(), 28);
+    EXPECT_TRUE(cached.LoadImage(path, profile, image));
+  }
+
+  // Failing to save the image does not fail the load.
+  Database unsaved;
+  EXPECT_NO_THROW(EXPECT_FALSE(unsaved.LoadImage(
+      path, profile, path + "/missing/image.bin")));
+  EXPECT_EQ(unsaved.entries().size(), 28);
+  EXPECT_THROW(unsaved.SaveImage(path + "/missing/image.bin"), IoError);
+
+  RemoveTestVault(path);
+}
@@ -0,0 +1,97 @@
+/*
+ * libonepass - 1Password key database importer/exporter
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "bands.hh"
+#include "details_cache.hh"
+#include "profile.hh"
+
+using namespace onepass;
+
+namespace {
+
+std::string GetTestPath(const std::string& name) {
+  return "./test/data/" + name;
+}
+
+std::string GetTestProfilePath(const std::string& name) {
+  return GetTestPath(name) + "/default/profile.js";
+}
+
+} // namespace
+
+TEST(DetailsCacheTest, Budget) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  auto cache = std::make_shared<DetailsCache>(0);
+  LoadOptions options;
+  options.set_details_cache(cache);
+
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile, options));
+  ASSERT_EQ(bands.entries().size(), 29);
+  EXPECT_EQ(cache->statistics().entries, 0);
+
+  // Without a budget only the most recently used details are kept.
+  std::shared_ptr<Entry> first = bands.entries()[0];
+  std::shared_ptr<Entry> second = bands.entries()[1];
+  std::shared_ptr<const Entry::Details> details = first->details();
+  EXPECT_TRUE(first->has_details());
+  EXPECT_EQ(first->details(), details);
+  std::shared_ptr<const Entry::Details> second_details = second->details();
+  EXPECT_NE(second_details, details);
+  EXPECT_EQ(second->details(), second_details);
+  EXPECT_FALSE(first->has_details());
+  EXPECT_TRUE(second->has_details());
+
+  DetailsCache::Statistics statistics = cache->statistics();
+  EXPECT_EQ(statistics.hits, 2);
+  EXPECT_EQ(statistics.misses, 2);
+  EXPECT_EQ(statistics.evictions, 1);
+  EXPECT_EQ(statistics.entries, 1);
+
+  // Re-decrypting evicted details gives equal values.
+  EXPECT_NE(first->details(), details);
+  EXPECT_EQ(first->details()->notes(), details->notes());
+  EXPECT_EQ(cache->statistics().misses, 3);
+
+  // With a large enough budget everything is kept.
+  cache->set_budget(1 << 20);
+  for (const auto& entry : bands.entries())
+    entry->details();
+  statistics = cache->statistics();
+  EXPECT_EQ(statistics.entries, 29);
+  EXPECT_LE(statistics.size, cache->budget());
+
+  // Shrinking the budget evicts the least recently used details.
+  cache->set_budget(statistics.size / 2);
+  EXPECT_LE(cache->statistics().size, cache->budget());
+  EXPECT_TRUE(bands.entries().back()->has_details());
+  EXPECT_FALSE(bands.entries().front()->has_details());
+
+  // Destroyed entries leave the cache.
+  bands = Bands();
+  first.reset();
+  second.reset();
+  EXPECT_EQ(cache->statistics().entries, 0);
+  EXPECT_EQ(cache->statistics().size, 0);
+}
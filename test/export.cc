@@ -0,0 +1,298 @@
+/*
+ * libonepass - 1Password key database importer/exporter
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <openssl/hmac.h>
+
+#include "bands.hh"
+#include "cipher.hh"
+#include "data.hh"
+#include "exception.hh"
+#include "exporter.hh"
+#include "json11.hh"
+#include "profile.hh"
+
+using namespace onepass;
+
+namespace {
+
+std::string GetTestPath(const std::string& name) {
+  return "./test/data/" + name;
+}
+
+std::string GetTestProfilePath(const std::string& name) {
+  return GetTestPath(name) + "/default/profile.js";
+}
+
+/**
+ * Encrypts text in the opdata01 format read by ReadOpData.
+ */
+std::string WriteOpData(const std::string& text,
+                        const std::array<uint8_t, 32>& key,
+                        const std::array<uint8_t, 32>& mac_key) {
+  // The plain text is preceded by padding up to a whole number of blocks.
+  std::string plain(16 - text.size() % 16, '\0');
+  plain.append(text);
+
+  std::array<uint8_t, 16> prv = { { 0 } };
+  for (std::size_t i = 0; i < prv.size(); ++i)
+    prv[i] = static_cast<uint8_t>(i);
+
+  uint64_t size = text.size();
+  std::string data("opdata01");
+  data.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  data.append(reinterpret_cast<const char*>(prv.data()), prv.size());
+
+  AesCipher cipher(key);
+  for (std::size_t pos = 0; pos < plain.size(); pos += 16) {
+    std::array<uint8_t, 16> block;
+    for (std::size_t i = 0; i < 16; ++i)
+      block[i] = static_cast<uint8_t>(plain[pos + i]) ^ prv[i];
+    cipher.Encrypt(block, prv);
+    data.append(reinterpret_cast<const char*>(prv.data()), prv.size());
+  }
+
+  std::array<uint8_t, 32> hmac;
+  HMAC(EVP_sha256(), mac_key.data(), mac_key.size(),
+       reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+       hmac.data(), nullptr);
+  data.append(reinterpret_cast<const char*>(hmac.data()), hmac.size());
+  return data;
+}
+
+/**
+ * Creates an entry with the item keys of an existing entry but with a
+ * different overview and details.
+ */
+std::shared_ptr<Entry> MakeEntry(const Entry& base, Profile& profile,
+                                 const json11::Json& overview,
+                                 const json11::Json& details) {
+  std::string keys = ReadData(base.sealed().key_data, profile.master_key(),
+                              profile.master_mac_key());
+  std::array<uint8_t, 32> key;
+  std::array<uint8_t, 32> mac_key;
+  std::memcpy(key.data(), keys.data(), key.size());
+  std::memcpy(mac_key.data(), keys.data() + key.size(), mac_key.size());
+
+  Entry::Sealed sealed = base.sealed();
+  sealed.overview_data = WriteOpData(overview.dump(), profile.overview_key(),
+                                     profile.overview_mac_key());
+  sealed.details_data = WriteOpData(details.dump(), key, mac_key);
+  return std::make_shared<Entry>(sealed, &profile);
+}
+
+/**
+ * Stream buffer failing every write.
+ */
+class FailingBuffer final : public std::streambuf {
+ protected:
+  int_type overflow(int_type) override { return traits_type::eof(); }
+};
+
+} // namespace
+
+TEST(ExportTest, JsonLines) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  auto format = std::make_shared<JsonLinesFormat>();
+  std::ostringstream out;
+  EXPECT_EQ(Exporter(format, 4, 2).Export(GetTestPath("freddy-2013-12-04"),
+                                          profile, LoadOptions(), out), 29);
+  std::string text = out.str();
+  EXPECT_EQ(std::count(text.begin(), text.end(), '\n'), 29);
+
+  bool found = false;
+  std::istringstream lines(text);
+  for (std::string line; std::getline(lines, line);) {
+    std::string err;
+    json11::Json json = json11::Json::parse(line, err);
+    EXPECT_TRUE(err.empty());
+    if (json["uuid"].string_value() == "13C8E12AC8E54B1F873BAB0824E521BC") {
+      EXPECT_EQ(json["title"].string_value(), "Hulu");
+      EXPECT_EQ(json["category"].string_value(), "001");
+      EXPECT_EQ(json["password"].string_value(), "frirp7i1ob7wig4d");
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+
+  // The order of the output does not depend on the number of threads.
+  std::ostringstream serial;
+  EXPECT_EQ(Exporter(format, 1).Export(GetTestPath("freddy-2013-12-04"),
+                                       profile, LoadOptions(), serial), 29);
+  EXPECT_EQ(serial.str(), text);
+
+  LoadOptions options;
+  options.set_categories({ Entry::Category::kLogin });
+  std::ostringstream logins;
+  EXPECT_EQ(Exporter(format, 4, 2).Export(GetTestPath("freddy-2013-12-04"),
+                                          profile, options, logins), 10);
+  text = logins.str();
+  EXPECT_EQ(std::count(text.begin(), text.end(), '\n'), 10);
+}
+
+TEST(ExportTest, Entries) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+
+  std::ostringstream csv;
+  EXPECT_EQ(Exporter(std::make_shared<CsvFormat>(), 3, 1).Export(
+      bands.entries(), csv), 29);
+  std::string text = csv.str();
+  EXPECT_EQ(text.compare(0, 5, "uuid,"), 0);
+  EXPECT_NE(text.find("13C8E12AC8E54B1F873BAB0824E521BC,001,Hulu,"),
+            std::string::npos);
+  EXPECT_NE(text.find(",frirp7i1ob7wig4d,"), std::string::npos);
+
+  std::ostringstream xml;
+  EXPECT_EQ(Exporter(std::make_shared<KeePassXmlFormat>()).Export(
+      bands.entries(), xml), 29);
+  text = xml.str();
+  EXPECT_EQ(text.compare(0, 5, "<?xml"), 0);
+  EXPECT_NE(text.find("<Value>Hulu</Value>"), std::string::npos);
+  EXPECT_NE(text.find("<Value ProtectInMemory=\"True\">frirp7i1ob7wig4d"
+                      "</Value>"), std::string::npos);
+  EXPECT_EQ(text.substr(text.size() - 30), "</Group></Root></KeePassFile>\n");
+}
+
+TEST(ExportTest, Escaping) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  std::shared_ptr<Entry> hulu = Bands::LoadEntry(
+      GetTestPath("freddy-2013-12-04") + "/default/",
+      ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC"), profile);
+  ASSERT_TRUE(hulu != nullptr);
+
+  json11::Json overview = json11::Json::object {
+    { "title", "Tom & Jerry's \"<Cartoons>\", Inc." }
+  };
+  json11::Json details = json11::Json::object {
+    { "notesPlain", "line 1\r\nline 2\x01\x1f" },
+    { "fields", json11::Json::array {
+      json11::Json::object {
+        { "name", "username" },
+        { "designation", "username" },
+        { "type", "T" },
+        { "value", "tom,jerry" }
+      },
+      json11::Json::object {
+        { "name", "password" },
+        { "designation", "password" },
+        { "type", "P" },
+        { "value", "a<b>&c" }
+      }
+    } },
+    { "sections", json11::Json::array {
+      json11::Json::object {
+        { "name", "extra" },
+        { "title", "Extra" },
+        { "fields", json11::Json::array {
+          json11::Json::object {
+            { "k", "string" },
+            { "n", "quote" },
+            { "t", "\"Quote\" & <tag>" },
+            { "v", "it's\ta \"test\"\x07" }
+          }
+        } }
+      }
+    } }
+  };
+  std::vector<std::shared_ptr<Entry>> entries = {
+    MakeEntry(*hulu, profile, overview, details)
+  };
+  ASSERT_EQ(entries[0]->title(), "Tom & Jerry's \"<Cartoons>\", Inc.");
+
+  // Fields containing separators, quotes or line breaks are quoted, with
+  // quotes doubled. Other fields are written as is.
+  std::ostringstream csv;
+  EXPECT_EQ(Exporter(std::make_shared<CsvFormat>(), 1).Export(entries, csv),
+            1);
+  std::string text = csv.str();
+  EXPECT_NE(text.find(",001,\"Tom & Jerry's \"\"<Cartoons>\"\", Inc.\","),
+            std::string::npos);
+  EXPECT_NE(text.find(",\"tom,jerry\",a<b>&c,,"), std::string::npos);
+  EXPECT_NE(text.find(",\"line 1\r\nline 2\x01\x1f\","),
+            std::string::npos);
+
+  // Markup characters are escaped and control characters other than white
+  // space dropped.
+  std::ostringstream xml;
+  EXPECT_EQ(Exporter(std::make_shared<KeePassXmlFormat>(), 1).Export(
+      entries, xml), 1);
+  text = xml.str();
+  EXPECT_NE(text.find("<Value>Tom &amp; Jerry&apos;s &quot;&lt;Cartoons&gt;"
+                      "&quot;, Inc.</Value>"), std::string::npos);
+  EXPECT_NE(text.find("<Value>tom,jerry</Value>"), std::string::npos);
+  EXPECT_NE(text.find("<Value ProtectInMemory=\"True\">a&lt;b&gt;&amp;c"
+                      "</Value>"), std::string::npos);
+  EXPECT_NE(text.find("<Value>line 1\r\nline 2</Value>"),
+            std::string::npos);
+  EXPECT_NE(text.find("<Key>&quot;Quote&quot; &amp; &lt;tag&gt;</Key>"
+                      "<Value>it&apos;s\ta &quot;test&quot;</Value>"),
+            std::string::npos);
+  EXPECT_EQ(text.find('\x01'), std::string::npos);
+  EXPECT_EQ(text.find('\x07'), std::string::npos);
+}
+
+TEST(ExportTest, WriteError) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  auto format = std::make_shared<JsonLinesFormat>();
+  FailingBuffer buffer;
+  std::ostream out(&buffer);
+  EXPECT_THROW(Exporter(format, 4, 1).Export(
+      GetTestPath("freddy-2013-12-04"), profile, LoadOptions(), out),
+      IoError);
+
+  // Enough entries for the writer to fail while the reader and the workers
+  // are still waiting on the full queues.
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+  std::vector<std::shared_ptr<Entry>> entries;
+  for (int i = 0; i < 200; ++i) {
+    entries.insert(entries.end(), bands.entries().begin(),
+                   bands.entries().end());
+  }
+  std::ostringstream size;
+  EXPECT_EQ(Exporter(format, 1).Export(bands.entries(), size), 29);
+  EXPECT_GT(size.str().size() * 200, 1u << 20);
+
+  std::ostream failing(&buffer);
+  EXPECT_THROW(Exporter(format, 4, 1).Export(entries, failing), IoError);
+}
@@ -0,0 +1,72 @@
+/*
+ * libonepass - 1Password key database importer/exporter
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "exception.hh"
+#include "regex.hh"
+
+using namespace onepass;
+
+namespace {
+
+bool Search(const std::string& pattern, const std::string& text,
+            bool ignore_case = false) {
+  Regex::Matcher matcher(std::make_shared<const Regex>(pattern, ignore_case));
+  return matcher.Search(text);
+}
+
+} // namespace
+
+TEST(RegexTest, Search) {
+  EXPECT_TRUE(Search("abc", "xabcx"));
+  EXPECT_FALSE(Search("abc", "ab"));
+  EXPECT_TRUE(Search("a.c", "abc"));
+  EXPECT_FALSE(Search("a.c", "a\nc"));
+  EXPECT_TRUE(Search("^ab", "abc"));
+  EXPECT_FALSE(Search("^ab", "cab"));
+  EXPECT_TRUE(Search("bc$", "abc"));
+  EXPECT_FALSE(Search("bc$", "bca"));
+  EXPECT_TRUE(Search("^$", ""));
+  EXPECT_TRUE(Search("(?:foo|bar)baz", "xbarbaz"));
+  EXPECT_TRUE(Search("colou?r", "color"));
+  EXPECT_TRUE(Search("^(ab)+c$", "ababc"));
+  EXPECT_FALSE(Search("^(ab)+c$", "c"));
+  EXPECT_TRUE(Search("^a{2,3}$", "aaa"));
+  EXPECT_FALSE(Search("^a{2,3}$", "aaaa"));
+  EXPECT_TRUE(Search("^a{2,}$", "aaaa"));
+  EXPECT_TRUE(Search("x{", "x{"));
+  EXPECT_TRUE(Search("[^a-c]", "abcd"));
+  EXPECT_FALSE(Search("[^a-c]", "abc"));
+  EXPECT_TRUE(Search("\\d{4}-\\d{2}", "on 2013-12"));
+  EXPECT_TRUE(Search("\\w+@\\w+\\.com", "me@host.com"));
+  EXPECT_TRUE(Search("\\x41", "A"));
+  EXPECT_TRUE(Search("hello", "Say HeLLo", true));
+  EXPECT_TRUE(Search("[^a]", "A", false));
+  EXPECT_FALSE(Search("[^a]", "A", true));
+}
+
+TEST(RegexTest, InvalidPatterns) {
+  EXPECT_THROW(Regex("(", false), FormatError);
+  EXPECT_THROW(Regex("a)", false), FormatError);
+  EXPECT_THROW(Regex("*a", false), FormatError);
+  EXPECT_THROW(Regex("[a", false), FormatError);
+  EXPECT_THROW(Regex("\\b", false), FormatError);
+  EXPECT_THROW(Regex("a{3,1}", false), FormatError);
+  EXPECT_THROW(Regex("(a{1000}){1000}", false), FormatError);
+}
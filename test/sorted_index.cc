@@ -0,0 +1,84 @@
+/*
+ * libonepass - 1Password key database importer/exporter
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "profile.hh"
+#include "sorted_index.hh"
+
+using namespace onepass;
+
+namespace {
+
+std::string GetTestPath(const std::string& name) {
+  return "./test/data/" + name;
+}
+
+std::string GetTestProfilePath(const std::string& name) {
+  return GetTestPath(name) + "/default/profile.js";
+}
+
+} // namespace
+
+TEST(SortedIndexTest, CollationKey) {
+  EXPECT_EQ(CollationKey("  Hello \t World  "), "hello world");
+  EXPECT_EQ(CollationKey("\xc3\x84rger \xc3\xbc" "ber"), "arger uber");
+  EXPECT_EQ(CollationKey("Stra\xc3\x9f" "e"), "strasse");
+  EXPECT_EQ(CollationKey("\xc3\x86sir"), "aesir");
+  EXPECT_EQ(CollationKey("5 \xc3\x97 5"), "5 \xc3\x97 5");
+  EXPECT_EQ(CollationKey(""), "");
+}
+
+TEST(SortedIndexTest, StableCursor) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+
+  SortedIndex index;
+  index.Build(bands);
+  EXPECT_EQ(index.size(), 28);
+
+  SortedIndex::Page first = index.List(SortedIndex::Order::kTitle, 3);
+  ASSERT_EQ(first.entries().size(), 3);
+  SortedIndex::Page second = index.List(SortedIndex::Order::kTitle, 3,
+                                        first.next());
+  ASSERT_EQ(second.entries().size(), 3);
+
+  // Removing entries already seen does not shift the following page.
+  index.Remove(first.entries()[0]);
+  index.Remove(first.entries()[1]);
+  EXPECT_EQ(index.size(), 26);
+  SortedIndex::Page again = index.List(SortedIndex::Order::kTitle, 3,
+                                       first.next());
+  EXPECT_EQ(again.entries(), second.entries());
+
+  index.Add(first.entries()[0]);
+  index.Add(first.entries()[0]);
+  EXPECT_EQ(index.size(), 27);
+  EXPECT_EQ(index.List(SortedIndex::Order::kTitle, 1).entries()[0],
+            first.entries()[0]);
+
+  index.Update(bands);
+  EXPECT_EQ(index.size(), 28);
+  index.Clear();
+  EXPECT_TRUE(index.List(SortedIndex::Order::kModified, 10).entries().empty());
+}
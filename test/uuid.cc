@@ -0,0 +1,66 @@
+/*
+ * libonepass - 1Password key database importer/exporter
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unordered_set>
+
+#include <gtest/gtest.h>
+
+#include "exception.hh"
+#include "uuid.hh"
+
+using namespace onepass;
+
+TEST(UuidTest, ParseAndFormat) {
+  Uuid uuid = ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC");
+  EXPECT_EQ(uuid.bytes()[0], 0x13);
+  EXPECT_EQ(uuid.bytes()[1], 0xc8);
+  EXPECT_EQ(uuid.bytes()[15], 0xbc);
+  EXPECT_EQ(uuid.ToString(), "13C8E12AC8E54B1F873BAB0824E521BC");
+  EXPECT_FALSE(uuid.IsNil());
+
+  EXPECT_EQ(ParseUuid("13c8e12ac8e54b1f873bab0824e521bc"), uuid);
+  EXPECT_EQ(ParseUuid("0123456789abcdefABCDEF0000000000").ToString(),
+            "0123456789ABCDEFABCDEF0000000000");
+  EXPECT_TRUE(Uuid().IsNil());
+  EXPECT_EQ(Uuid().ToString(), "00000000000000000000000000000000");
+}
+
+TEST(UuidTest, InvalidInput) {
+  EXPECT_THROW(ParseUuid(""), FormatError);
+  EXPECT_THROW(ParseUuid("13C8E12AC8E54B1F873BAB0824E521B"), FormatError);
+  EXPECT_THROW(ParseUuid("13C8E12AC8E54B1F873BAB0824E521BG"), FormatError);
+  EXPECT_THROW(ParseUuid("g3C8E12AC8E54B1F873BAB0824E521BC"), FormatError);
+  EXPECT_THROW(ParseUuid("13C8E12AC8E54B1F:73BAB0824E521BC"), FormatError);
+  EXPECT_THROW(ParseUuid("13C8E12AC8E54B1F 73BAB0824E521BC"), FormatError);
+}
+
+TEST(UuidTest, HashAndOrder) {
+  Uuid a = ParseUuid("13C8E12AC8E54B1F873BAB0824E521BC");
+  Uuid b = ParseUuid("2A632FDD32F5445E91EB5636C7580447");
+
+  EXPECT_TRUE(a < b);
+  EXPECT_FALSE(b < a);
+  EXPECT_NE(a, b);
+
+  std::unordered_set<Uuid> set;
+  set.insert(a);
+  set.insert(b);
+  set.insert(ParseUuid("2a632fdd32f5445e91eb5636c7580447"));
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_EQ(set.count(a), 1);
+}
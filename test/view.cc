@@ -0,0 +1,112 @@
+/*
+ * libonepass - 1Password key database importer/exporter
+ * Copyright (C) 2014 Christian Kindahl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "bands.hh"
+#include "profile.hh"
+#include "view.hh"
+
+using namespace onepass;
+
+namespace {
+
+std::string GetTestPath(const std::string& name) {
+  return "./test/data/" + name;
+}
+
+std::string GetTestProfilePath(const std::string& name) {
+  return GetTestPath(name) + "/default/profile.js";
+}
+
+} // namespace
+
+TEST(ViewTest, Predicates) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+
+  EntryView all(bands.entries());
+  EXPECT_EQ(all.Count(), 29);
+
+  EntryView logins = all.Where(
+      Predicate::InCategory(Entry::Category::kLogin));
+  EXPECT_EQ(logins.Count(), 10);
+  for (const auto& entry : logins)
+    EXPECT_EQ(entry->category(), Entry::Category::kLogin);
+
+  Uuid folder = ParseUuid("617F428170E1455D9503EC75AA103859");
+  EXPECT_EQ(all.Where(Predicate::InFolder(folder)).Count(), 4);
+  EXPECT_EQ(logins.Where(Predicate::InFolder(folder)).Count(), 1);
+
+  EXPECT_EQ(all.Where(Predicate::Trashed()).Count(), 2);
+  EXPECT_EQ(all.Where(Predicate::ModifiedSince(1386214000)).Count(), 3);
+  EXPECT_EQ(all.Where(Predicate::ModifiedSince(1386214000) &&
+                      !Predicate::Trashed()).Count(), 1);
+  EXPECT_EQ(all.Where(Predicate::CreatedBetween(0, 1325483950)).Count(), 3);
+
+  EntryView personal = all.Where(Predicate::HasTag("Personal"));
+  EXPECT_EQ(personal.Count(), 2);
+  EntryView personal_logins = personal.Where(
+      Predicate::InCategory(Entry::Category::kLogin));
+  ASSERT_EQ(personal_logins.Count(), 1);
+  EXPECT_EQ((*personal_logins.begin())->title(), "Bank of America");
+
+  EXPECT_EQ(all.Where(Predicate::HasTag("Business") ||
+                      Predicate::HasTag("Personal")).Count(), 3);
+  EXPECT_TRUE(all.Where(Predicate::HasTag("Nothing")).empty());
+}
+
+TEST(ViewTest, LazyDetails) {
+  Profile profile;
+  EXPECT_NO_THROW(profile.Load(GetTestProfilePath("freddy-2013-12-04")));
+  EXPECT_NO_THROW(profile.Unlock("freddy"));
+
+  Bands bands;
+  EXPECT_NO_THROW(bands.Load(GetTestPath("freddy-2013-12-04") + "/default/",
+                             profile));
+  for (const auto& entry : bands.entries())
+    EXPECT_FALSE(entry->has_details());
+
+  // The details predicate is added first but evaluated last, only the
+  // entries passing the metadata predicates get decrypted.
+  Predicate has_password(Predicate::Cost::kDetails, [](const Entry& entry) {
+    return !entry.password().empty();
+  });
+  EntryView view = EntryView(bands.entries()).Where(has_password).Where(
+      Predicate::InCategory(Entry::Category::kLogin));
+  EXPECT_EQ(view.Count(), 10);
+
+  std::size_t decrypted = 0;
+  for (const auto& entry : bands.entries()) {
+    if (entry->has_details()) {
+      EXPECT_EQ(entry->category(), Entry::Category::kLogin);
+      ++decrypted;
+    }
+  }
+  EXPECT_EQ(decrypted, 10);
+
+  std::shared_ptr<const Entry::Details> details =
+      (*view.begin())->details();
+  EXPECT_EQ(details, (*view.begin())->details());
+  EXPECT_FALSE(details->password().empty());
+}